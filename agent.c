@@ -0,0 +1,344 @@
+/* gdb agent expression interpreter, for conditional breakpoints */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent.h"
+#include "log.h"
+
+//opcodes, see gdb/ax.def
+enum
+  {
+    AX_ADD          = 0x02,
+    AX_SUB          = 0x03,
+    AX_MUL          = 0x04,
+    AX_DIV_SIGNED   = 0x05,
+    AX_DIV_UNSIGNED = 0x06,
+    AX_REM_SIGNED   = 0x07,
+    AX_REM_UNSIGNED = 0x08,
+    AX_LSH          = 0x09,
+    AX_RSH_SIGNED   = 0x0A,
+    AX_RSH_UNSIGNED = 0x0B,
+    AX_TRACE        = 0x0C,
+    AX_TRACE_QUICK  = 0x0D,
+    AX_LOG_NOT      = 0x0E,
+    AX_BIT_AND      = 0x0F,
+    AX_BIT_OR       = 0x10,
+    AX_BIT_XOR      = 0x11,
+    AX_BIT_NOT      = 0x12,
+    AX_EQUAL        = 0x13,
+    AX_LESS_SIGNED  = 0x14,
+    AX_LESS_UNSIGNED= 0x15,
+    AX_EXT          = 0x16,
+    AX_REF8         = 0x17,
+    AX_REF16        = 0x18,
+    AX_REF32        = 0x19,
+    AX_REF64        = 0x1A,
+    AX_IF_GOTO      = 0x20,
+    AX_GOTO         = 0x21,
+    AX_CONST8       = 0x22,
+    AX_CONST16      = 0x23,
+    AX_CONST32      = 0x24,
+    AX_CONST64      = 0x25,
+    AX_REG          = 0x26,
+    AX_END          = 0x27,
+    AX_DUP          = 0x28,
+    AX_POP          = 0x29,
+    AX_ZERO_EXT     = 0x2A,
+    AX_SWAP         = 0x2B,
+    AX_TRACEV       = 0x2E,
+    AX_TRACENZ      = 0x2F,
+    AX_TRACE16      = 0x30,
+    AX_PICK         = 0x32,
+    AX_ROT          = 0x33,
+  };
+
+//operand bytes following each supported opcode, -1 for unsupported ones
+static int ax_operands(uint8_t op)
+  {
+    switch(op)
+      {
+      case AX_EXT: case AX_ZERO_EXT: case AX_TRACE_QUICK: case AX_PICK: case AX_CONST8:
+        return 1;
+      case AX_IF_GOTO: case AX_GOTO: case AX_CONST16: case AX_REG:
+      case AX_TRACEV: case AX_TRACE16:
+        return 2;
+      case AX_CONST32:
+        return 4;
+      case AX_CONST64:
+        return 8;
+      default:
+        if((op >= AX_ADD && op <= AX_REF64) || op == AX_END || op == AX_DUP ||
+           op == AX_POP || op == AX_SWAP || op == AX_TRACENZ || op == AX_ROT)
+          {
+            return 0;
+          }
+        return -1;
+      }
+  }
+
+struct hc11_agent *hc11_agent_create(const uint8_t *code, uint16_t len)
+  {
+    struct hc11_agent *ax;
+    uint16_t pc, target;
+    int n;
+
+    if(len == 0 || len > AGENT_MAX_CODE)
+      {
+        return NULL;
+      }
+    //every opcode known, operands and jump targets inside the code
+    for(pc = 0; pc < len; pc += 1 + n)
+      {
+        n = ax_operands(code[pc]);
+        if(n < 0 || pc + 1 + n > len)
+          {
+            return NULL;
+          }
+        if(code[pc] == AX_IF_GOTO || code[pc] == AX_GOTO)
+          {
+            target = (code[pc+1] << 8) | code[pc+2];
+            if(target >= len)
+              {
+                return NULL;
+              }
+          }
+      }
+
+    ax = malloc(sizeof(struct hc11_agent) + len);
+    if(!ax)
+      {
+        return NULL;
+      }
+    ax->next = NULL;
+    ax->len  = len;
+    memcpy(ax->code, code, len);
+    return ax;
+  }
+
+void hc11_agent_free(struct hc11_agent *list)
+  {
+    struct hc11_agent *next;
+    while(list)
+      {
+        next = list->next;
+        free(list);
+        list = next;
+      }
+  }
+
+//big endian operand of n bytes
+static uint64_t ax_operand(const uint8_t *p, int n)
+  {
+    uint64_t val = 0;
+    while(n--)
+      {
+        val = (val << 8) | *p++;
+      }
+    return val;
+  }
+
+static int64_t ax_sext(uint64_t val, int bits)
+  {
+    if(bits <= 0 || bits >= 64)
+      {
+        return val;
+      }
+    val &= (1ULL << bits) - 1;
+    if(val & (1ULL << (bits - 1)))
+      {
+        val |= ~((1ULL << bits) - 1);
+      }
+    return val;
+  }
+
+int hc11_agent_eval(struct hc11_agent *ax, struct hc11_core *core, int64_t *result)
+  {
+    int64_t stack[AGENT_MAX_STACK];
+    int sp = 0; //number of entries
+    uint16_t pc = 0;
+    uint16_t reg;
+    uint64_t a, b;
+    int ops, n, i, size;
+    uint8_t op;
+
+//pop/push with bound checks
+#define NEED(k)  do { if(sp < (k)) goto fail; } while(0)
+#define ROOM(k)  do { if(sp + (k) > AGENT_MAX_STACK) goto fail; } while(0)
+
+    for(ops = 0; ops < AGENT_MAX_OPS && pc < ax->len; ops++)
+      {
+        op = ax->code[pc];
+        n  = ax_operands(op);
+        switch(op)
+          {
+          case AX_ADD: case AX_SUB: case AX_MUL:
+          case AX_DIV_SIGNED: case AX_DIV_UNSIGNED: case AX_REM_SIGNED: case AX_REM_UNSIGNED:
+          case AX_LSH: case AX_RSH_SIGNED: case AX_RSH_UNSIGNED:
+          case AX_BIT_AND: case AX_BIT_OR: case AX_BIT_XOR:
+          case AX_EQUAL: case AX_LESS_SIGNED: case AX_LESS_UNSIGNED:
+            NEED(2);
+            a = stack[sp-2];
+            b = stack[sp-1];
+            sp--;
+            if((op >= AX_DIV_SIGNED && op <= AX_REM_UNSIGNED) && b == 0)
+              {
+                goto fail;
+              }
+            switch(op)
+              {
+              case AX_ADD:          a = a + b; break;
+              case AX_SUB:          a = a - b; break;
+              case AX_MUL:          a = a * b; break;
+              //by -1 apart, INT64_MIN / -1 traps
+              case AX_DIV_SIGNED:   a = ((int64_t)b == -1) ? 0 - a : (uint64_t)((int64_t)a / (int64_t)b); break;
+              case AX_DIV_UNSIGNED: a = a / b; break;
+              case AX_REM_SIGNED:   a = ((int64_t)b == -1) ? 0 : (uint64_t)((int64_t)a % (int64_t)b); break;
+              case AX_REM_UNSIGNED: a = a % b; break;
+              case AX_LSH:          a = (b < 64) ? a << b : 0; break;
+              case AX_RSH_SIGNED:   a = (int64_t)a >> ((b < 64) ? b : 63); break;
+              case AX_RSH_UNSIGNED: a = (b < 64) ? a >> b : 0; break;
+              case AX_BIT_AND:      a = a & b; break;
+              case AX_BIT_OR:       a = a | b; break;
+              case AX_BIT_XOR:      a = a ^ b; break;
+              case AX_EQUAL:        a = (a == b); break;
+              case AX_LESS_SIGNED:  a = ((int64_t)a < (int64_t)b); break;
+              case AX_LESS_UNSIGNED:a = (a < b); break;
+              }
+            stack[sp-1] = a;
+            break;
+
+          case AX_LOG_NOT:
+            NEED(1);
+            stack[sp-1] = !stack[sp-1];
+            break;
+          case AX_BIT_NOT:
+            NEED(1);
+            stack[sp-1] = ~stack[sp-1];
+            break;
+          case AX_EXT:
+            NEED(1);
+            stack[sp-1] = ax_sext(stack[sp-1], ax->code[pc+1]);
+            break;
+          case AX_ZERO_EXT:
+            NEED(1);
+            if(ax->code[pc+1] < 64)
+              {
+                stack[sp-1] &= (1ULL << ax->code[pc+1]) - 1;
+              }
+            break;
+
+          case AX_REF8: case AX_REF16: case AX_REF32: case AX_REF64:
+            NEED(1);
+            size = 1 << (op - AX_REF8);
+            a = stack[sp-1];
+            if(a > 0x10000 - size)
+              {
+                goto fail;
+              }
+            b = 0;
+            for(i=0;i<size;i++)
+              {
+                b = (b << 8) | hc11_core_debug_readb(core, a + i);
+              }
+            stack[sp-1] = b;
+            break;
+
+          case AX_IF_GOTO:
+            NEED(1);
+            sp--;
+            if(stack[sp])
+              {
+                pc = ax_operand(&ax->code[pc+1], 2);
+                continue;
+              }
+            break;
+          case AX_GOTO:
+            pc = ax_operand(&ax->code[pc+1], 2);
+            continue;
+
+          case AX_CONST8: case AX_CONST16: case AX_CONST32: case AX_CONST64:
+            ROOM(1);
+            stack[sp++] = ax_operand(&ax->code[pc+1], n);
+            break;
+
+          case AX_REG:
+            ROOM(1);
+            if(hc11_core_get_reg(core, ax_operand(&ax->code[pc+1], 2), &reg) < 0)
+              {
+                goto fail;
+              }
+            stack[sp++] = reg;
+            break;
+
+          case AX_END:
+            NEED(1);
+            *result = stack[sp-1];
+            return 0;
+
+          case AX_DUP:
+            NEED(1);
+            ROOM(1);
+            stack[sp] = stack[sp-1];
+            sp++;
+            break;
+          case AX_POP:
+            NEED(1);
+            sp--;
+            break;
+          case AX_SWAP:
+            NEED(2);
+            a = stack[sp-1];
+            stack[sp-1] = stack[sp-2];
+            stack[sp-2] = a;
+            break;
+          case AX_PICK:
+            NEED(ax->code[pc+1] + 1);
+            ROOM(1);
+            stack[sp] = stack[sp - 1 - ax->code[pc+1]];
+            sp++;
+            break;
+          case AX_ROT:
+            //a b c => c a b
+            NEED(3);
+            a = stack[sp-1];
+            stack[sp-1] = stack[sp-2];
+            stack[sp-2] = stack[sp-3];
+            stack[sp-3] = a;
+            break;
+
+          //nothing is collected for a condition, only the stack effect stays
+          case AX_TRACE: case AX_TRACENZ:
+            NEED(2);
+            sp -= 2;
+            break;
+          case AX_TRACE_QUICK: case AX_TRACE16: case AX_TRACEV:
+            break;
+
+          default:
+            goto fail;
+          }
+        pc += 1 + n;
+      }
+
+fail:
+    log_msg(core, SYS_CORE, CORE_DBG, "agent expression failed at %u\n", pc);
+    return -1;
+#undef NEED
+#undef ROOM
+  }
+
+bool hc11_agent_any(struct hc11_agent *list, struct hc11_core *core)
+  {
+    int64_t val;
+    for(; list != NULL; list = list->next)
+      {
+        if(hc11_agent_eval(list, core, &val) < 0 || val)
+          {
+            return true;
+          }
+      }
+    return false;
+  }
@@ -0,0 +1,35 @@
+#ifndef __agent__h__
+#define __agent__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* gdb agent expressions, used as breakpoint conditions evaluated by the
+ * core itself. The bytecode is checked once when it is received, then run
+ * against the registers and memory (debugger view, no side effects) each
+ * time the breakpoint is reached. Trace and float opcodes are refused. */
+
+#define AGENT_MAX_CODE  512  //bytes per expression
+#define AGENT_MAX_STACK 32
+#define AGENT_MAX_OPS   4096 //executed per evaluation, loops are allowed
+
+struct hc11_agent
+  {
+    struct hc11_agent *next; //conditions of the same breakpoint
+    uint16_t len;
+    uint8_t  code[];
+  };
+
+//copy and check the bytecode, NULL if it cannot be run
+struct hc11_agent *hc11_agent_create(const uint8_t *code, uint16_t len);
+void hc11_agent_free(struct hc11_agent *list);
+
+//-1 on a runtime error (stack, memory, division by zero, too many ops)
+int  hc11_agent_eval(struct hc11_agent *ax, struct hc11_core *core, int64_t *result);
+
+//true if any expression of the list is non zero or fails to run
+bool hc11_agent_any(struct hc11_agent *list, struct hc11_core *core);
+
+#endif /* __agent__h__ */
@@ -0,0 +1,692 @@
+/* exhaustive verification of ALU instructions against the core */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <inttypes.h>
+
+#include "core.h"
+#include "hc11sim.h"
+
+/* The reference results are computed by kernels working on a structure of
+ * arrays: the same instruction on LANES independent register files. They
+ * are written without branches so that the compiler can vectorize them.
+ * Each batch of lanes is then replayed one by one on a real core, from
+ * the same registers, and the results are compared. */
+
+#define LANES 64
+
+#define CCR_C 0x01
+#define CCR_V 0x02
+#define CCR_Z 0x04
+#define CCR_N 0x08
+#define CCR_I 0x10
+#define CCR_H 0x20
+#define CCR_X 0x40
+#define CCR_S 0x80
+
+#define CODE 0xE000 //where the instruction under test is placed
+
+//flags that are swept as inputs, S X I stay set so that nothing interrupts
+#define CCR_FIXED (CCR_S | CCR_X | CCR_I)
+
+#define UNDEF_D 0x01 //D is indeterminate after this instruction
+
+struct lanes
+  {
+    uint16_t d[LANES];
+    uint16_t x[LANES];
+    uint8_t  ccr[LANES];
+    uint8_t  m[LANES];     //immediate operand
+    uint8_t  undef[LANES];
+  };
+
+typedef void (*kernel_f)(struct lanes *l, int acc);
+
+//which inputs are swept
+enum
+  {
+    SWEEP_ACC,    //accumulator, flags
+    SWEEP_ACC_M,  //accumulator, immediate operand, flags
+    SWEEP_A_B,    //both accumulators, flags
+    SWEEP_D_X,    //16 bit D and X, sampled unless -f
+  };
+
+struct aluop
+  {
+    const char *name;
+    uint8_t     opcode;
+    int         sweep;
+    int         acc;     //1 for A, 0 for B
+    kernel_f    kernel;
+    uint8_t     ccrmask; //flags that are defined after the instruction
+  };
+
+/* Kernels. acc selects the accumulator the same way for all lanes, the
+ * compiler hoists the test out of the loops. */
+
+static inline uint8_t acc_get(uint16_t d, int acc)
+  {
+    return acc ? d >> 8 : d & 0xFF;
+  }
+
+static inline uint16_t acc_set(uint16_t d, int acc, uint8_t val)
+  {
+    return acc ? (d & 0x00FF) | (val << 8) : (d & 0xFF00) | val;
+  }
+
+static inline uint8_t flags_nz(uint8_t ccr, uint8_t r)
+  {
+    return (ccr & ~(CCR_N | CCR_Z)) | ((r & 0x80) ? CCR_N : 0) | (r ? 0 : CCR_Z);
+  }
+
+static inline uint8_t flags_nzvc(uint8_t ccr, uint8_t r, uint8_t v, uint8_t c)
+  {
+    return (flags_nz(ccr, r) & ~(CCR_V | CCR_C)) | (v ? CCR_V : 0) | (c ? CCR_C : 0);
+  }
+
+static inline uint8_t add8(uint8_t *ccr, uint8_t a, uint8_t m, uint8_t cin)
+  {
+    uint8_t r = a + m + cin;
+    uint8_t carry = (a & m) | (m & ~r) | (~r & a);
+    uint8_t ovf   = (a & m & ~r) | (~a & ~m & r);
+    *ccr = flags_nzvc(*ccr, r, ovf & 0x80, carry & 0x80);
+    *ccr = (*ccr & ~CCR_H) | ((carry & 0x08) ? CCR_H : 0);
+    return r;
+  }
+
+static inline uint8_t sub8(uint8_t *ccr, uint8_t a, uint8_t m, uint8_t cin)
+  {
+    uint8_t r = a - m - cin;
+    uint8_t borrow = (~a & m) | (m & r) | (r & ~a);
+    uint8_t ovf    = (a & ~m & ~r) | (~a & m & r);
+    *ccr = flags_nzvc(*ccr, r, ovf & 0x80, borrow & 0x80);
+    return r;
+  }
+
+#define LANE_LOOP for(i=0;i<LANES;i++)
+
+static void k_add(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], acc, add8(&l->ccr[i], acc_get(l->d[i], acc), l->m[i], 0));
+  }
+
+static void k_adc(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], acc, add8(&l->ccr[i], acc_get(l->d[i], acc), l->m[i], l->ccr[i] & CCR_C));
+  }
+
+static void k_sub(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], acc, sub8(&l->ccr[i], acc_get(l->d[i], acc), l->m[i], 0));
+  }
+
+static void k_sbc(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], acc, sub8(&l->ccr[i], acc_get(l->d[i], acc), l->m[i], l->ccr[i] & CCR_C));
+  }
+
+static void k_cmp(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP sub8(&l->ccr[i], acc_get(l->d[i], acc), l->m[i], 0);
+  }
+
+static void k_and(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = acc_get(l->d[i], acc) & l->m[i];
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = flags_nz(l->ccr[i], r) & ~CCR_V;
+      }
+  }
+
+static void k_bit(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->ccr[i] = flags_nz(l->ccr[i], acc_get(l->d[i], acc) & l->m[i]) & ~CCR_V;
+  }
+
+static void k_ora(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = acc_get(l->d[i], acc) | l->m[i];
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = flags_nz(l->ccr[i], r) & ~CCR_V;
+      }
+  }
+
+static void k_eor(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = acc_get(l->d[i], acc) ^ l->m[i];
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = flags_nz(l->ccr[i], r) & ~CCR_V;
+      }
+  }
+
+//accumulator to accumulator, the operand is B
+static void k_aba(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], 1, add8(&l->ccr[i], l->d[i] >> 8, l->d[i] & 0xFF, 0));
+  }
+
+static void k_sba(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->d[i] = acc_set(l->d[i], 1, sub8(&l->ccr[i], l->d[i] >> 8, l->d[i] & 0xFF, 0));
+  }
+
+static void k_cba(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP sub8(&l->ccr[i], l->d[i] >> 8, l->d[i] & 0xFF, 0);
+  }
+
+static void k_mul(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP
+      {
+        l->d[i]   = (l->d[i] >> 8) * (l->d[i] & 0xFF);
+        l->ccr[i] = (l->ccr[i] & ~CCR_C) | ((l->d[i] & 0x80) ? CCR_C : 0);
+      }
+  }
+
+static void k_inc(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = acc_get(l->d[i], acc) + 1;
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = (flags_nz(l->ccr[i], r) & ~CCR_V) | ((r == 0x80) ? CCR_V : 0);
+      }
+  }
+
+static void k_dec(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = acc_get(l->d[i], acc) - 1;
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = (flags_nz(l->ccr[i], r) & ~CCR_V) | ((r == 0x7F) ? CCR_V : 0);
+      }
+  }
+
+static void k_neg(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = -acc_get(l->d[i], acc);
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = flags_nzvc(l->ccr[i], r, r == 0x80, r != 0);
+      }
+  }
+
+static void k_com(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t r;
+    LANE_LOOP
+      {
+        r = ~acc_get(l->d[i], acc);
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = flags_nzvc(l->ccr[i], r, 0, 1);
+      }
+  }
+
+static void k_clr(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP
+      {
+        l->d[i]   = acc_set(l->d[i], acc, 0);
+        l->ccr[i] = flags_nzvc(l->ccr[i], 0, 0, 0);
+      }
+  }
+
+static void k_tst(struct lanes *l, int acc)
+  {
+    int i;
+    LANE_LOOP l->ccr[i] = flags_nzvc(l->ccr[i], acc_get(l->d[i], acc), 0, 0);
+  }
+
+//shifts: V = N ^ C after the operation
+static inline uint8_t shift_flags(uint8_t ccr, uint8_t r, uint8_t c)
+  {
+    return flags_nzvc(ccr, r, (r >> 7) ^ c, c);
+  }
+
+static void k_asl(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    LANE_LOOP
+      {
+        a = acc_get(l->d[i], acc);
+        l->d[i]   = acc_set(l->d[i], acc, a << 1);
+        l->ccr[i] = shift_flags(l->ccr[i], a << 1, a >> 7);
+      }
+  }
+
+static void k_asr(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    uint8_t r;
+    LANE_LOOP
+      {
+        a = acc_get(l->d[i], acc);
+        r = (a >> 1) | (a & 0x80);
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = shift_flags(l->ccr[i], r, a & 1);
+      }
+  }
+
+static void k_lsr(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    LANE_LOOP
+      {
+        a = acc_get(l->d[i], acc);
+        l->d[i]   = acc_set(l->d[i], acc, a >> 1);
+        l->ccr[i] = shift_flags(l->ccr[i], a >> 1, a & 1);
+      }
+  }
+
+static void k_rol(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    uint8_t r;
+    LANE_LOOP
+      {
+        a = acc_get(l->d[i], acc);
+        r = (a << 1) | (l->ccr[i] & CCR_C);
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = shift_flags(l->ccr[i], r, a >> 7);
+      }
+  }
+
+static void k_ror(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    uint8_t r;
+    LANE_LOOP
+      {
+        a = acc_get(l->d[i], acc);
+        r = (a >> 1) | ((l->ccr[i] & CCR_C) << 7);
+        l->d[i]   = acc_set(l->d[i], acc, r);
+        l->ccr[i] = shift_flags(l->ccr[i], r, a & 1);
+      }
+  }
+
+//decimal adjust after an addition, V is undefined
+static void k_daa(struct lanes *l, int acc)
+  {
+    int i;
+    uint8_t a;
+    uint8_t lo;
+    uint8_t hi;
+    uint8_t r;
+    LANE_LOOP
+      {
+        a  = l->d[i] >> 8;
+        lo = a & 0x0F;
+        hi = a >> 4;
+        hi = (l->ccr[i] & CCR_C) || hi > 9 || (hi > 8 && lo > 9);
+        lo = (l->ccr[i] & CCR_H) || lo > 9;
+        r  = a + (lo ? 0x06 : 0) + (hi ? 0x60 : 0);
+        l->d[i]   = acc_set(l->d[i], 1, r);
+        l->ccr[i] = flags_nzvc(l->ccr[i], r, 0, hi);
+      }
+  }
+
+//division by zero gives a quotient of FFFF and an indeterminate remainder
+static void k_idiv(struct lanes *l, int acc)
+  {
+    int i;
+    uint16_t x;
+    uint16_t q;
+    LANE_LOOP
+      {
+        x = l->x[i] ? l->x[i] : 1;
+        q = l->x[i] ? l->d[i] / x : 0xFFFF;
+        l->d[i]     = l->d[i] % x;
+        l->undef[i] = l->x[i] ? 0 : UNDEF_D;
+        l->ccr[i]   = (l->ccr[i] & ~(CCR_Z | CCR_V | CCR_C)) |
+                      (q ? 0 : CCR_Z) | (l->x[i] ? 0 : CCR_C);
+        l->x[i]     = q;
+      }
+  }
+
+//fractional divide, the numerator must be less than the denominator
+static void k_fdiv(struct lanes *l, int acc)
+  {
+    int i;
+    uint16_t x;
+    uint16_t q;
+    bool ovf;
+    LANE_LOOP
+      {
+        ovf = l->x[i] <= l->d[i];
+        x   = ovf ? 1 : l->x[i];
+        q   = ovf ? 0xFFFF : ((uint32_t)l->d[i] << 16) / x;
+        l->d[i]     = ((uint32_t)l->d[i] << 16) % x;
+        l->undef[i] = ovf ? UNDEF_D : 0;
+        l->ccr[i]   = (l->ccr[i] & ~(CCR_Z | CCR_V | CCR_C)) |
+                      (q ? 0 : CCR_Z) | (ovf ? CCR_V : 0) | (l->x[i] ? 0 : CCR_C);
+        l->x[i]     = q;
+      }
+  }
+
+#define ALL 0xFF
+
+static const struct aluop aluops[] =
+  {
+    {"ADDA", 0x8B, SWEEP_ACC_M, 1, k_add, ALL},
+    {"ADDB", 0xCB, SWEEP_ACC_M, 0, k_add, ALL},
+    {"ADCA", 0x89, SWEEP_ACC_M, 1, k_adc, ALL},
+    {"ADCB", 0xC9, SWEEP_ACC_M, 0, k_adc, ALL},
+    {"SUBA", 0x80, SWEEP_ACC_M, 1, k_sub, ALL},
+    {"SUBB", 0xC0, SWEEP_ACC_M, 0, k_sub, ALL},
+    {"SBCA", 0x82, SWEEP_ACC_M, 1, k_sbc, ALL},
+    {"SBCB", 0xC2, SWEEP_ACC_M, 0, k_sbc, ALL},
+    {"CMPA", 0x81, SWEEP_ACC_M, 1, k_cmp, ALL},
+    {"CMPB", 0xC1, SWEEP_ACC_M, 0, k_cmp, ALL},
+    {"ANDA", 0x84, SWEEP_ACC_M, 1, k_and, ALL},
+    {"ANDB", 0xC4, SWEEP_ACC_M, 0, k_and, ALL},
+    {"BITA", 0x85, SWEEP_ACC_M, 1, k_bit, ALL},
+    {"BITB", 0xC5, SWEEP_ACC_M, 0, k_bit, ALL},
+    {"ORAA", 0x8A, SWEEP_ACC_M, 1, k_ora, ALL},
+    {"ORAB", 0xCA, SWEEP_ACC_M, 0, k_ora, ALL},
+    {"EORA", 0x88, SWEEP_ACC_M, 1, k_eor, ALL},
+    {"EORB", 0xC8, SWEEP_ACC_M, 0, k_eor, ALL},
+    {"ABA" , 0x1B, SWEEP_A_B  , 1, k_aba, ALL},
+    {"SBA" , 0x10, SWEEP_A_B  , 1, k_sba, ALL},
+    {"CBA" , 0x11, SWEEP_A_B  , 1, k_cba, ALL},
+    {"MUL" , 0x3D, SWEEP_A_B  , 1, k_mul, ALL},
+    {"DAA" , 0x19, SWEEP_A_B  , 1, k_daa, ALL & ~CCR_V},
+    {"INCA", 0x4C, SWEEP_ACC  , 1, k_inc, ALL},
+    {"INCB", 0x5C, SWEEP_ACC  , 0, k_inc, ALL},
+    {"DECA", 0x4A, SWEEP_ACC  , 1, k_dec, ALL},
+    {"DECB", 0x5A, SWEEP_ACC  , 0, k_dec, ALL},
+    {"NEGA", 0x40, SWEEP_ACC  , 1, k_neg, ALL},
+    {"NEGB", 0x50, SWEEP_ACC  , 0, k_neg, ALL},
+    {"COMA", 0x43, SWEEP_ACC  , 1, k_com, ALL},
+    {"COMB", 0x53, SWEEP_ACC  , 0, k_com, ALL},
+    {"CLRA", 0x4F, SWEEP_ACC  , 1, k_clr, ALL},
+    {"CLRB", 0x5F, SWEEP_ACC  , 0, k_clr, ALL},
+    {"TSTA", 0x4D, SWEEP_ACC  , 1, k_tst, ALL},
+    {"TSTB", 0x5D, SWEEP_ACC  , 0, k_tst, ALL},
+    {"ASLA", 0x48, SWEEP_ACC  , 1, k_asl, ALL},
+    {"ASLB", 0x58, SWEEP_ACC  , 0, k_asl, ALL},
+    {"ASRA", 0x47, SWEEP_ACC  , 1, k_asr, ALL},
+    {"ASRB", 0x57, SWEEP_ACC  , 0, k_asr, ALL},
+    {"LSRA", 0x44, SWEEP_ACC  , 1, k_lsr, ALL},
+    {"LSRB", 0x54, SWEEP_ACC  , 0, k_lsr, ALL},
+    {"ROLA", 0x49, SWEEP_ACC  , 1, k_rol, ALL},
+    {"ROLB", 0x59, SWEEP_ACC  , 0, k_rol, ALL},
+    {"RORA", 0x46, SWEEP_ACC  , 1, k_ror, ALL},
+    {"RORB", 0x56, SWEEP_ACC  , 0, k_ror, ALL},
+    {"IDIV", 0x02, SWEEP_D_X  , 1, k_idiv, ALL},
+    {"FDIV", 0x03, SWEEP_D_X  , 1, k_fdiv, ALL},
+  };
+
+#define ALUOPS (sizeof(aluops) / sizeof(aluops[0]))
+
+//swept flags H N Z V C from a 5 bit index
+static uint8_t sweep_ccr(uint32_t f)
+  {
+    return CCR_FIXED | (f & 0x0F) | ((f & 0x10) << 1);
+  }
+
+static uint64_t sweep_count(const struct aluop *op, uint32_t step)
+  {
+    switch(op->sweep)
+      {
+        case SWEEP_ACC  : return 256 * 32;
+        case SWEEP_ACC_M:
+        case SWEEP_A_B  : return 256 * 256 * 32;
+        case SWEEP_D_X  : return (uint64_t)(65536 / step) * (65536 / step) * 2;
+      }
+    return 0;
+  }
+
+//set up lane i for input combination n
+static void sweep_lane(const struct aluop *op, uint32_t step, struct lanes *l,
+                       int i, uint64_t n)
+  {
+    uint32_t v1 = n & 0xFF;
+    uint32_t v2 = (n >> 8) & 0xFF;
+    uint32_t per;
+
+    l->x[i]     = 0x55AA;
+    l->m[i]     = 0;
+    l->undef[i] = 0;
+    switch(op->sweep)
+      {
+        case SWEEP_ACC:
+          l->d[i]   = acc_set(v1 ^ 0xA5A5, op->acc, v1);
+          l->ccr[i] = sweep_ccr(n >> 8);
+          break;
+        case SWEEP_ACC_M:
+          l->d[i]   = acc_set(v1 ^ 0xA5A5, op->acc, v1);
+          l->m[i]   = v2;
+          l->ccr[i] = sweep_ccr(n >> 16);
+          break;
+        case SWEEP_A_B:
+          l->d[i]   = (v1 << 8) | v2;
+          l->ccr[i] = sweep_ccr(n >> 16);
+          break;
+        case SWEEP_D_X:
+          per = 65536 / step;
+          l->d[i]   = (n % per) * step;
+          l->x[i]   = ((n / per) % per) * step;
+          l->ccr[i] = (n / per / per) ? (CCR_FIXED | 0x2F) : CCR_FIXED;
+          break;
+      }
+  }
+
+//run one lane on the core, -1 if the core does not implement the instruction
+static int scalar_lane(struct hc11_sim *sim, const struct aluop *op,
+                       struct lanes *l, int i)
+  {
+    uint16_t ccr;
+
+    hc11_sim_set_reg(sim, HC11_REG_D  , l->d[i]);
+    hc11_sim_set_reg(sim, HC11_REG_X  , l->x[i]);
+    hc11_sim_set_reg(sim, HC11_REG_CCR, l->ccr[i]);
+    hc11_sim_write(sim, CODE + 1, &l->m[i], 1);
+    hc11_sim_start(sim, CODE);
+    if(hc11_sim_run(sim, 1) != HC11_SIM_BUDGET)
+      {
+        return -1;
+      }
+    hc11_sim_get_reg(sim, HC11_REG_D, &l->d[i]);
+    hc11_sim_get_reg(sim, HC11_REG_X, &l->x[i]);
+    hc11_sim_get_reg(sim, HC11_REG_CCR, &ccr);
+    l->ccr[i] = ccr;
+    return 0;
+  }
+
+static bool lane_match(const struct aluop *op, struct lanes *ref, struct lanes *got, int i)
+  {
+    return (ref->undef[i] & UNDEF_D || ref->d[i] == got->d[i]) &&
+           ref->x[i] == got->x[i] &&
+           (ref->ccr[i] & op->ccrmask) == (got->ccr[i] & op->ccrmask);
+  }
+
+static uint64_t getmicros(void)
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LU + tv.tv_usec;
+  }
+
+//returns the number of mismatches, -1 if not implemented by the core
+static int64_t check_op(struct hc11_sim *sim, const struct aluop *op, uint32_t step,
+                        int verbose)
+  {
+    struct lanes in;
+    struct lanes ref;
+    struct lanes got;
+    uint64_t total = sweep_count(op, step);
+    uint64_t n;
+    int64_t bad = 0;
+    int i;
+
+    hc11_sim_write(sim, CODE, &op->opcode, 1);
+    for(n=0;n<total;n+=LANES)
+      {
+        for(i=0;i<LANES;i++)
+          {
+            sweep_lane(op, step, &in, i, (n + i) % total);
+          }
+        ref = in;
+        op->kernel(&ref, op->acc);
+        got = in;
+        for(i=0;i<LANES;i++)
+          {
+            if(scalar_lane(sim, op, &got, i) < 0)
+              {
+                return -1;
+              }
+            if(!lane_match(op, &ref, &got, i))
+              {
+                if(bad < verbose)
+                  {
+                    printf("  %s D=%04X X=%04X CCR=%02X M=%02X: core D=%04X X=%04X CCR=%02X,"
+                           " expected D=%04X X=%04X CCR=%02X\n", op->name,
+                           in.d[i], in.x[i], in.ccr[i], in.m[i],
+                           got.d[i], got.x[i], got.ccr[i],
+                           ref.d[i], ref.x[i], ref.ccr[i]);
+                  }
+                bad++;
+              }
+          }
+      }
+    return bad;
+  }
+
+void help(void)
+  {
+    printf("alucheck [-f] [-q] [-v n] [instruction]...\n"
+           "\n"
+           "  -q      Only report instructions with mismatches\n"
+           "  -f      Full sweep of 16 bit operands (IDIV, FDIV), default is every 64th value\n"
+           "  -v <n>  Print up to n mismatches per instruction, default 4\n"
+           "\n"
+           "Runs every combination of operands and input flags through the core and\n"
+           "compares with reference kernels. Default is all known instructions.\n"
+           "The exit code is 1 if any result differs, or if an instruction given on\n"
+           "the command line is unknown or not implemented by the core.\n");
+  }
+
+int main(int argc, char **argv)
+  {
+    struct hc11_sim *sim;
+    uint32_t step = 64;
+    int verbose = 4;
+    bool quiet = false;
+    int failed = 0;
+    int64_t bad;
+    uint64_t micros;
+    size_t i;
+    int j;
+    int c;
+
+    while((c = getopt(argc, argv, "fqv:h")) != -1)
+      {
+        switch(c)
+          {
+            case 'f': step = 1; break;
+            case 'q': quiet = true; break;
+            case 'v': verbose = atoi(optarg); break;
+            default : help(); return 2;
+          }
+      }
+
+    //names that are not checked at all would make an empty run pass
+    for(j=optind;j<argc;j++)
+      {
+        for(i=0;i<ALUOPS && strcasecmp(argv[j], aluops[i].name);i++);
+        if(i == ALUOPS)
+          {
+            printf("%-4s unknown instruction\n", argv[j]);
+            failed++;
+          }
+      }
+
+    sim = hc11_sim_create();
+    if(!sim || hc11_sim_map_ram(sim, 0xE000, 0x2000) < 0)
+      {
+        return 2;
+      }
+
+    for(i=0;i<ALUOPS;i++)
+      {
+        if(optind < argc)
+          {
+            for(j=optind;j<argc && strcasecmp(argv[j], aluops[i].name);j++);
+            if(j == argc)
+              {
+                continue;
+              }
+          }
+        micros = getmicros();
+        bad = check_op(sim, &aluops[i], step, verbose);
+        micros = getmicros() - micros;
+        if(bad < 0)
+          {
+            //skipped quietly in a full run, an error when asked for by name
+            if(!quiet || optind < argc)
+              {
+                printf("%-4s not implemented by the core\n", aluops[i].name);
+              }
+            if(optind < argc)
+              {
+                failed++;
+              }
+            continue;
+          }
+        if(quiet && !bad)
+          {
+            continue;
+          }
+        printf("%-4s %10"PRIu64" cases %8"PRId64" mismatches %6.2fs\n", aluops[i].name,
+               sweep_count(&aluops[i], step), bad, micros / 1e6);
+        if(bad)
+          {
+            failed++;
+          }
+      }
+    hc11_sim_destroy(sim);
+    return failed ? 1 : 0;
+  }
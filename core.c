@@ -5,6 +5,9 @@
 
 #include "core.h"
 #include "log.h"
+#include "history.h"
+#include "profile.h"
+#include "agent.h"
 
 // Define internal core execution states
 enum hc11states
@@ -32,8 +35,14 @@ enum hc11states
     STATE_PUSH_H,
     STATE_PULL_L,
     STATE_PULL_H,
+    STATE_STACK,          //push all registers before an interrupt vector fetch
   };
 
+//interrupt sources: one bit per vector, lowest bit has highest priority
+#define IRQ_BIT(vector)  (1UL << ((VECTOR_RESET - (vector)) >> 1))
+#define IRQ_XIRQ_MASK    IRQ_BIT(VECTOR_XIRQ)
+#define IRQ_MASKABLE     (~(IRQ_BIT(VECTOR_IRQ) - 1) & ((IRQ_BIT(VECTOR_SCI) << 1) - 1))
+
 // Define addressing modes
 enum
   {
@@ -427,37 +436,200 @@ void init_write(void *ctx, uint16_t off, uint8_t val)
     struct hc11_core *core = ctx;
     core->rambase = (val >> 4   ) << 12;
     core->iobase  = (val &  0x0F) << 12;
-    log_msg(SYS_CORE, CORE_MEM, "INIT: rambase %04X iobase %04X\n", core->rambase, core->iobase);
+    log_msg(core, SYS_CORE, CORE_MEM, "INIT: rambase %04X iobase %04X\n", core->rambase, core->iobase);
   }
 
 void hc11_core_init(struct hc11_core *core)
   {
     int i;
     core->maps = NULL;
+    log_init(core);
     for(i=0;i<64;i++)
       {
         core->io[i].rdf = NULL;
         core->io[i].wrf = NULL;
+        core->io[i].dbgrdf = NULL;
+        core->io[i].dbgwrf = NULL;
       }
     for(i=0;i<HC11_BKPT_NUM;i++)
       {
         core->break_pc[i] = 0x0000;
+        core->break_cond[i] = NULL;
+      }
+    core->ranging = false;
+    core->ncalls  = 0;
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        core->events[i].when = HC11_EVENT_NONE;
+        core->events[i].cb   = NULL;
+      }
+    core->next_event  = HC11_EVENT_NONE;
+    core->irq_pending = 0;
+    core->journal     = NULL;
+    core->history     = NULL;
+    core->profile     = NULL;
+    core->wrhook      = NULL;
+    for(i=0;i<HC11_STATE_NUM;i++)
+      {
+        core->states[i].save = NULL;
+        core->states[i].load = NULL;
+      }
+    core->mem_epoch = 1;
+    for(i=0;i<HC11_PAGE_NUM;i++)
+      {
+        core->page_epoch[i] = 0;
       }
     hc11_core_iocallback(core, REG_INIT, 1, core, init_read, init_write);
     core->status = STATUS_STOPPED;
 
-    for(i=0;i<256;i++)
+    core->istats = true;
+    hc11_core_istats_clear(core);
+  }
+
+int hc11_core_event_register(struct hc11_core *core, void *ctx, event_f cb)
+  {
+    int i;
+    for(i=0;i<HC11_EVENT_NUM;i++)
       {
-        core->istat_main[i] = 0;
-        core->istat_pg18[i] = 0;
-        core->istat_pg1A[i] = 0;
-        core->istat_pgCD[i] = 0;
+        if(core->events[i].cb == NULL)
+          {
+            core->events[i].ctx  = ctx;
+            core->events[i].cb   = cb;
+            core->events[i].when = HC11_EVENT_NONE;
+            return i;
+          }
+      }
+    log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - no free event slot\n");
+    return -1;
+  }
+
+static void hc11_core_event_update(struct hc11_core *core)
+  {
+    int i;
+    core->next_event = HC11_EVENT_NONE;
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        if(core->events[i].when < core->next_event)
+          {
+            core->next_event = core->events[i].when;
+          }
       }
   }
 
+//schedule event id to fire delay clocks from now, replacing any pending date
+void hc11_core_event_schedule(struct hc11_core *core, int id, uint64_t delay)
+  {
+    if(id < 0 || id >= HC11_EVENT_NUM)
+      {
+        return;
+      }
+    core->events[id].when = core->clocks + delay;
+    if(core->events[id].when < core->next_event)
+      {
+        core->next_event = core->events[id].when;
+      }
+  }
+
+void hc11_core_event_cancel(struct hc11_core *core, int id)
+  {
+    if(id < 0 || id >= HC11_EVENT_NUM)
+      {
+        return;
+      }
+    core->events[id].when = HC11_EVENT_NONE;
+    hc11_core_event_update(core);
+  }
+
+//clocks until event id fires, HC11_EVENT_NONE if not scheduled
+uint64_t hc11_core_event_delay(struct hc11_core *core, int id)
+  {
+    if(id < 0 || id >= HC11_EVENT_NUM || core->events[id].when == HC11_EVENT_NONE)
+      {
+        return HC11_EVENT_NONE;
+      }
+    return core->events[id].when - core->clocks;
+  }
+
+//fire all events that are due. Callbacks may reschedule themselves.
+static void hc11_core_events(struct hc11_core *core)
+  {
+    int i;
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        if(core->events[i].when <= core->clocks)
+          {
+            core->events[i].when = HC11_EVENT_NONE;
+            core->events[i].cb(core->events[i].ctx);
+          }
+      }
+    hc11_core_event_update(core);
+  }
+
+//set or clear the request line of an interrupt source. Requests are level
+//sensitive: the source must clear it when the cause is acknowledged.
+void hc11_core_irq(struct hc11_core *core, uint16_t vector, bool level)
+  {
+    if(level)
+      {
+        core->irq_pending |= IRQ_BIT(vector);
+      }
+    else
+      {
+        core->irq_pending &= ~IRQ_BIT(vector);
+      }
+  }
+
+//return the vector of the highest priority unmasked interrupt, or 0
+static uint16_t hc11_core_irq_vector(struct hc11_core *core)
+  {
+    uint32_t pending = core->irq_pending;
+    if(core->regs.flags.X) pending &= ~IRQ_XIRQ_MASK;
+    if(core->regs.flags.I) pending &= ~IRQ_MASKABLE;
+    if(!pending)
+      {
+        return 0;
+      }
+    return VECTOR_RESET - (__builtin_ctz(pending) << 1);
+  }
+
+int hc11_core_get_reg(struct hc11_core *core, int reg, uint16_t *val)
+  {
+    switch(reg)
+      {
+        case HC11_REG_X  : *val = core->regs.x;         break;
+        case HC11_REG_D  : *val = core->regs.d;         break;
+        case HC11_REG_Y  : *val = core->regs.y;         break;
+        case HC11_REG_SP : *val = core->regs.sp;        break;
+        case HC11_REG_PC : *val = core->regs.pc;        break;
+        case HC11_REG_A  : *val = core->regs.d >> 8;    break; //a is MSB
+        case HC11_REG_B  : *val = core->regs.d & 0xFF;  break; //b is LSB
+        case HC11_REG_CCR: *val = core->regs.ccr;       break;
+        default: return -1;
+      }
+    return 0;
+  }
+
+int hc11_core_set_reg(struct hc11_core *core, int reg, uint16_t val)
+  {
+    switch(reg)
+      {
+        case HC11_REG_X  : core->regs.x  = val; break;
+        case HC11_REG_D  : core->regs.d  = val; break;
+        case HC11_REG_Y  : core->regs.y  = val; break;
+        case HC11_REG_SP : core->regs.sp = val; break;
+        case HC11_REG_PC : core->regs.pc = val; break;
+        case HC11_REG_A  : core->regs.d  = (core->regs.d & 0x00FF) | (val << 8);   break;
+        case HC11_REG_B  : core->regs.d  = (core->regs.d & 0xFF00) | (val & 0xFF); break;
+        case HC11_REG_CCR: core->regs.ccr = val; break;
+        default: return -1;
+      }
+    return 0;
+  }
+
 int hc11_core_set_bkpt(struct hc11_core *core, uint16_t pc)
   {
     int i;
+    //a free slot can come before the one already set for pc
     for(i=0;i<HC11_BKPT_NUM;i++)
       {
         if(core->break_pc[i] == pc)
@@ -465,6 +637,9 @@ int hc11_core_set_bkpt(struct hc11_core *core, uint16_t pc)
             //already done
             return 0;
           }        
+      }
+    for(i=0;i<HC11_BKPT_NUM;i++)
+      {
         if(core->break_pc[i] == 0)
           {
             //added in free place
@@ -483,30 +658,170 @@ int hc11_core_clr_bkpt(struct hc11_core *core, uint16_t pc)
         if(core->break_pc[i] == pc)
           {
             core->break_pc[i] = 0;
+            hc11_agent_free(core->break_cond[i]);
+            core->break_cond[i] = NULL;
             return 0;
           }        
       }
     return -1;
   }
 
+int hc11_core_set_bkpt_cond(struct hc11_core *core, uint16_t pc, struct hc11_agent *cond)
+  {
+    int i;
+    if(hc11_core_set_bkpt(core, pc) < 0)
+      {
+        hc11_agent_free(cond);
+        return -1;
+      }
+    for(i=0;i<HC11_BKPT_NUM;i++)
+      {
+        if(core->break_pc[i] == pc)
+          {
+            hc11_agent_free(core->break_cond[i]);
+            core->break_cond[i] = cond;
+            break;
+          }
+      }
+    return 0;
+  }
+
+bool hc11_core_at_bkpt(struct hc11_core *core)
+  {
+    int i;
+    for(i=0;i<HC11_BKPT_NUM;i++)
+      {
+        //0000 marks a free slot
+        if(core->break_pc[i] && core->break_pc[i] == core->regs.pc)
+          {
+            //the condition runs on the target, gdb only sees real hits
+            return !core->break_cond[i] || hc11_agent_any(core->break_cond[i], core);
+          }
+      }
+    return false;
+  }
+
+void hc11_core_set_range(struct hc11_core *core, uint16_t start, uint16_t end)
+  {
+    core->ranging     = start < end;
+    core->range_start = start;
+    core->range_end   = end;
+  }
+
+//Shadow call stack: only calls, returns and interrupt entry touch it. Each
+//frame keeps sp from before the call, a frame is live while sp is below it.
+//Returns and new calls drop the frames the firmware abandoned by resetting
+//sp or unwinding by hand, so the stack resyncs on its own.
+static void hc11_core_drop(struct hc11_core *core)
+  {
+    core->ncalls--;
+    if(core->profile && core->ncalls < HC11_CALL_NUM)
+      {
+        hc11_profile_return(core->profile, &core->calls[core->ncalls], core->ncalls);
+      }
+  }
+
+static void hc11_core_call(struct hc11_core *core, uint16_t from, uint16_t to,
+                           uint16_t sp, uint16_t vector)
+  {
+    struct hc11_call *c;
+    while(core->ncalls && core->ncalls <= HC11_CALL_NUM &&
+          core->calls[core->ncalls-1].sp <= sp)
+      {
+        hc11_core_drop(core);
+      }
+    if(core->ncalls < HC11_CALL_NUM)
+      {
+        c = &core->calls[core->ncalls];
+        c->from   = from;
+        c->to     = to;
+        c->sp     = sp;
+        c->vector = vector;
+        if(core->profile)
+          {
+            hc11_profile_call(core->profile, core->ncalls);
+          }
+      }
+    core->ncalls++;
+  }
+
+static void hc11_core_return(struct hc11_core *core)
+  {
+    if(core->ncalls > HC11_CALL_NUM)
+      {
+        core->ncalls--; //too deep to be recorded, trust the return
+        return;
+      }
+    while(core->ncalls && core->calls[core->ncalls-1].sp <= core->regs.sp)
+      {
+        hc11_core_drop(core);
+      }
+  }
+
+int hc11_core_calls(struct hc11_core *core, struct hc11_call *out, int max)
+  {
+    int i, n = 0;
+    i = (core->ncalls < HC11_CALL_NUM) ? core->ncalls : HC11_CALL_NUM;
+    while(i-- > 0 && n < max)
+      {
+        if(core->calls[i].sp > core->regs.sp)
+          {
+            out[n++] = core->calls[i];
+          }
+      }
+    return n;
+  }
+
+//move the clock count, pending events keep the same distance to it
+void hc11_core_set_clocks(struct hc11_core *core, uint64_t clocks)
+  {
+    int i;
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        if(core->events[i].when != HC11_EVENT_NONE)
+          {
+            core->events[i].when += clocks - core->clocks;
+          }
+      }
+    core->clocks = clocks;
+    hc11_core_event_update(core);
+  }
+
 void hc11_core_reset(struct hc11_core *core)
   {
+    hc11_core_set_clocks(core, 0);
+    if(core->history)
+      {
+        hc11_history_clear(core->history); //the memory map changes
+      }
     core->rambase = 0x0000;
     core->iobase  = 0x1000;
     core->busadr  = VECTOR_RESET;
     core->state   = STATE_VECTORFETCH_H;
     core->prefix  = 0x00;
-    core->clocks = 0;
+    core->ncalls  = 0;
+  }
+
+//skip the vector fetch, next clock fetches the opcode at pc
+void hc11_core_jump(struct hc11_core *core, uint16_t pc)
+  {
+    core->regs.pc = pc;
+    core->state   = STATE_FETCHOPCODE;
+    core->prefix  = 0x00;
   }
 
 void hc11_core_clock(struct hc11_core *core)
   {
     core->clocks += 1;
+    if(core->clocks >= core->next_event)
+      {
+        hc11_core_events(core);
+      }
     switch(core->state)
       {
         case STATE_VECTORFETCH_H:
-          log_msg(SYS_CORE, CORE_INST, "----------------------------------------\n");
-          log_msg(SYS_CORE, CORE_INST, "VECTOR fetch @ 0x%04X\n", core->busadr);
+          log_msg(core, SYS_CORE, CORE_INST, "----------------------------------------\n");
+          log_msg(core, SYS_CORE, CORE_INST, "VECTOR fetch @ 0x%04X\n", core->busadr);
           core->regs.pc = hc11_core_readb(core,core->busadr) << 8;
           core->state = STATE_VECTORFETCH_L;
           break;
@@ -516,9 +831,23 @@ void hc11_core_clock(struct hc11_core *core)
           core->state = STATE_FETCHOPCODE;
           break;
 
-        case STATE_PREFIX:
         case STATE_FETCHOPCODE:
-          log_msg(SYS_CORE, CORE_INST, "----------------------------------------\n");
+          if(core->irq_pending)
+            {
+              core->irqvec = hc11_core_irq_vector(core);
+              if(core->irqvec)
+                {
+                  log_msg(core, SYS_CORE, CORE_INST, "----------------------------------------\n");
+                  log_msg(core, SYS_CORE, CORE_INST, "INTERRUPT vector %04X\n", core->irqvec);
+                  core->pc_opcode = core->regs.pc;
+                  core->stackcnt  = 0;
+                  core->state     = STATE_STACK;
+                  break;
+                }
+            }
+          /* FALLTHROUGH */
+        case STATE_PREFIX:
+          log_msg(core, SYS_CORE, CORE_INST, "----------------------------------------\n");
           core->busadr = core->regs.pc;
           core->busdat = hc11_core_readb(core,core->busadr);
           core->pc_opcode = core->regs.pc;
@@ -528,7 +857,7 @@ void hc11_core_clock(struct hc11_core *core)
             {
               if(core->prefix == 0)
                 {
-                  log_msg(SYS_CORE, CORE_INST, "Got prefix %02X\n", core->busdat);
+                  log_msg(core, SYS_CORE, CORE_INST, "Got prefix %02X\n", core->busdat);
                   core->prefix = core->busdat;
                   core->state = STATE_PREFIX; //dummy state to avoid stopping single step in the middle of the inst
                   break; //stay in this state
@@ -550,7 +879,7 @@ void hc11_core_clock(struct hc11_core *core)
             if(core->prefix == 0x1A) modtable = opmodes_1A;
             if(core->prefix == 0xCD) modtable = opmodes_CD;
             core->addmode = modtable[core->opcode];
-            log_msg(SYS_CORE, CORE_ADMODE,"add mode: %d\n", core->addmode);
+            log_msg(core, SYS_CORE, CORE_ADMODE,"add mode: %d\n", core->addmode);
             switch(core->addmode)
               {
                 case ILL: //illegal opcode
@@ -587,7 +916,7 @@ void hc11_core_clock(struct hc11_core *core)
                   break;
 
                 default:
-                  log_msg(SYS_CORE, CORE_ERROR, "ERROR - undefined addressing mode %d!\n", core->addmode);
+                  log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - undefined addressing mode %d!\n", core->addmode);
                   core->busadr  = VECTOR_ILLEGAL;
                   core->state   = STATE_VECTORFETCH_H;
               }
@@ -614,67 +943,67 @@ void hc11_core_clock(struct hc11_core *core)
           switch(core->addmode)
             {
               case REL:
-                log_msg(SYS_CORE, CORE_ADMODE, "Relative\n");
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Relative\n");
                 break;
 
               case IM1:
               case IM2:
-                log_msg(SYS_CORE, CORE_ADMODE, "Immediate (1/2)\n");
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Immediate (1/2)\n");
                 break;
 
               case EXS:
               case DIS:
-                log_msg(SYS_CORE, CORE_ADMODE, "Direct/Extended (0)\n");
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Direct/Extended (0)\n");
                 break;
 
               case DIR:
               case EXT:
-                log_msg(SYS_CORE, CORE_ADMODE, "Direct/Extended (1)\n");
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Direct/Extended (1)\n");
                 core->state = STATE_READOP_L; //read value not used for jsr and bsr, but still acquired
                 break;
 
               case DI2:
               case EX2:
-                log_msg(SYS_CORE, CORE_ADMODE, "Direct/Extended (2)\n");
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Direct/Extended (2)\n");
                 core->state = STATE_READOP_H;
                 break;
 
               case IXS:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(0) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(0) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
                 core->operand = core->regs.x + core->operand;
                 break;
 
               case IYS:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(0) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(0) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
                 core->operand = core->regs.y + core->operand;
                 break;
 
               case INX:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(1) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(1) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
                 core->operand = core->regs.x + core->operand;
                 core->state = STATE_READOP_L;
                 break;
 
               case INY:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(1) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(1) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
                 core->operand = core->regs.y + core->operand;
                 core->state = STATE_READOP_L;
                 break;
 
               case IX2:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(2) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(2) op X=0x%04X off=0x%02X (%d)\n", core->regs.x, core->operand, core->operand);
                 core->operand = core->regs.x + core->operand;
                 core->state = STATE_READOP_H;
                 break;
 
               case IY2:
-                log_msg(SYS_CORE, CORE_ADMODE, "Indexed(2) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
+                log_msg(core, SYS_CORE, CORE_ADMODE, "Indexed(2) op Y=0x%04X off=0x%02X (%d)\n", core->regs.y, core->operand, core->operand);
                 core->operand = core->regs.y + core->operand;
                 core->state = STATE_READOP_H;
                 break;
 
               default:
-                log_msg(SYS_CORE, CORE_ERROR, "ERROR - undefined operand fetch mode %d!\n", core->addmode);
+                log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - undefined operand fetch mode %d!\n", core->addmode);
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
             }
@@ -727,7 +1056,7 @@ void hc11_core_clock(struct hc11_core *core)
 
         case STATE_EXECUTENEXT: //finish BRSET/BRCLR insns
           core->state = STATE_FETCHOPCODE; //default action when nothing needs writing
-          log_msg(SYS_CORE, CORE_INST, "[%10"PRIu64"] EXEC_NEXT\n",core->clocks);
+          log_msg(core, SYS_CORE, CORE_INST, "[%10"PRIu64"] EXEC_NEXT\n",core->clocks);
           switch(core->opcode)
             {
               uint16_t tmp;
@@ -742,7 +1071,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "BSET MASK %02X\n", core->op2);
+                log_msg(core, SYS_CORE, CORE_INST, "BSET MASK %02X\n", core->op2);
                 break;
 
               case OP15_BCLR_DIR:
@@ -754,7 +1083,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "BCLR MASK %02X\n", core->op2);
+                log_msg(core, SYS_CORE, CORE_INST, "BCLR MASK %02X\n", core->op2);
                 break;
 
               case OP12_BRSET_DIR:
@@ -765,7 +1094,7 @@ void hc11_core_clock(struct hc11_core *core)
                     rel = (int16_t)((int8_t)core->op3);
                     core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BRSET MASK %02X REL %02X PC %04X\n", core->op2, core->op3, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BRSET MASK %02X REL %02X PC %04X\n", core->op2, core->op3, core->regs.pc);
                 break;
 
               case OP13_BRCLR_DIR:
@@ -776,19 +1105,22 @@ void hc11_core_clock(struct hc11_core *core)
                     rel = (int16_t)((int8_t)core->op3);
                     core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BRCLR MASK %02X REL %02X PC %04X\n", core->op2, core->op3, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BRCLR MASK %02X REL %02X PC %04X\n", core->op2, core->op3, core->regs.pc);
                 break;
               default:
-                log_msg(SYS_CORE, CORE_ERROR, "ERROR - undefined opcode %02X in EXECUTE_NEXT!\n", core->opcode);
+                log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - undefined opcode %02X in EXECUTE_NEXT!\n", core->opcode);
             }
           break;
 
         case STATE_EXECUTE:
-          log_msg(SYS_CORE, CORE_INST, "[%8ld] EXEC  %02X operand %04X\n", core->clocks, core->opcode, core->operand);
+          log_msg(core, SYS_CORE, CORE_INST, "[%8ld] EXEC  %02X operand %04X\n", core->clocks, core->opcode, core->operand);
           core->prefix = 0; //prepare for next opcode
           core->state = STATE_FETCHOPCODE; //default action when nothing needs writing
 
-          core->istat_main[core->opcode] += 1;
+          if(core->istats)
+            {
+              core->istat_main[core->opcode] += 1;
+            }
           switch(core->opcode)
             {
               uint16_t tmp,tmp2,tmp3;
@@ -797,17 +1129,17 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
                 core->status = STATUS_EXECUTED_STOP;
-                log_msg(SYS_CORE, CORE_INST, "TEST instruction not available in sim -> stop\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TEST instruction not available in sim -> stop\n");
                 //behave as STOP
                 break;
 
               case OP01_NOP_INH  :
-                log_msg(SYS_CORE, CORE_INST, "NOP\n");
+                log_msg(core, SYS_CORE, CORE_INST, "NOP\n");
                 break;
 
               case OP02_IDIV_INH : /*ZVC*/
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "IDIV %04X / %04X\n", core->regs.d, core->regs.x);
+                log_msg(core, SYS_CORE, CORE_INST, "IDIV %04X / %04X\n", core->regs.d, core->regs.x);
                 if(core->regs.x == 0)
                   {
                     //divide by zero
@@ -819,26 +1151,34 @@ void hc11_core_clock(struct hc11_core *core)
                     tmp = core->regs.x;
                     core->regs.x = core->regs.d / tmp;
                     core->regs.d = core->regs.d % tmp;
-                    core->regs.flags.Z = (tmp == 0);
+                    core->regs.flags.C = 0;
                   }
+                core->regs.flags.Z = (core->regs.x == 0);
                 break;
 
               case OP03_FDIV_INH : /*ZVC*/
                 core->regs.flags.V = core->regs.x <= core->regs.d;
-                log_msg(SYS_CORE, CORE_INST, "FDIV %04X / %04X\n", core->regs.d, core->regs.x);
+                log_msg(core, SYS_CORE, CORE_INST, "FDIV %04X / %04X\n", core->regs.d, core->regs.x);
                 if(core->regs.x == 0)
                   {
                     //divide by zero
                     core->regs.x = 0xFFFF;
                     core->regs.flags.C = 1;
                   }
+                else if(core->regs.flags.V)
+                  {
+                    //quotient does not fit
+                    core->regs.x = 0xFFFF;
+                    core->regs.flags.C = 0;
+                  }
                 else
                   {
                     tmp = core->regs.x;
                     core->regs.x = (uint16_t)(((uint32_t)core->regs.d << 16) / (uint32_t)tmp);
                     core->regs.d = (uint16_t)(((uint32_t)core->regs.d << 16) % (uint32_t)tmp);
-                    core->regs.flags.Z = (tmp == 0);
+                    core->regs.flags.C = 0;
                   }
+                core->regs.flags.Z = (core->regs.x == 0);
                 break;
 
               case OP_MUL_INH   : /*C*/
@@ -846,17 +1186,17 @@ void hc11_core_clock(struct hc11_core *core)
                 tmp *= (core->regs.d >> 8);
                 core->regs.flags.C = (tmp >> 7) & 1;
                 core->regs.d = tmp;
-                log_msg(SYS_CORE, CORE_INST, "MUL\n");
+                log_msg(core, SYS_CORE, CORE_INST, "MUL\n");
                 break;
 
               case OP06_TAP_INH  : /*SXHINZVC*/
                 core->regs.ccr = core->regs.d >> 8;
-                log_msg(SYS_CORE, CORE_INST, "TAP\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TAP\n");
                 break;
 
               case OP07_TPA_INH  :
                 core->regs.d = (core->regs.d & 0x00FF) | (core->regs.ccr << 8);
-                log_msg(SYS_CORE, CORE_INST, "TPA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TPA\n");
                 break;
 
               case OP16_TAB_INH   : /*NZV*/
@@ -865,7 +1205,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "TAB\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TAB\n");
                 break;
 
               case OP17_TBA_INH   : /*NZV*/
@@ -874,43 +1214,43 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "TBA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TBA\n");
                 break;
 
               case OP0A_CLV_INH  : /*V*/
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "CLV\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLV\n");
                 break;
 
               case OP0B_SEV_INH  : /*V*/
                 core->regs.flags.V = 1;
-                log_msg(SYS_CORE, CORE_INST, "SEV\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SEV\n");
                 break;
 
               case OP0C_CLC_INH  : /*C*/
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "CLC\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLC\n");
                 break;
 
               case OP0D_SEC_INH  : /*C*/
                 core->regs.flags.C = 1;
-                log_msg(SYS_CORE, CORE_INST, "SEC\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SEC\n");
                 break;
 
               case OP0E_CLI_INH  : /*I*/
                 core->regs.flags.I = 0;
-                log_msg(SYS_CORE, CORE_INST, "CLI\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLI\n");
                 break;
 
               case OP0F_SEI_INH  : /*I*/
                 core->regs.flags.I = 1;
-                log_msg(SYS_CORE, CORE_INST, "SEI\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SEI\n");
                 break;
 
               case OP_ABXY_INH  :
                 core->regs.x = core->regs.x + (core->regs.d & 0xFF);
                 /* No flags changed */
-                log_msg(SYS_CORE, CORE_INST, "ABX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ABX\n");
                 break;
 
               case OP_ABA_INH   : /*HNZCV*/
@@ -920,15 +1260,15 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp3 << 8);
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ABA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ABA\n");
                 break;
 
               case OP10_SBA_INH   : /*NZVC*/
@@ -943,7 +1283,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) &&  (tmp3 >> 7)) ||
                                      ( (tmp3 >> 7) && !(tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "SBA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SBA\n");
                 break;
 
               case OP11_CBA_INH   : /*NZVC*/
@@ -957,13 +1297,13 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(tmp >>7) &&  (tmp2>> 7)) ||
                                      ( (tmp2>>7) &&  (tmp3>>7)) ||
                                      ( (tmp3>>7) && !(tmp >>7));
-                log_msg(SYS_CORE, CORE_INST, "CBA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CBA\n");
                 break;
 
               case OP19_DAA_INH   : /*NZC*/
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
-                log_msg(SYS_CORE, CORE_ERROR, "ERROR - undefined opcode %02X in EXECUTE!\n", core->opcode);
+                log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - undefined opcode %02X in EXECUTE!\n", core->opcode);
                 break;
 
               case OP_CLRA_INH : /*NZVC*/
@@ -972,7 +1312,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = 1;
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "CLRA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLRA\n");
                 break;
 
               case OP_CLRB_INH : /*NZVC*/
@@ -981,7 +1321,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = 1;
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "CLRB\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLRB\n");
                 break;
 
               case OP_INCA_INH : /*NZV*/
@@ -991,7 +1331,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp << 8);
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_INST, "INCA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "INCA -> %02X\n", tmp);
                 break;
 
               case OP_INCB_INH : /*NZV*/
@@ -1001,7 +1341,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | tmp;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_INST, "INCB -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "INCB -> %02X\n", tmp);
                 break;
 
               case OP_DECA_INH : /*NZV*/
@@ -1011,7 +1351,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp << 8);
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_INST, "DECA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "DECA -> %02X\n", tmp);
                 break;
 
               case OP_DECB_INH : /*NZV*/
@@ -1021,7 +1361,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | tmp;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_INST, "DECB -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "DECB -> %02X\n", tmp);
                 break;
 
               case OP_LSRA_INH : /*NZVC*/
@@ -1057,7 +1397,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "ASLA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ASLA -> %02X\n", tmp);
                 break;
 
               case OP_ASLB_INH : /*NZVC*/
@@ -1068,7 +1408,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "ASLB -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ASLB -> %02X\n", tmp);
                 break;
 
               case OP05_ASLD_INH : /*NZVC*/
@@ -1079,7 +1419,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "LSLD/ASLD -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "LSLD/ASLD -> %02X\n", tmp);
                 break;
 
               case OP46_RORA_INH : /*NZVC*/
@@ -1089,7 +1429,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = core->regs.d >> 15;
                 core->regs.flags.Z = (core->regs.d >> 8) == 0;
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "RORA -> %02X C=%d\n", core->regs.d >> 8, core->regs.flags.C);
+                log_msg(core, SYS_CORE, CORE_INST, "RORA -> %02X C=%d\n", core->regs.d >> 8, core->regs.flags.C);
 
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
@@ -1102,7 +1442,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (core->regs.d >> 7) & 1;
                 core->regs.flags.Z = (core->regs.d & 0xFF) == 0;
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "RORB -> %02X C=%d\n", core->regs.d & 0xFF, core->regs.flags.C);
+                log_msg(core, SYS_CORE, CORE_INST, "RORB -> %02X C=%d\n", core->regs.d & 0xFF, core->regs.flags.C);
 
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
@@ -1115,7 +1455,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = core->regs.d >> 15;
                 core->regs.flags.Z = (core->regs.d>>8) == 0;
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "ROLA -> %02X C=%d\n", core->regs.d >> 8, core->regs.flags.C);
+                log_msg(core, SYS_CORE, CORE_INST, "ROLA -> %02X C=%d\n", core->regs.d >> 8, core->regs.flags.C);
                 break;
 
               case OP59_ROLB_INH : /*NZVC*/
@@ -1125,27 +1465,27 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (core->regs.d & 0xFF) >> 7;
                 core->regs.flags.Z = (core->regs.d & 0xFF) == 0;
                 core->regs.flags.V = core->regs.flags.C ^ core->regs.flags.N;
-                log_msg(SYS_CORE, CORE_INST, "ROLB -> %02X C=%d\n", core->regs.d & 0xFF, core->regs.flags.C);
+                log_msg(core, SYS_CORE, CORE_INST, "ROLB -> %02X C=%d\n", core->regs.d & 0xFF, core->regs.flags.C);
                 break;
 
               case OP_NEGA_INH : /*NZVC*/
-                tmp = 0x00 - (core->regs.d>>8);
+                tmp = (0x00 - (core->regs.d>>8)) & 0xFF;
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp << 8);
                 core->regs.flags.N = (tmp>>7);
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = (tmp==0x80);
                 core->regs.flags.C = (tmp!=0);
-                log_msg(SYS_CORE, CORE_INST, "NEGA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "NEGA -> %02X\n", tmp);
                 break;
 
               case OP_NEGB_INH : /*NZVC*/
-                tmp = 0x00 - (core->regs.d&0xFF);
+                tmp = (0x00 - (core->regs.d&0xFF)) & 0xFF;
                 core->regs.d = (core->regs.d & 0xFF00) | tmp;
                 core->regs.flags.N = (tmp>>7);
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = (tmp==0x80);
                 core->regs.flags.C = (tmp!=0);
-                log_msg(SYS_CORE, CORE_INST, "NEGB -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "NEGB -> %02X\n", tmp);
                 break;
 
               case OP_COMA_INH : /*NZVC*/
@@ -1155,7 +1495,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 1;
-                log_msg(SYS_CORE, CORE_INST, "COMA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "COMA -> %02X\n", tmp);
                 break;
 
               case OP_COMB_INH : /*NZVC*/
@@ -1165,7 +1505,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 1;
-                log_msg(SYS_CORE, CORE_INST, "COMB -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "COMB -> %02X\n", tmp);
                 break;
 
               case OP_TSTA_INH : /*NZVC*/
@@ -1174,7 +1514,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "TSTA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "TSTA -> %02X\n", tmp);
                 break;
 
               case OP_TSTB_INH : /*NZVC*/
@@ -1183,94 +1523,95 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "TSTA -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "TSTA -> %02X\n", tmp);
                 break;
 
               case OP_PSHA_INH  :
                 core->busdat = (core->regs.d >> 8) << 8;
                 core->state = STATE_PUSH_H; // single wordm positioned in MSByte
-                log_msg(SYS_CORE, CORE_INST, "PSHA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PSHA\n");
                 break;
 
               case OP_PSHB_INH  :
                 core->busdat = (core->regs.d & 0xFF) << 8;
                 core->state = STATE_PUSH_H; // single word, positioned in MSByte
-                log_msg(SYS_CORE, CORE_INST, "PSHB\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PSHB\n");
                 break;
 
               case OP_PULA_INH  :
                 core->pulsel = PULL_A;
                 core->state = STATE_PULL_L;
-                log_msg(SYS_CORE, CORE_INST, "PULA\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PULA\n");
                 break;
 
               case OP_PULB_INH  :
                 core->pulsel = PULL_B;
                 core->state = STATE_PULL_L;
-                log_msg(SYS_CORE, CORE_INST, "PULB\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PULB\n");
                 break;
 
               case OP_TSXY_INH  :
                 core->regs.x = core->regs.sp + 1;
-                log_msg(SYS_CORE, CORE_INST, "TSX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TSX\n");
                 break;
 
               case OP_TXYS_INH  :
                 core->regs.sp = core->regs.x - 1;
-                log_msg(SYS_CORE, CORE_INST, "TXS\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TXS\n");
                 break;
 
               case OP_INS_INH   :
                 core->regs.sp = core->regs.sp + 1;
-                log_msg(SYS_CORE, CORE_INST, "INS -> %04X\n", core->regs.sp );
+                log_msg(core, SYS_CORE, CORE_INST, "INS -> %04X\n", core->regs.sp );
                 break;
 
               case OP_DES_INH   :
                 core->regs.sp = core->regs.sp - 1;
-                log_msg(SYS_CORE, CORE_INST, "DES -> %04X\n", core->regs.sp );
+                log_msg(core, SYS_CORE, CORE_INST, "DES -> %04X\n", core->regs.sp );
                 break;
 
 
               case OP08_INXY_INH : /*Z*/
                 core->regs.x = core->regs.x + 1;
                 core->regs.flags.Z = (core->regs.x == 0);
-                log_msg(SYS_CORE, CORE_INST, "INX -> %04X\n", core->regs.x );
+                log_msg(core, SYS_CORE, CORE_INST, "INX -> %04X\n", core->regs.x );
                 break;
 
               case OP09_DEXY_INH : /*Z*/
                 core->regs.x = core->regs.x - 1;
                 core->regs.flags.Z = (core->regs.x == 0);
-                log_msg(SYS_CORE, CORE_INST, "DEX -> %04X\n", core->regs.x );
+                log_msg(core, SYS_CORE, CORE_INST, "DEX -> %04X\n", core->regs.x );
                 break;
 
               case OP_PSHXY_INH :
                 core->busdat = core->regs.x;
                 core->state = STATE_PUSH_L; // not H, push happens L first
-                log_msg(SYS_CORE, CORE_INST, "PSHX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PSHX\n");
                 break;
 
               case OP_PULXY_INH :
                 core->pulsel = PULL_X;
                 core->state = STATE_PULL_H;
-                log_msg(SYS_CORE, CORE_INST, "PULX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PULX\n");
                 break;
 
               case OP_RTS_INH:
                 core->pulsel = PULL_PC;
                 core->state = STATE_PULL_H;
-                log_msg(SYS_CORE, CORE_INST, "RTS\n");
+                log_msg(core, SYS_CORE, CORE_INST, "RTS\n");
                 break;
 
               case OP_XGDXY_INH :
                 tmp = core->regs.d;
                 core->regs.d = core->regs.x;
                 core->regs.x = tmp;
-                log_msg(SYS_CORE, CORE_INST, "XGDX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "XGDX\n");
                 break;
 
               case OP_RTI_INH   : /*SXHINZVC*/
-                core->busadr  = VECTOR_ILLEGAL;
-                core->state   = STATE_VECTORFETCH_H;
+                core->pulsel = PULL_CCR; //then B, A, X, Y, PC, see STATE_PULL_L
+                core->state = STATE_PULL_L;
+                log_msg(core, SYS_CORE, CORE_INST, "RTI\n");
                 break;
 
               case OP_WAI_INH   :
@@ -1281,46 +1622,48 @@ void hc11_core_clock(struct hc11_core *core)
               case OP_STOP_INH  :
                 core->busadr  = VECTOR_ILLEGAL;
                 core->state   = STATE_VECTORFETCH_H;
-                log_msg(SYS_CORE, CORE_INST, "TODO stop the clock until an IRQ (SCI?) happens\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TODO stop the clock until an IRQ (SCI?) happens\n");
                 break;
 
               case OP_SWI_INH   :
-                core->busadr  = VECTOR_ILLEGAL;
-                core->state   = STATE_VECTORFETCH_H;
+                core->irqvec   = VECTOR_SWI;
+                core->stackcnt = 0;
+                core->state    = STATE_STACK;
+                log_msg(core, SYS_CORE, CORE_INST, "SWI\n");
                 break;
 
               case OP12_BRSET_DIR :
               case OP_BRSET_IND :
-                log_msg(SYS_CORE, CORE_INST, "BRSET_DIR_IND %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BRSET_DIR_IND %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP13_BRCLR_DIR :
               case OP_BRCLR_IND :
-                log_msg(SYS_CORE, CORE_INST, "BRCLR_DIR_IND %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BRCLR_DIR_IND %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP14_BSET_DIR  : /*NZV*/
               case OP_BSET_IND  :
-                log_msg(SYS_CORE, CORE_INST, "BSET_DIR_IND %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BSET_DIR_IND %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP15_BCLR_DIR  : /*NZV*/
               case OP_BCLR_IND  :
-                log_msg(SYS_CORE, CORE_INST, "BCLR_DIR_IND %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BCLR_DIR_IND %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP_BRA_REL  :
                 rel = (int16_t)((int8_t)core->operand);
                 core->regs.pc = core->regs.pc + rel;
-                log_msg(SYS_CORE, CORE_INST, "BRA %04X\n", core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BRA %04X\n", core->regs.pc);
                 break;
 
               case OP_BRN_REL  :
-                log_msg(SYS_CORE, CORE_INST, "BRN\n");
+                log_msg(core, SYS_CORE, CORE_INST, "BRN\n");
                 break;
 
               case OP_BHI_REL  :
@@ -1329,7 +1672,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BHI -> C=%d Z=%d pc=%04X\n", core->regs.flags.C, core->regs.flags.Z, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BHI -> C=%d Z=%d pc=%04X\n", core->regs.flags.C, core->regs.flags.Z, core->regs.pc);
                 break;
 
               case OP_BLS_REL  :
@@ -1338,7 +1681,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BLS -> C=%d Z=%d pc=%04X\n", core->regs.flags.C, core->regs.flags.Z, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BLS -> C=%d Z=%d pc=%04X\n", core->regs.flags.C, core->regs.flags.Z, core->regs.pc);
                 break;
 
               case OP_BHS_REL  :
@@ -1347,7 +1690,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BHS/BCC -> C=%d pc=%04X\n", core->regs.flags.C, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BHS/BCC -> C=%d pc=%04X\n", core->regs.flags.C, core->regs.pc);
                 break;
 
               case OP_BLO_REL  :
@@ -1356,7 +1699,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BLO/BCS -> C=%d pc=%04X\n", core->regs.flags.C, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BLO/BCS -> C=%d pc=%04X\n", core->regs.flags.C, core->regs.pc);
                 break;
 
               case OP_BNE_REL  :
@@ -1365,7 +1708,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BNE -> Z=%d pc=%04X\n" , core->regs.flags.Z, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BNE -> Z=%d pc=%04X\n" , core->regs.flags.Z, core->regs.pc);
                 break;
 
 
@@ -1375,7 +1718,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BEQ -> Z=%d pc=%04X\n" , core->regs.flags.Z, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BEQ -> Z=%d pc=%04X\n" , core->regs.flags.Z, core->regs.pc);
                 break;
 
               case OP_BVC_REL  :
@@ -1384,7 +1727,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BVC -> V=%d pc=%04X\n" , core->regs.flags.V, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BVC -> V=%d pc=%04X\n" , core->regs.flags.V, core->regs.pc);
                 break;
 
               case OP_BVS_REL  :
@@ -1393,7 +1736,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BVS -> V=%d pc=%04X\n" , core->regs.flags.V, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BVS -> V=%d pc=%04X\n" , core->regs.flags.V, core->regs.pc);
                 break;
 
               case OP_BPL_REL  :
@@ -1402,7 +1745,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BPL -> N=%d pc=%04X\n" , core->regs.flags.N, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BPL -> N=%d pc=%04X\n" , core->regs.flags.N, core->regs.pc);
                 break;
 
               case OP_BMI_REL  :
@@ -1411,7 +1754,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BMI -> N=%d pc=%04X\n" , core->regs.flags.N, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BMI -> N=%d pc=%04X\n" , core->regs.flags.N, core->regs.pc);
                 break;
 
               case OP_BGE_REL  :
@@ -1420,7 +1763,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BGE -> N=%d V=%d pc=%04X\n" , core->regs.flags.N, core->regs.flags.V, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BGE -> N=%d V=%d pc=%04X\n" , core->regs.flags.N, core->regs.flags.V, core->regs.pc);
                 break;
 
               case OP_BLT_REL  :
@@ -1429,7 +1772,7 @@ void hc11_core_clock(struct hc11_core *core)
                   rel = (int16_t)((int8_t)core->operand);
                   core->regs.pc = core->regs.pc + rel;
                   }
-                log_msg(SYS_CORE, CORE_INST, "BLT -> N=%d V=%d pc=%04X\n" , core->regs.flags.N, core->regs.flags.V, core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "BLT -> N=%d V=%d pc=%04X\n" , core->regs.flags.N, core->regs.flags.V, core->regs.pc);
                 break;
 
               case OP_BGT_REL  :
@@ -1447,7 +1790,8 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = core->regs.pc;
                 core->regs.pc = core->regs.pc + rel;
                 core->state = STATE_PUSH_L; // not H, push happens L first
-                log_msg(SYS_CORE, CORE_INST, "BSR %04X\n", core->regs.pc);
+                hc11_core_call(core, core->pc_opcode, core->regs.pc, core->regs.sp, 0);
+                log_msg(core, SYS_CORE, CORE_INST, "BSR %04X\n", core->regs.pc);
                 break;
 
               case OP_NEG_EXT : /*NZVC*/
@@ -1460,7 +1804,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "NEG_EXT_INX -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "NEG_EXT_INX -> %02X\n", tmp);
                 break;
 
               case OP_COM_EXT : /*NZVC*/
@@ -1473,7 +1817,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "COM_EXT_INX -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "COM_EXT_INX -> %02X\n", tmp);
                 break;
 
               case OP_LSR_EXT : /*NZVC*/
@@ -1499,7 +1843,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "ASL_EXT_INX -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ASL_EXT_INX -> %02X\n", tmp);
                 break;
 
               case OP_ROL_EXT :/*NZVC*/
@@ -1524,7 +1868,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "DEC_EXT_INX -> %02X @ %04X\n", tmp, core->busadr);
+                log_msg(core, SYS_CORE, CORE_INST, "DEC_EXT_INX -> %02X @ %04X\n", tmp, core->busadr);
                 break;
 
               case OP_INC_EXT : /*NZV*/
@@ -1537,7 +1881,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "INC_EXT_INX -> %02X @ %04X\n", tmp, core->busadr);
+                log_msg(core, SYS_CORE, CORE_INST, "INC_EXT_INX -> %02X @ %04X\n", tmp, core->busadr);
                 break;
 
               case OP_TST_EXT : /*NZVC*/
@@ -1547,13 +1891,13 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "TST_EXT_INX -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "TST_EXT_INX -> %02X\n", tmp);
                 break;
 
               case OP_JMP_EXT :
               case OP_JMP_IND :
                 core->regs.pc = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "JMP_EXT_IND %04X\n", core->regs.pc);
+                log_msg(core, SYS_CORE, CORE_INST, "JMP_EXT_IND %04X\n", core->regs.pc);
                 break;
 
               case OP_CLR_EXT :/*NZVC*/
@@ -1565,12 +1909,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busadr = core->operand;
                 core->busdat = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "CLR_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLR_DIR_EXT_INX\n");
                 break;
 
               case OP_BITA_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "BITA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "BITA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_BITA_IND :/*NZV*/ 
               case OP_BITA_DIR :
@@ -1579,12 +1923,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "BITA_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "BITA_DIR_EXT_INX\n");
                 break;
 
               case OP_BITB_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "BITB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "BITB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_BITB_IND :/*NZV*/ 
               case OP_BITB_DIR :
@@ -1593,12 +1937,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "BITB_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "BITB_DIR_EXT_INX\n");
                 break;
 
               case OP_ANDA_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ANDA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ANDA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ANDA_IND :/*NZV*/ 
               case OP_ANDA_DIR :
@@ -1608,12 +1952,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ANDA_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ANDA_DIR_EXT_INX\n");
                 break;
 
               case OP_ANDB_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ANDB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ANDB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ANDB_IND :/*NZV*/ 
               case OP_ANDB_DIR :
@@ -1623,12 +1967,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ANDB_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ANDB_DIR_EXT_INX\n");
                 break;
 
               case OP_ORAA_IMM  : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ORAA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ORAA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ORAA_IND : /*NZV*/
               case OP_ORAA_DIR :
@@ -1638,12 +1982,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ORAA_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ORAA_DIR_EXT_INX\n");
                 break;
 
               case OP_ORAB_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ORAB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ORAB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ORAB_IND : /*NZV*/
               case OP_ORAB_DIR :
@@ -1653,12 +1997,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ORAB_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ORAB_DIR_EXT_INX\n");
                 break;
 
               case OP_EORA_IMM  : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "EORA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "EORA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_EORA_IND : /*NZV*/
               case OP_EORA_DIR :
@@ -1668,12 +2012,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "EORA_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "EORA_DIR_EXT_INX\n");
                 break;
 
               case OP_EORB_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "EORB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "EORB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_EORB_IND :/*NZV*/
               case OP_EORB_DIR :
@@ -1683,12 +2027,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "EORB_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "EORB_DIR_EXT_INX\n");
                 break;
 
               case OP_ADDA_IMM  : /*HNZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ADDA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ADDA_IND : /*HNZVC*/
               case OP_ADDA_DIR :
@@ -1699,20 +2043,20 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp3 << 8);
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADDA_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDA_IND_DIR_EXT\n");
                 break;
 
               case OP_ADDB_IMM : /*HNZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ADDB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ADDB_IND : /*HNZVC*/
               case OP_ADDB_DIR :
@@ -1723,20 +2067,20 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | (tmp3) & 0xFF;
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADDB_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDB_IND_DIR_EXT\n");
                 break;
 
               case OP_ADCA_IMM  : /*HNZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ADCA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ADCA_IND : /*HNZVC*/
               case OP_ADCA_DIR :
@@ -1747,20 +2091,20 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp3 << 8);
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADCA_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCA_IND_DIR_EXT\n");
                 break;
 
               case OP_ADCB_IMM : /*HNZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ADCB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ADCB_IND : /*HNZVC*/
               case OP_ADCB_DIR :
@@ -1771,20 +2115,20 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | (tmp3) & 0xFF;
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADCB_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCB_IND_DIR_EXT\n");
                 break;
 
               case OP_SUBA_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "SUBA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SUBA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_SUBA_IND :/*NZVC*/
               case OP_SUBA_DIR :
@@ -1795,7 +2139,7 @@ void hc11_core_clock(struct hc11_core *core)
 
               case OP_SUBB_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "SUBB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SUBB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_SUBB_IND :/*NZVC*/
               case OP_SUBB_DIR :
@@ -1806,7 +2150,7 @@ void hc11_core_clock(struct hc11_core *core)
 
               case OP_SBCA_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "SBCA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SBCA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_SBCA_IND :/*NZVC*/
               case OP_SBCA_DIR :
@@ -1817,7 +2161,7 @@ void hc11_core_clock(struct hc11_core *core)
 
               case OP_SBCB_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "SBCB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SBCB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_SBCB_IND :/*NZVC*/
               case OP_SBCB_DIR :
@@ -1830,7 +2174,7 @@ void hc11_core_clock(struct hc11_core *core)
 
               case OP_CMPA_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "CMPA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CMPA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_CMPA_IND :/*NZVC*/
               case OP_CMPA_DIR :
@@ -1844,12 +2188,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(core->regs.d>>15) &&  (core->busdat>> 7)) || 
                                      ( (core->busdat>> 7) &&  (tmp         >> 7)) ||
                                      ( (tmp         >> 7) && !(core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "CMPA_INX_DIR_EXT A=%02X M=%02X R=%02X\n", core->regs.d>>8, core->busdat&0xFF, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CMPA_INX_DIR_EXT A=%02X M=%02X R=%02X\n", core->regs.d>>8, core->busdat&0xFF, tmp);
                 break;
 
               case OP_CMPB_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "CMPB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CMPB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_CMPB_IND :/*NZVC*/
               case OP_CMPB_DIR :
@@ -1863,12 +2207,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!((core->regs.d&0xFF)>> 7) &&  (core->busdat>> 7)) || 
                                      ( (core->busdat>> 7) &&  (tmp         >> 7)) ||
                                      ( (tmp         >> 7) && !((core->regs.d&0xFF)>> 7));
-                log_msg(SYS_CORE, CORE_INST, "CMPB_INX_DIR_EXT B=%02X M=%02X R=%02X\n", core->regs.d&0xFF, core->busdat&0xFF, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CMPB_INX_DIR_EXT B=%02X M=%02X R=%02X\n", core->regs.d&0xFF, core->busdat&0xFF, tmp);
                 break;
 
               case OP_CPD_SUBD_IMM : /* SUBD: NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "SUBD_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "SUBD_IMM\n");
                 /*FALLTHROUGH*/
               case OP_CPD_SUBD_IND :/*subd: NZVC*/
               case OP_CPD_SUBD_DIR :
@@ -1881,13 +2225,13 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(core->regs.d>>15) &&  (core->busdat>>15)) || 
                                      ( (core->busdat>>15) &&  (tmp         >>15)) ||
                                      ( (tmp         >>15) && !(core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "SUBD_IND_DIR_EXT D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "SUBD_IND_DIR_EXT D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
                 core->regs.d = tmp;
                 break;
 
               case OP_CPXY_IMM  : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "CPX_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CPX_IMM\n");
                 /*FALLTHROUGH*/
               case OP_CPXY_IND : /*NZVC*/
               case OP_CPXY_DIR :
@@ -1900,21 +2244,22 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(core->regs.x>>15) &&  (core->busdat>>15)) || 
                                      ( (core->busdat>>15) &&  (tmp         >>15)) ||
                                      ( (tmp         >>15) && !(core->regs.x>>15));
-                log_msg(SYS_CORE, CORE_INST, "CPD_DIR_INDX X=%04X M=%04X diff=%04X\n",core->regs.x,core->busdat, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CPD_DIR_INDX X=%04X M=%04X diff=%04X\n",core->regs.x,core->busdat, tmp);
                 break;
 
               case OP_JSR_IND  :
               case OP_JSR_DIR  :
               case OP_JSR_EXT  :
-                log_msg(SYS_CORE, CORE_INST, "JSR_EXT ea=%04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "JSR_EXT ea=%04X\n", core->operand);
                 core->busdat  = core->regs.pc;
                 core->regs.pc = core->operand;
                 core->state = STATE_PUSH_L; // not H, push happens L first
+                hc11_core_call(core, core->pc_opcode, core->regs.pc, core->regs.sp, 0);
                 break;
 
               case OP_LDS_IMM   : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDS_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDS_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDS_IND  : /*NZV*/
               case OP_LDS_DIR  :
@@ -1923,7 +2268,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (core->busdat >> 15);
                 core->regs.flags.Z = (core->busdat == 0);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDS_DIR_EXT_INX %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "LDS_DIR_EXT_INX %04X\n", core->operand);
                 break;
 
               case OP_STS_IND  : /*NZV*/
@@ -1936,12 +2281,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STS_DIR_EXT_INX %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "STS_DIR_EXT_INX %04X\n", core->operand);
                 break;
 
               case OP_ADDD_IMM : /*NZVC*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "ADDD_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDD_IMM\n");
                 /*FALLTHROUGH*/
               case OP_ADDD_IND : /*NZVC*/
               case OP_ADDD_DIR :
@@ -1954,13 +2299,13 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = ( (core->regs.d>>15) &&  (core->busdat>>15)) || 
                                      ( (core->busdat>>15) && !(tmp         >>15)) ||
                                      (!(tmp         >>15) &&  (core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "ADDD_IND_DIR_EXT D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ADDD_IND_DIR_EXT D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
                 core->regs.d = tmp;
                 break;
 
               case OP_LDAA_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDAA_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDAA_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDAA_IND :/*NZV*/
               case OP_LDAA_DIR :
@@ -1970,12 +2315,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDAA_DIR_EXT_INX %02X\n", core->busdat & 0xFF);
+                log_msg(core, SYS_CORE, CORE_INST, "LDAA_DIR_EXT_INX %02X\n", core->busdat & 0xFF);
                 break;
 
               case OP_LDAB_IMM :/*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDAB_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDAB_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDAB_IND :/*NZV*/
               case OP_LDAB_DIR :
@@ -1985,12 +2330,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDAB_DIR_EXT_INX %02X\n", core->busdat & 0xFF);
+                log_msg(core, SYS_CORE, CORE_INST, "LDAB_DIR_EXT_INX %02X\n", core->busdat & 0xFF);
                 break;
 
               case OP_LDD_IMM  :/*NZV*/ 
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDD_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDD_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDD_IND  :/*NZV*/
               case OP_LDD_DIR  :
@@ -2000,12 +2345,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDD_DIR_EXT_INX @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDD_DIR_EXT_INX @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_LDXY_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDX_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDX_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDXY_IND :/*NZV*/ 
               case OP_LDXY_DIR :
@@ -2015,7 +2360,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDX_DIR_EXT_INX @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDX_DIR_EXT_INX @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_STAA_IND : /*NZV*/
@@ -2028,7 +2373,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "STAA_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "STAA_DIR_EXT_INX\n");
                 break;
 
               case OP_STAB_IND :/*NZV*/ 
@@ -2041,7 +2386,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "STAB_DIR_EXT_INX\n");
+                log_msg(core, SYS_CORE, CORE_INST, "STAB_DIR_EXT_INX\n");
                 break;
 
               case OP_STD_IND  :/*NZV*/
@@ -2054,7 +2399,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STD DIR_EXT_IND @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STD DIR_EXT_IND @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               case OP_STXY_IND :/*NZV*/
@@ -2067,7 +2412,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STX DIR_EXT_IND @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STX DIR_EXT_IND @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               default:
@@ -2077,42 +2422,45 @@ void hc11_core_clock(struct hc11_core *core)
           break;
 
         case STATE_EXECUTE_18:
-          log_msg(SYS_CORE, CORE_INST, "STATE_EXECUTE_18 op %02X operand %04X\n", core->opcode, core->operand);
+          log_msg(core, SYS_CORE, CORE_INST, "STATE_EXECUTE_18 op %02X operand %04X\n", core->opcode, core->operand);
           core->prefix = 0; //prepare for next opcode
           core->state = STATE_FETCHOPCODE; //default action when nothing needs writing
-          core->istat_pg18[core->opcode] += 1;
+          if(core->istats)
+            {
+              core->istat_pg18[core->opcode] += 1;
+            }
           switch(core->opcode)
             {
               uint16_t tmp,tmp2,tmp3;
               case OP08_INXY_INH : /*Z*/
                 core->regs.y = core->regs.y + 1;
                 core->regs.flags.Z = (core->regs.y == 0);
-                log_msg(SYS_CORE, CORE_INST, "INY -> %04X\n", core->regs.y );
+                log_msg(core, SYS_CORE, CORE_INST, "INY -> %04X\n", core->regs.y );
                 break;
 
               case OP09_DEXY_INH : /*Z*/
                 core->regs.y = core->regs.y - 1;
                 core->regs.flags.Z = (core->regs.y == 0);
-                log_msg(SYS_CORE, CORE_INST, "DEY -> %04X\n", core->regs.y );
+                log_msg(core, SYS_CORE, CORE_INST, "DEY -> %04X\n", core->regs.y );
                 break;
 
               case OP_BSET_IND:
-                log_msg(SYS_CORE, CORE_INST, "BSET_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BSET_INY %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP_BCLR_IND:
-                log_msg(SYS_CORE, CORE_INST, "BCLR_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BCLR_INY %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP_BRSET_IND:
-                log_msg(SYS_CORE, CORE_INST, "BRSET_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BRSET_INY %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
               case OP_BRCLR_IND:
-                log_msg(SYS_CORE, CORE_INST, "BRCLR_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "BRCLR_INY %04X\n", core->operand);
                 core->state = STATE_RDMASK;
                 break;
 
@@ -2128,24 +2476,24 @@ void hc11_core_clock(struct hc11_core *core)
 
               case OP_TSXY_INH:
                 core->regs.y = core->regs.sp + 1;
-                log_msg(SYS_CORE, CORE_INST, "TSY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TSY\n");
                 break;
 
               case OP_TXYS_INH:
                 core->regs.sp = core->regs.y - 1;
-                log_msg(SYS_CORE, CORE_INST, "TYS\n");
+                log_msg(core, SYS_CORE, CORE_INST, "TYS\n");
                 break;
 
               case OP_PULXY_INH:
                 core->pulsel = PULL_Y;
                 core->state = STATE_PULL_H;
-                log_msg(SYS_CORE, CORE_INST, "PULY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PULY\n");
                 break;
 
               case OP_PSHXY_INH:
                 core->busdat = core->regs.y;
                 core->state = STATE_PUSH_L; // not H, push happens L first
-                log_msg(SYS_CORE, CORE_INST, "PSHY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "PSHY\n");
                 break;
 
               case OP_NEG_IND:
@@ -2157,7 +2505,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "NEG_INY -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "NEG_INY -> %02X\n", tmp);
                 break;
 
               case OP_COM_IND:
@@ -2169,7 +2517,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "COM_INY -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "COM_INY -> %02X\n", tmp);
                 break;
 
               case OP_LSR_IND:
@@ -2192,7 +2540,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "ASL_INY -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ASL_INY -> %02X\n", tmp);
                 break;
 
               case OP_ROR_IND:
@@ -2214,7 +2562,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "DEC_INY -> %02X @ %04X\n", tmp, core->busadr);
+                log_msg(core, SYS_CORE, CORE_INST, "DEC_INY -> %02X @ %04X\n", tmp, core->busadr);
                 break;
 
               case OP_INC_IND:
@@ -2227,7 +2575,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busdat = tmp;
                 core->busadr = core->operand;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "INC_INY -> %02X @ %04X\n", tmp, core->busadr);
+                log_msg(core, SYS_CORE, CORE_INST, "INC_INY -> %02X @ %04X\n", tmp, core->busadr);
                 break;
 
               case OP_TST_IND:
@@ -2236,7 +2584,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp==0);
                 core->regs.flags.V = 0;
                 core->regs.flags.C = 0;
-                log_msg(SYS_CORE, CORE_INST, "TST_INY -> %02X\n", tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "TST_INY -> %02X\n", tmp);
                 break;
 
               case OP_CLR_IND:
@@ -2247,20 +2595,20 @@ void hc11_core_clock(struct hc11_core *core)
                 core->busadr = core->operand;
                 core->busdat = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "CLR_INY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CLR_INY\n");
                 break;
 
               case OP_ABXY_INH:
                 core->regs.y = core->regs.y + (core->regs.d & 0xFF);
                 /* No flags changed */
-                log_msg(SYS_CORE, CORE_INST, "ABY_INH\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ABY_INH\n");
                 break;
 
               case OP_XGDXY_INH:
                 tmp = core->regs.d;
                 core->regs.d = core->regs.y;
                 core->regs.y = tmp;
-                log_msg(SYS_CORE, CORE_INST, "XGDY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "XGDY\n");
                 break;
 
               case OP_CMPA_IND:
@@ -2273,7 +2621,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(core->regs.d>>15) &&  (core->busdat>> 7)) || 
                                      ( (core->busdat>> 7) &&  (tmp         >> 7)) ||
                                      ( (tmp         >> 7) && !(core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "CMPA_INY A=%02X M=%02X R=%02X\n", core->regs.d>>8, core->busdat&0xFF, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CMPA_INY A=%02X M=%02X R=%02X\n", core->regs.d>>8, core->busdat&0xFF, tmp);
                 break;
 
               case OP_CMPB_IND:
@@ -2286,7 +2634,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!((core->regs.d&0xFF)>> 7) &&  (core->busdat>> 7)) || 
                                      ( (core->busdat>> 7) &&  (tmp         >> 7)) ||
                                      ( (tmp         >> 7) && !((core->regs.d&0xFF)>> 7));
-                log_msg(SYS_CORE, CORE_INST, "CMPB_INY B=%02X M=%02X R=%02X\n", core->regs.d&0xFF, core->busdat&0xFF, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CMPB_INY B=%02X M=%02X R=%02X\n", core->regs.d&0xFF, core->busdat&0xFF, tmp);
                 break;
 
               case OP_CPD_SUBD_IND:
@@ -2299,7 +2647,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "BITA_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "BITA_INY\n");
                 break;
 
               case OP_BITB_IND:
@@ -2307,7 +2655,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "BITB_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "BITB_INY\n");
                 break;
 
               case OP_ANDA_IND:
@@ -2316,7 +2664,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ANDA_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ANDA_INY\n");
                 break;
 
               case OP_ANDB_IND:
@@ -2325,7 +2673,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ANDB_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ANDB_INY\n");
                 break;
 
               case OP_ORAA_IND:
@@ -2334,7 +2682,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ORAA_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ORAA_INY\n");
                 break;
 
               case OP_ORAB_IND:
@@ -2343,7 +2691,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "ORAB_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "ORAB_INY\n");
                 break;
 
               case OP_EORA_IND:
@@ -2352,7 +2700,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "EORA_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "EORA_INY\n");
                 break;
 
               case OP_EORB_IND:
@@ -2361,7 +2709,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.V = 0;
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.Z = (tmp == 0);
-                log_msg(SYS_CORE, CORE_ERROR, "EORB_INY\n");
+                log_msg(core, SYS_CORE, CORE_ERROR, "EORB_INY\n");
                 break;
 
               case OP_ADDA_IND:
@@ -2371,15 +2719,15 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp3 << 8);
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADDA_INY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDA_INY\n");
                 break;
 
               case OP_ADDB_IND:
@@ -2389,15 +2737,15 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | (tmp3) & 0xFF;
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADDB_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADDB_IND_DIR_EXT\n");
                 break;
 
               case OP_ADDD_IND:
@@ -2409,7 +2757,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = ( (core->regs.d>>15) &&  (core->busdat>>15)) || 
                                      ( (core->busdat>>15) && !(tmp         >>15)) ||
                                      (!(tmp         >>15) &&  (core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "ADDD_INY D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "ADDD_INY D=%04X M=%04X R=%04X\n", core->regs.d, core->busdat, tmp);
                 core->regs.d = tmp;
                 break;
 
@@ -2420,15 +2768,15 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0x00FF) | (tmp3 << 8);
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADCA_INY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCA_INY\n");
                 break;
 
               case OP_ADCB_IND:
@@ -2438,15 +2786,15 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.d = (core->regs.d & 0xFF00) | (tmp3) & 0xFF;
                 core->regs.flags.N = (tmp3 >> 7);
                 core->regs.flags.Z = (tmp3 == 0);
-                core->regs.flags.H = ( ((tmp  >> 4)&0x01) &&  ((tmp2 >> 4)&0x01)) ||
-                                     ( ((tmp2 >> 4)&0x01) && !((tmp3 >> 4)&0x01)) ||
-                                     (!((tmp3 >> 4)&0x01) &&  ((tmp  >> 4)&0x01));
+                core->regs.flags.H = ( ((tmp  >> 3)&0x01) &&  ((tmp2 >> 3)&0x01)) ||
+                                     ( ((tmp2 >> 3)&0x01) && !((tmp3 >> 3)&0x01)) ||
+                                     (!((tmp3 >> 3)&0x01) &&  ((tmp  >> 3)&0x01));
                 core->regs.flags.V = ( (tmp >> 7) &&  (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp >> 7) && !(tmp2 >> 7) &&  (tmp3 >> 7));
                 core->regs.flags.C = ( (tmp  >> 7) &&  (tmp2 >> 7)) ||
                                      ( (tmp2 >> 7) && !(tmp3 >> 7)) ||
                                      (!(tmp3 >> 7) &&  (tmp  >> 7));
-                log_msg(SYS_CORE, CORE_INST, "ADCB_IND_DIR_EXT\n");
+                log_msg(core, SYS_CORE, CORE_INST, "ADCB_IND_DIR_EXT\n");
                 break;
 
               case OP_SUBA_IND:
@@ -2475,7 +2823,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 7);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDAA_INY %02X\n", core->busdat & 0xFF);
+                log_msg(core, SYS_CORE, CORE_INST, "LDAA_INY %02X\n", core->busdat & 0xFF);
                 break;
 
               case OP_LDAB_IND:
@@ -2484,7 +2832,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDAB_INY %02X\n", core->busdat & 0xFF);
+                log_msg(core, SYS_CORE, CORE_INST, "LDAB_INY %02X\n", core->busdat & 0xFF);
                 break;
 
               case OP_LDD_IND:
@@ -2493,12 +2841,12 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDD_INY @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDD_INY @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_LDXY_IMM : /*NZV*/
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "LDY_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "LDY_IMM\n");
                 /*FALLTHROUGH*/
               case OP_LDXY_IND : /*NZV, LDY IND,Y*/ 
               case OP_LDXY_DIR :
@@ -2508,7 +2856,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDY_DIR_EXT_INDY @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDY_DIR_EXT_INDY @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_LDS_IND:
@@ -2516,7 +2864,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (core->busdat >> 15);
                 core->regs.flags.Z = (core->busdat == 0);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDS_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "LDS_INY %04X\n", core->operand);
                 break;
 
               case OP_STAA_IND:
@@ -2527,7 +2875,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "STAA_INY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "STAA_INY\n");
                 break;
 
               case OP_STAB_IND:
@@ -2538,7 +2886,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 7;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_L;
-                log_msg(SYS_CORE, CORE_INST, "STAB_INY\n");
+                log_msg(core, SYS_CORE, CORE_INST, "STAB_INY\n");
                 break;
 
               case OP_STD_IND:
@@ -2549,7 +2897,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STD INY @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STD INY @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               case OP_STXY_DIR:
@@ -2562,7 +2910,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STY DIR_EXT_INY @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STY DIR_EXT_INY @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               case OP_STS_IND:
@@ -2573,7 +2921,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STS_INY %04X\n", core->operand);
+                log_msg(core, SYS_CORE, CORE_INST, "STS_INY %04X\n", core->operand);
                 break;
 
               case OP_CPXY_IMM: //prefix 18
@@ -2595,16 +2943,19 @@ void hc11_core_clock(struct hc11_core *core)
             break;
 
         case STATE_EXECUTE_1A:
-          log_msg(SYS_CORE, CORE_INST, "STATE_EXECUTE_1A op %02X operand %04X\n", core->opcode, core->operand);
+          log_msg(core, SYS_CORE, CORE_INST, "STATE_EXECUTE_1A op %02X operand %04X\n", core->opcode, core->operand);
           core->prefix = 0; //prepare for next opcode
           core->state = STATE_FETCHOPCODE; //default action when nothing needs writing
-          core->istat_pg1A[core->opcode] += 1;
+          if(core->istats)
+            {
+              core->istat_pg1A[core->opcode] += 1;
+            }
           switch(core->opcode)
             {
               uint16_t tmp;
               case OP_CPD_SUBD_IMM: //CPD, NZVC
                 core->busdat = core->operand;
-                log_msg(SYS_CORE, CORE_INST, "CPD_IMM\n");
+                log_msg(core, SYS_CORE, CORE_INST, "CPD_IMM\n");
                 /* FALLTHROUGH */
               case OP_CPD_SUBD_DIR: //CPD, NZVC
               case OP_CPD_SUBD_EXT:
@@ -2617,7 +2968,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.C = (!(core->regs.d>>15) &&  (core->busdat>>15)) || 
                                      ( (core->busdat>>15) &&  (tmp         >>15)) ||
                                      ( (tmp         >>15) && !(core->regs.d>>15));
-                log_msg(SYS_CORE, CORE_INST, "CPD_DIR_INDX D=%04X M=%04X diff=%04X\n",core->regs.d,core->busdat, tmp);
+                log_msg(core, SYS_CORE, CORE_INST, "CPD_DIR_INDX D=%04X M=%04X diff=%04X\n",core->regs.d,core->busdat, tmp);
                 break;
 
               case OP_LDXY_IND: /*NZV, LDY IND,X*/
@@ -2626,7 +2977,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = tmp == 0;
                 core->regs.flags.N = tmp >> 15;
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDY_DIR_EXT_INDX @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDY_DIR_EXT_INDX @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_STXY_IND: /*NZV, STY IND,X*/
@@ -2637,7 +2988,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STY DIR_EXT_INX @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STY DIR_EXT_INX @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               case OP_CPXY_IND: //prefix 1A
@@ -2652,10 +3003,13 @@ void hc11_core_clock(struct hc11_core *core)
             break;
 
         case STATE_EXECUTE_CD:
-          log_msg(SYS_CORE, CORE_INST, "STATE_EXECUTE_CD op %02X operand %04X\n", core->opcode, core->operand);
+          log_msg(core, SYS_CORE, CORE_INST, "STATE_EXECUTE_CD op %02X operand %04X\n", core->opcode, core->operand);
           core->prefix = 0; //prepare for next opcode
           core->state = STATE_FETCHOPCODE; //default action when nothing needs writing
-          core->istat_pgCD[core->opcode] += 1;
+          if(core->istats)
+            {
+              core->istat_pgCD[core->opcode] += 1;
+            }
           switch(core->opcode)
             {
               uint16_t tmp;
@@ -2665,7 +3019,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.Z = (tmp == 0);
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
-                log_msg(SYS_CORE, CORE_INST, "LDX_DIR_EXT_INY @%04X -> %04X\n", core->operand, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "LDX_DIR_EXT_INY @%04X -> %04X\n", core->operand, core->busdat);
                 break;
 
               case OP_STXY_IND: //STX IND,Y
@@ -2676,7 +3030,7 @@ void hc11_core_clock(struct hc11_core *core)
                 core->regs.flags.N = (tmp >> 15);
                 core->regs.flags.V = 0;
                 core->state = STATE_WRITEOP_H;
-                log_msg(SYS_CORE, CORE_INST, "STY DIR_EXT_INY @%04X <- %04X\n", core->busadr, core->busdat);
+                log_msg(core, SYS_CORE, CORE_INST, "STY DIR_EXT_INY @%04X <- %04X\n", core->busadr, core->busdat);
                 break;
 
               case OP_CPD_SUBD_IND: /*CPD*/
@@ -2738,19 +3092,61 @@ void hc11_core_clock(struct hc11_core *core)
               case PULL_A  : core->regs.d  = (core->regs.d & 0x00FF) | (core->busdat & 0xFF) << 8; break;
               case PULL_X  : core->regs.x  = core->busdat; break;
               case PULL_Y  : core->regs.y  = core->busdat; break;
-              case PULL_PC : core->regs.pc = core->busdat; break;
+              case PULL_PC : core->regs.pc = core->busdat;
+                             hc11_core_return(core); //RTS or end of RTI
+                             break;
             }
           core->state = STATE_FETCHOPCODE;
+          if(core->opcode == OP_RTI_INH && core->pulsel != PULL_PC)
+            {
+              //RTI unstacks everything: bytes for CCR,B,A then words for X,Y,PC
+              core->pulsel += 1;
+              core->state = (core->pulsel < PULL_X) ? STATE_PULL_L : STATE_PULL_H;
+            }
+          break;
+
+        case STATE_STACK: //one byte per clock: PC, Y, X (lo then hi), A, B, CCR
+          switch(core->stackcnt)
+            {
+              case 0: core->busdat = core->regs.pc & 0xFF; break;
+              case 1: core->busdat = core->regs.pc >> 8;   break;
+              case 2: core->busdat = core->regs.y & 0xFF;  break;
+              case 3: core->busdat = core->regs.y >> 8;    break;
+              case 4: core->busdat = core->regs.x & 0xFF;  break;
+              case 5: core->busdat = core->regs.x >> 8;    break;
+              case 6: core->busdat = core->regs.d >> 8;    break;
+              case 7: core->busdat = core->regs.d & 0xFF;  break;
+              case 8: core->busdat = core->regs.ccr;       break;
+            }
+          core->busadr = core->regs.sp;
+          hc11_core_writeb(core, core->busadr, core->busdat);
+          core->regs.sp = core->regs.sp - 1;
+          core->stackcnt += 1;
+          if(core->stackcnt == 9)
+            {
+              core->regs.flags.I = 1;
+              if(core->irqvec == VECTOR_XIRQ)
+                {
+                  core->regs.flags.X = 1;
+                }
+              core->busadr = core->irqvec;
+              core->state  = STATE_VECTORFETCH_H;
+              //SWI is called from its own address, an interrupt from the
+              //stacked return address
+              hc11_core_call(core, (core->irqvec == VECTOR_SWI) ? core->pc_opcode : core->regs.pc,
+                             hc11_core_debug_readb(core, core->irqvec) << 8 |
+                             hc11_core_debug_readb(core, core->irqvec + 1),
+                             core->regs.sp + 9, core->irqvec);
+            }
           break;
 
       }//switch
   }
 
 //run the clock until the current insn being fetched is executed
-void hc11_core_step(struct hc11_core *core)
+//reference engine: the clock state machine alone, up to the next instruction
+void hc11_core_step_clock(struct hc11_core *core)
   {
-    int i;
-
     do
       {
         hc11_core_clock(core);
@@ -2768,16 +3164,50 @@ void hc11_core_step(struct hc11_core *core)
           }
       }
     while(core->state != STATE_FETCHOPCODE);
+  }
 
+void hc11_core_step(struct hc11_core *core)
+  {
+    uint16_t pc     = core->regs.pc;
+    uint64_t clocks = core->clocks;
 
-    for(i=0;i<HC11_BKPT_NUM;i++)
+    if(core->history)
       {
-        if(core->break_pc[i] == core->regs.pc)
-          {
-            log_msg(SYS_CORE,CORE_DBG,"reached breakpoint %d\n",i);
-            core->status = STATUS_STOPPED;
-            return;
-          }        
+        hc11_history_step(core->history);
+      }
+    hc11_core_step_clock(core);
+    if(core->profile)
+      {
+        hc11_profile_step(core->profile, pc, core->clocks - clocks);
+      }
+    if(core->state != STATE_FETCHOPCODE)
+      {
+        return;
+      }
+
+    if(hc11_core_at_bkpt(core))
+      {
+        log_msg(core, SYS_CORE,CORE_DBG,"reached breakpoint at %04X\n",core->regs.pc);
+        core->status = STATUS_STOPPED;
+      }
+    else if(core->ranging &&
+            (core->regs.pc < core->range_start || core->regs.pc >= core->range_end))
+      {
+        log_msg(core, SYS_CORE,CORE_DBG,"left range at %04X\n",core->regs.pc);
+        core->ranging = false;
+        core->status  = STATUS_STOPPED;
+      }
+  }
+
+void hc11_core_istats_clear(struct hc11_core *core)
+  {
+    int i;
+    for(i=0;i<256;i++)
+      {
+        core->istat_main[i] = 0;
+        core->istat_pg18[i] = 0;
+        core->istat_pg1A[i] = 0;
+        core->istat_pgCD[i] = 0;
       }
   }
 
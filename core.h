@@ -2,8 +2,21 @@
 #define __core__h__
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 
 #define HC11_BKPT_NUM  8
+#define HC11_EVENT_NUM 8
+#define HC11_STATE_NUM 8
+#define HC11_CALL_NUM  64
+#define HC11_ECLOCK    2000000 //Hz, E clock of the usual 8 MHz crystal
+
+//write tracking granularity
+#define HC11_PAGE_SHIFT 8
+#define HC11_PAGE_SIZE  (1 << HC11_PAGE_SHIFT)
+#define HC11_PAGE_NUM   (0x10000 >> HC11_PAGE_SHIFT)
+
+#define HC11_EVENT_NONE UINT64_MAX
 
 enum hc11regs
   {
@@ -37,6 +50,20 @@ enum hc11vectors
     VECTOR_RESET   = 0xFFFE
   };
 
+//register numbers, same as gdb/m68hc11-tdep.c
+enum hc11_regnum
+  {
+    HC11_REG_X,
+    HC11_REG_D,
+    HC11_REG_Y,
+    HC11_REG_SP,
+    HC11_REG_PC,
+    HC11_REG_A,
+    HC11_REG_B,
+    HC11_REG_CCR,
+    HC11_REG_COUNT
+  };
+
 //for pulsel
 enum
   {
@@ -58,6 +85,11 @@ enum
 
 typedef uint8_t (*read_f )(void *ctx, uint16_t off);
 typedef void    (*write_f)(void *ctx, uint16_t off, uint8_t val);
+typedef void    (*event_f)(void *ctx);
+
+struct hc11_snapbuf;
+typedef void    (*snapsave_f)(void *ctx, struct hc11_snapbuf *buf);
+typedef int     (*snapload_f)(void *ctx, struct hc11_snapbuf *buf);
 
 struct hc11_mapping
   {
@@ -68,6 +100,10 @@ struct hc11_mapping
     void     *ctx;
     read_f   rdf;
     write_f  wrf;    
+    read_f   dbgrdf; //debugger access without side effects, optional
+    write_f  dbgwrf;
+    uint8_t  *mem;   //backing store of ram and rom mappings, else NULL
+    uint32_t maplen; //mem is mmap'd for maplen bytes, else malloc'd
   };
 
 struct hc11_regs
@@ -86,8 +122,8 @@ struct hc11_regs
             uint8_t V : 1;
             uint8_t Z : 1;
             uint8_t N : 1;
-            uint8_t H : 1;
             uint8_t I : 1;
+            uint8_t H : 1;
             uint8_t X : 1;
             uint8_t S : 1;
           } flags;
@@ -99,6 +135,40 @@ struct hc11_io
     void    *ctx;
     read_f  rdf;
     write_f wrf;
+    read_f  dbgrdf; //debugger access without side effects, optional
+    write_f dbgwrf;
+  };
+
+struct hc11_journal;
+struct hc11_history;
+struct hc11_profile;
+struct hc11_agent;
+struct hc11_image;
+
+//peripheral state saved in snapshots, see snapshot.h
+struct hc11_state
+  {
+    char       name[8];
+    void       *ctx;
+    snapsave_f save;
+    snapload_f load;
+  };
+
+//event scheduled in simulated time, fired by the core clock
+struct hc11_event
+  {
+    uint64_t when; //absolute clock count, HC11_EVENT_NONE if not scheduled
+    void     *ctx;
+    event_f  cb;
+  };
+
+//shadow call stack entry, see hc11_core_calls
+struct hc11_call
+  {
+    uint16_t from;   //JSR, BSR or SWI instruction, or interrupted pc
+    uint16_t to;     //called routine or interrupt handler
+    uint16_t sp;     //before the return address was pushed
+    uint16_t vector; //interrupt or SWI vector, 0 for JSR and BSR
   };
 
 struct hc11_core
@@ -111,8 +181,30 @@ struct hc11_core
     uint16_t             iobase;
     uint16_t             state; //core state machine
     uint64_t             clocks;
-    volatile uint16_t    status; //stopped, stepping, running...
+    uint16_t             status; //stopped, stepping, running... simulation thread only
     uint16_t             break_pc[HC11_BKPT_NUM];
+    struct hc11_agent   *break_cond[HC11_BKPT_NUM]; //conditions, NULL to always stop
+    bool                 ranging;     //stop when pc leaves [range_start, range_end)
+    uint16_t             range_start;
+    uint16_t             range_end;
+    struct hc11_call     calls[HC11_CALL_NUM]; //shadow call stack, outermost first
+    uint32_t             ncalls;      //depth, only the first HC11_CALL_NUM are kept
+    struct hc11_event    events[HC11_EVENT_NUM];
+    uint64_t             next_event; //earliest scheduled event
+    uint32_t             irq_pending; //one bit per vector, see hc11_core_irq
+    struct hc11_journal *journal;     //external input recorder, or NULL
+    struct hc11_history *history;     //undo log for reverse execution, or NULL
+    struct hc11_profile *profile;     //firmware profiler, or NULL
+    write_f              wrhook;      //sees every write, or NULL
+    void                *wrhook_ctx;
+    struct hc11_state    states[HC11_STATE_NUM];
+    //Dirty page tracking: each page remembers the memory epoch of its last
+    //write. Any number of users can take a checkpoint and later find the
+    //pages written since, without clearing anything for the others.
+    uint32_t             mem_epoch;
+    uint32_t             page_epoch[HC11_PAGE_NUM];
+    uint64_t             logmask; //enabled log messages, see log.h
+    FILE                *logfile;
     // internal regs for execution
     uint16_t             busadr;
     uint16_t             busdat;
@@ -121,9 +213,12 @@ struct hc11_core
     uint8_t              addmode;
     uint16_t             operand;
     uint8_t              op2,op3, pulsel;
+    uint8_t              stackcnt; //bytes pushed during interrupt stacking
+    uint16_t             irqvec;   //vector fetched after stacking
     uint16_t             pc_opcode;
 
-    //execution stats
+    //execution stats, counted while istats is set
+    bool     istats;
     uint64_t istat_main[256];
     uint64_t istat_pg18[256];
     uint64_t istat_pg1A[256];
@@ -132,28 +227,76 @@ struct hc11_core
   };
 
 void hc11_core_init(struct hc11_core *core);
-void hc11_core_map(struct hc11_core *core, const char *name, uint16_t start,
-                   uint16_t count, void *ctx, read_f rd, write_f wr);
-void hc11_core_map_ram(struct hc11_core *core, const char *name, uint16_t start,
+struct hc11_mapping *hc11_core_map(struct hc11_core *core, const char *name,
+                                   uint16_t start, uint16_t count,
+                                   void *ctx, read_f rd, write_f wr);
+int  hc11_core_map_ram(struct hc11_core *core, const char *name, uint16_t start,
                        uint16_t count);
-void hc11_core_map_rom(struct hc11_core *core, const char *name, uint16_t start,
+int  hc11_core_map_rom(struct hc11_core *core, const char *name, uint16_t start,
                        uint16_t count, uint8_t *rom);
+int  hc11_core_map_image(struct hc11_core *core, const char *name, uint16_t start,
+                         struct hc11_image *img, bool writable);
+void hc11_core_unmap_all(struct hc11_core *core);
+uint32_t hc11_core_mem_checkpoint(struct hc11_core *core);
+bool     hc11_core_page_dirty(struct hc11_core *core, uint16_t page, uint32_t since);
+void     hc11_core_mem_touch(struct hc11_core *core, uint16_t adr, uint32_t len);
 void hc11_core_iocallback(struct hc11_core *core, uint8_t off, uint8_t count,
                           void *ctx, read_f rd, write_f wr);
+//debugger variants of registers already set up with hc11_core_iocallback
+void hc11_core_iodebug(struct hc11_core *core, uint8_t off, uint8_t count,
+                       read_f rd, write_f wr);
+
+int  hc11_core_event_register(struct hc11_core *core, void *ctx, event_f cb);
+void hc11_core_event_schedule(struct hc11_core *core, int id, uint64_t delay);
+void hc11_core_event_cancel  (struct hc11_core *core, int id);
+uint64_t hc11_core_event_delay(struct hc11_core *core, int id);
+void hc11_core_irq(struct hc11_core *core, uint16_t vector, bool level);
+
+int hc11_core_get_reg(struct hc11_core *core, int reg, uint16_t *val);
+int hc11_core_set_reg(struct hc11_core *core, int reg, uint16_t val);
 
 int hc11_core_set_bkpt(struct hc11_core *core, uint16_t pc);
 int hc11_core_clr_bkpt(struct hc11_core *core, uint16_t pc);
+//set a breakpoint that stops only when one of the agent expressions in
+//cond is true, the core owns cond from now on. Replaces the conditions of an
+//existing breakpoint at pc, NULL makes it unconditional.
+int hc11_core_set_bkpt_cond(struct hc11_core *core, uint16_t pc, struct hc11_agent *cond);
+//pc is on a breakpoint whose condition holds
+bool hc11_core_at_bkpt(struct hc11_core *core);
+//range stepping: hc11_core_step stops the core once pc is outside
+//[start, end). An empty range turns it off.
+void hc11_core_set_range(struct hc11_core *core, uint16_t start, uint16_t end);
+//live frames of the shadow call stack, innermost first, returns the count
+//copied. Frames the firmware dropped by moving sp up are left out.
+int  hc11_core_calls(struct hc11_core *core, struct hc11_call *out, int max);
 
 
 uint8_t hc11_core_readb(struct hc11_core *core, uint16_t adr);
 void    hc11_core_writeb(struct hc11_core *core, uint16_t adr,
                          uint8_t val);
+//direct access to internal RAM and memory mappings, bypassing callbacks
+bool    hc11_core_peekb(struct hc11_core *core, uint16_t adr, uint8_t *val);
+bool    hc11_core_pokeb(struct hc11_core *core, uint16_t adr, uint8_t val);
+//bulk copies, RAM and ROM straight from their backing stores. write_block
+//also stores to ROM. Both fail if the block runs past 0xFFFF.
+int     hc11_core_read_block (struct hc11_core *core, uint16_t adr, uint8_t *buf, uint32_t len);
+int     hc11_core_write_block(struct hc11_core *core, uint16_t adr, const uint8_t *buf, uint32_t len);
+//debugger access: registers and callback mappings through their debug
+//callbacks when they have one, so looking at them does not change them
+uint8_t hc11_core_debug_readb (struct hc11_core *core, uint16_t adr);
+void    hc11_core_debug_writeb(struct hc11_core *core, uint16_t adr, uint8_t val);
+int     hc11_core_debug_read_block (struct hc11_core *core, uint16_t adr, uint8_t *buf, uint32_t len);
+int     hc11_core_debug_write_block(struct hc11_core *core, uint16_t adr, const uint8_t *buf, uint32_t len);
 
 void hc11_core_reset(struct hc11_core *core);
+void hc11_core_jump (struct hc11_core *core, uint16_t pc);
+void hc11_core_set_clocks(struct hc11_core *core, uint64_t clocks);
 void hc11_core_clock(struct hc11_core *core);
 void hc11_core_step (struct hc11_core *core);
+void hc11_core_step_clock(struct hc11_core *core);
 
 void hc11_core_istats(FILE *dest, struct hc11_core *core);
+void hc11_core_istats_clear(struct hc11_core *core);
 
 #endif /* __core__h__ */
 
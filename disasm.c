@@ -0,0 +1,447 @@
+/* HC11 disassembler */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "core.h"
+#include "disasm.h"
+
+//operand formats
+enum
+  {
+    ILL, //not an opcode
+    INH, //no operand
+    IM1, //#$12
+    IM2, //#$1234
+    DIR, //$12
+    EXT, //$1234
+    IDX, //$12,X or $12,Y
+    REL, //branch target
+    BTD, //BSET/BCLR direct: $12,#mask
+    BTX, //BSET/BCLR indexed: $12,X,#mask
+    BRD, //BRSET/BRCLR direct: $12,#mask,target
+    BRX, //BRSET/BRCLR indexed: $12,X,#mask,target
+  };
+
+struct disasm_op
+  {
+    const char *name;
+    uint8_t     mode;
+  };
+
+static const struct disasm_op ops[256] =
+  {
+    [0x00] = {"TEST",  INH},
+    [0x01] = {"NOP",   INH},
+    [0x02] = {"IDIV",  INH},
+    [0x03] = {"FDIV",  INH},
+    [0x04] = {"LSRD",  INH},
+    [0x05] = {"ASLD",  INH},
+    [0x06] = {"TAP",   INH},
+    [0x07] = {"TPA",   INH},
+    [0x08] = {"INX",   INH},
+    [0x09] = {"DEX",   INH},
+    [0x0A] = {"CLV",   INH},
+    [0x0B] = {"SEV",   INH},
+    [0x0C] = {"CLC",   INH},
+    [0x0D] = {"SEC",   INH},
+    [0x0E] = {"CLI",   INH},
+    [0x0F] = {"SEI",   INH},
+    [0x10] = {"SBA",   INH},
+    [0x11] = {"CBA",   INH},
+    [0x12] = {"BRSET", BRD},
+    [0x13] = {"BRCLR", BRD},
+    [0x14] = {"BSET",  BTD},
+    [0x15] = {"BCLR",  BTD},
+    [0x16] = {"TAB",   INH},
+    [0x17] = {"TBA",   INH},
+    [0x19] = {"DAA",   INH},
+    [0x1B] = {"ABA",   INH},
+    [0x1C] = {"BSET",  BTX},
+    [0x1D] = {"BCLR",  BTX},
+    [0x1E] = {"BRSET", BRX},
+    [0x1F] = {"BRCLR", BRX},
+    [0x20] = {"BRA",   REL},
+    [0x21] = {"BRN",   REL},
+    [0x22] = {"BHI",   REL},
+    [0x23] = {"BLS",   REL},
+    [0x24] = {"BCC",   REL},
+    [0x25] = {"BCS",   REL},
+    [0x26] = {"BNE",   REL},
+    [0x27] = {"BEQ",   REL},
+    [0x28] = {"BVC",   REL},
+    [0x29] = {"BVS",   REL},
+    [0x2A] = {"BPL",   REL},
+    [0x2B] = {"BMI",   REL},
+    [0x2C] = {"BGE",   REL},
+    [0x2D] = {"BLT",   REL},
+    [0x2E] = {"BGT",   REL},
+    [0x2F] = {"BLE",   REL},
+    [0x30] = {"TSX",   INH},
+    [0x31] = {"INS",   INH},
+    [0x32] = {"PULA",  INH},
+    [0x33] = {"PULB",  INH},
+    [0x34] = {"DES",   INH},
+    [0x35] = {"TXS",   INH},
+    [0x36] = {"PSHA",  INH},
+    [0x37] = {"PSHB",  INH},
+    [0x38] = {"PULX",  INH},
+    [0x39] = {"RTS",   INH},
+    [0x3A] = {"ABX",   INH},
+    [0x3B] = {"RTI",   INH},
+    [0x3C] = {"PSHX",  INH},
+    [0x3D] = {"MUL",   INH},
+    [0x3E] = {"WAI",   INH},
+    [0x3F] = {"SWI",   INH},
+    [0x40] = {"NEGA",  INH},
+    [0x43] = {"COMA",  INH},
+    [0x44] = {"LSRA",  INH},
+    [0x46] = {"RORA",  INH},
+    [0x47] = {"ASRA",  INH},
+    [0x48] = {"ASLA",  INH},
+    [0x49] = {"ROLA",  INH},
+    [0x4A] = {"DECA",  INH},
+    [0x4C] = {"INCA",  INH},
+    [0x4D] = {"TSTA",  INH},
+    [0x4F] = {"CLRA",  INH},
+    [0x50] = {"NEGB",  INH},
+    [0x53] = {"COMB",  INH},
+    [0x54] = {"LSRB",  INH},
+    [0x56] = {"RORB",  INH},
+    [0x57] = {"ASRB",  INH},
+    [0x58] = {"ASLB",  INH},
+    [0x59] = {"ROLB",  INH},
+    [0x5A] = {"DECB",  INH},
+    [0x5C] = {"INCB",  INH},
+    [0x5D] = {"TSTB",  INH},
+    [0x5F] = {"CLRB",  INH},
+    [0x60] = {"NEG",   IDX},
+    [0x63] = {"COM",   IDX},
+    [0x64] = {"LSR",   IDX},
+    [0x66] = {"ROR",   IDX},
+    [0x67] = {"ASR",   IDX},
+    [0x68] = {"ASL",   IDX},
+    [0x69] = {"ROL",   IDX},
+    [0x6A] = {"DEC",   IDX},
+    [0x6C] = {"INC",   IDX},
+    [0x6D] = {"TST",   IDX},
+    [0x6E] = {"JMP",   IDX},
+    [0x6F] = {"CLR",   IDX},
+    [0x70] = {"NEG",   EXT},
+    [0x73] = {"COM",   EXT},
+    [0x74] = {"LSR",   EXT},
+    [0x76] = {"ROR",   EXT},
+    [0x77] = {"ASR",   EXT},
+    [0x78] = {"ASL",   EXT},
+    [0x79] = {"ROL",   EXT},
+    [0x7A] = {"DEC",   EXT},
+    [0x7C] = {"INC",   EXT},
+    [0x7D] = {"TST",   EXT},
+    [0x7E] = {"JMP",   EXT},
+    [0x7F] = {"CLR",   EXT},
+    [0x80] = {"SUBA",  IM1},
+    [0x81] = {"CMPA",  IM1},
+    [0x82] = {"SBCA",  IM1},
+    [0x83] = {"SUBD",  IM2},
+    [0x84] = {"ANDA",  IM1},
+    [0x85] = {"BITA",  IM1},
+    [0x86] = {"LDAA",  IM1},
+    [0x88] = {"EORA",  IM1},
+    [0x89] = {"ADCA",  IM1},
+    [0x8A] = {"ORAA",  IM1},
+    [0x8B] = {"ADDA",  IM1},
+    [0x8C] = {"CPX",   IM2},
+    [0x8D] = {"BSR",   REL},
+    [0x8E] = {"LDS",   IM2},
+    [0x8F] = {"XGDX",  INH},
+    [0x90] = {"SUBA",  DIR},
+    [0x91] = {"CMPA",  DIR},
+    [0x92] = {"SBCA",  DIR},
+    [0x93] = {"SUBD",  DIR},
+    [0x94] = {"ANDA",  DIR},
+    [0x95] = {"BITA",  DIR},
+    [0x96] = {"LDAA",  DIR},
+    [0x97] = {"STAA",  DIR},
+    [0x98] = {"EORA",  DIR},
+    [0x99] = {"ADCA",  DIR},
+    [0x9A] = {"ORAA",  DIR},
+    [0x9B] = {"ADDA",  DIR},
+    [0x9C] = {"CPX",   DIR},
+    [0x9D] = {"JSR",   DIR},
+    [0x9E] = {"LDS",   DIR},
+    [0x9F] = {"STS",   DIR},
+    [0xA0] = {"SUBA",  IDX},
+    [0xA1] = {"CMPA",  IDX},
+    [0xA2] = {"SBCA",  IDX},
+    [0xA3] = {"SUBD",  IDX},
+    [0xA4] = {"ANDA",  IDX},
+    [0xA5] = {"BITA",  IDX},
+    [0xA6] = {"LDAA",  IDX},
+    [0xA7] = {"STAA",  IDX},
+    [0xA8] = {"EORA",  IDX},
+    [0xA9] = {"ADCA",  IDX},
+    [0xAA] = {"ORAA",  IDX},
+    [0xAB] = {"ADDA",  IDX},
+    [0xAC] = {"CPX",   IDX},
+    [0xAD] = {"JSR",   IDX},
+    [0xAE] = {"LDS",   IDX},
+    [0xAF] = {"STS",   IDX},
+    [0xB0] = {"SUBA",  EXT},
+    [0xB1] = {"CMPA",  EXT},
+    [0xB2] = {"SBCA",  EXT},
+    [0xB3] = {"SUBD",  EXT},
+    [0xB4] = {"ANDA",  EXT},
+    [0xB5] = {"BITA",  EXT},
+    [0xB6] = {"LDAA",  EXT},
+    [0xB7] = {"STAA",  EXT},
+    [0xB8] = {"EORA",  EXT},
+    [0xB9] = {"ADCA",  EXT},
+    [0xBA] = {"ORAA",  EXT},
+    [0xBB] = {"ADDA",  EXT},
+    [0xBC] = {"CPX",   EXT},
+    [0xBD] = {"JSR",   EXT},
+    [0xBE] = {"LDS",   EXT},
+    [0xBF] = {"STS",   EXT},
+    [0xC0] = {"SUBB",  IM1},
+    [0xC1] = {"CMPB",  IM1},
+    [0xC2] = {"SBCB",  IM1},
+    [0xC3] = {"ADDD",  IM2},
+    [0xC4] = {"ANDB",  IM1},
+    [0xC5] = {"BITB",  IM1},
+    [0xC6] = {"LDAB",  IM1},
+    [0xC8] = {"EORB",  IM1},
+    [0xC9] = {"ADCB",  IM1},
+    [0xCA] = {"ORAB",  IM1},
+    [0xCB] = {"ADDB",  IM1},
+    [0xCC] = {"LDD",   IM2},
+    [0xCE] = {"LDX",   IM2},
+    [0xCF] = {"STOP",  INH},
+    [0xD0] = {"SUBB",  DIR},
+    [0xD1] = {"CMPB",  DIR},
+    [0xD2] = {"SBCB",  DIR},
+    [0xD3] = {"ADDD",  DIR},
+    [0xD4] = {"ANDB",  DIR},
+    [0xD5] = {"BITB",  DIR},
+    [0xD6] = {"LDAB",  DIR},
+    [0xD7] = {"STAB",  DIR},
+    [0xD8] = {"EORB",  DIR},
+    [0xD9] = {"ADCB",  DIR},
+    [0xDA] = {"ORAB",  DIR},
+    [0xDB] = {"ADDB",  DIR},
+    [0xDC] = {"LDD",   DIR},
+    [0xDD] = {"STD",   DIR},
+    [0xDE] = {"LDX",   DIR},
+    [0xDF] = {"STX",   DIR},
+    [0xE0] = {"SUBB",  IDX},
+    [0xE1] = {"CMPB",  IDX},
+    [0xE2] = {"SBCB",  IDX},
+    [0xE3] = {"ADDD",  IDX},
+    [0xE4] = {"ANDB",  IDX},
+    [0xE5] = {"BITB",  IDX},
+    [0xE6] = {"LDAB",  IDX},
+    [0xE7] = {"STAB",  IDX},
+    [0xE8] = {"EORB",  IDX},
+    [0xE9] = {"ADCB",  IDX},
+    [0xEA] = {"ORAB",  IDX},
+    [0xEB] = {"ADDB",  IDX},
+    [0xEC] = {"LDD",   IDX},
+    [0xED] = {"STD",   IDX},
+    [0xEE] = {"LDX",   IDX},
+    [0xEF] = {"STX",   IDX},
+    [0xF0] = {"SUBB",  EXT},
+    [0xF1] = {"CMPB",  EXT},
+    [0xF2] = {"SBCB",  EXT},
+    [0xF3] = {"ADDD",  EXT},
+    [0xF4] = {"ANDB",  EXT},
+    [0xF5] = {"BITB",  EXT},
+    [0xF6] = {"LDAB",  EXT},
+    [0xF7] = {"STAB",  EXT},
+    [0xF8] = {"EORB",  EXT},
+    [0xF9] = {"ADCB",  EXT},
+    [0xFA] = {"ORAB",  EXT},
+    [0xFB] = {"ADDB",  EXT},
+    [0xFC] = {"LDD",   EXT},
+    [0xFD] = {"STD",   EXT},
+    [0xFE] = {"LDX",   EXT},
+    [0xFF] = {"STX",   EXT},
+  };
+
+static const struct disasm_op ops_18[256] =
+  {
+    [0x08] = {"INY",   INH},
+    [0x09] = {"DEY",   INH},
+    [0x1C] = {"BSET",  BTX},
+    [0x1D] = {"BCLR",  BTX},
+    [0x1E] = {"BRSET", BRX},
+    [0x1F] = {"BRCLR", BRX},
+    [0x30] = {"TSY",   INH},
+    [0x35] = {"TYS",   INH},
+    [0x38] = {"PULY",  INH},
+    [0x3A] = {"ABY",   INH},
+    [0x3C] = {"PSHY",  INH},
+    [0x60] = {"NEG",   IDX},
+    [0x63] = {"COM",   IDX},
+    [0x64] = {"LSR",   IDX},
+    [0x66] = {"ROR",   IDX},
+    [0x67] = {"ASR",   IDX},
+    [0x68] = {"ASL",   IDX},
+    [0x69] = {"ROL",   IDX},
+    [0x6A] = {"DEC",   IDX},
+    [0x6C] = {"INC",   IDX},
+    [0x6D] = {"TST",   IDX},
+    [0x6E] = {"JMP",   IDX},
+    [0x6F] = {"CLR",   IDX},
+    [0x8C] = {"CPY",   IM2},
+    [0x8F] = {"XGDY",  INH},
+    [0x9C] = {"CPY",   DIR},
+    [0xA0] = {"SUBA",  IDX},
+    [0xA1] = {"CMPA",  IDX},
+    [0xA2] = {"SBCA",  IDX},
+    [0xA3] = {"SUBD",  IDX},
+    [0xA4] = {"ANDA",  IDX},
+    [0xA5] = {"BITA",  IDX},
+    [0xA6] = {"LDAA",  IDX},
+    [0xA7] = {"STAA",  IDX},
+    [0xA8] = {"EORA",  IDX},
+    [0xA9] = {"ADCA",  IDX},
+    [0xAA] = {"ORAA",  IDX},
+    [0xAB] = {"ADDA",  IDX},
+    [0xAC] = {"CPY",   IDX},
+    [0xAD] = {"JSR",   IDX},
+    [0xAE] = {"LDS",   IDX},
+    [0xAF] = {"STS",   IDX},
+    [0xBC] = {"CPY",   EXT},
+    [0xCE] = {"LDY",   IM2},
+    [0xDE] = {"LDY",   DIR},
+    [0xDF] = {"STY",   DIR},
+    [0xE0] = {"SUBB",  IDX},
+    [0xE1] = {"CMPB",  IDX},
+    [0xE2] = {"SBCB",  IDX},
+    [0xE3] = {"ADDD",  IDX},
+    [0xE4] = {"ANDB",  IDX},
+    [0xE5] = {"BITB",  IDX},
+    [0xE6] = {"LDAB",  IDX},
+    [0xE7] = {"STAB",  IDX},
+    [0xE8] = {"EORB",  IDX},
+    [0xE9] = {"ADCB",  IDX},
+    [0xEA] = {"ORAB",  IDX},
+    [0xEB] = {"ADDB",  IDX},
+    [0xEC] = {"LDD",   IDX},
+    [0xED] = {"STD",   IDX},
+    [0xEE] = {"LDY",   IDX},
+    [0xEF] = {"STY",   IDX},
+    [0xFE] = {"LDY",   EXT},
+    [0xFF] = {"STY",   EXT},
+  };
+
+static const struct disasm_op ops_1A[256] =
+  {
+    [0x83] = {"CPD",   IM2},
+    [0x93] = {"CPD",   DIR},
+    [0xA3] = {"CPD",   IDX},
+    [0xAC] = {"CPY",   IDX},
+    [0xB3] = {"CPD",   EXT},
+    [0xEE] = {"LDY",   IDX},
+    [0xEF] = {"STY",   IDX},
+  };
+
+static const struct disasm_op ops_CD[256] =
+  {
+    [0xA3] = {"CPD",   IDX},
+    [0xAC] = {"CPX",   IDX},
+    [0xEE] = {"LDX",   IDX},
+    [0xEF] = {"STX",   IDX},
+  };
+
+//operand bytes after the opcode, for each format
+static const uint8_t operand_len[] =
+  {
+    [ILL] = 0, [INH] = 0, [IM1] = 1, [IM2] = 2, [DIR] = 1, [EXT] = 2, [IDX] = 1,
+    [REL] = 1, [BTD] = 2, [BTX] = 2, [BRD] = 3, [BRX] = 3,
+  };
+
+//table entry of the instruction, len is set to the prefix and opcode length
+static const struct disasm_op *disasm_lookup(const uint8_t *code, int *len, char *index)
+  {
+    *len   = 2;
+    *index = 'X';
+    switch(code[0])
+      {
+        case 0x18: *index = 'Y'; return &ops_18[code[1]];
+        case 0x1A:               return &ops_1A[code[1]];
+        case 0xCD: *index = 'Y'; return &ops_CD[code[1]];
+      }
+    *len = 1;
+    return &ops[code[0]];
+  }
+
+int hc11_disasm_len(const uint8_t *code)
+  {
+    const struct disasm_op *op;
+    char index;
+    int len;
+
+    op = disasm_lookup(code, &len, &index);
+    if(!op->name)
+      {
+        return 1;
+      }
+    return len + operand_len[op->mode];
+  }
+
+int hc11_disasm(const uint8_t *code, uint16_t adr, char *buf, size_t size)
+  {
+    const struct disasm_op *op;
+    const uint8_t *arg;
+    char index;
+    int len;
+
+    op = disasm_lookup(code, &len, &index);
+    if(!op->name)
+      {
+        snprintf(buf, size, "FCB   $%02X", code[0]);
+        return 1;
+      }
+    arg = &code[len];
+    len += operand_len[op->mode];
+    switch(op->mode)
+      {
+        case INH: snprintf(buf, size, "%s", op->name); break;
+        case IM1: snprintf(buf, size, "%-5s #$%02X", op->name, arg[0]); break;
+        case IM2: snprintf(buf, size, "%-5s #$%02X%02X", op->name, arg[0], arg[1]); break;
+        case DIR: snprintf(buf, size, "%-5s $%02X", op->name, arg[0]); break;
+        case EXT: snprintf(buf, size, "%-5s $%02X%02X", op->name, arg[0], arg[1]); break;
+        case IDX: snprintf(buf, size, "%-5s $%02X,%c", op->name, arg[0], index); break;
+        case REL:
+          snprintf(buf, size, "%-5s $%04X", op->name, (uint16_t)(adr + len + (int8_t)arg[0]));
+          break;
+        case BTD: snprintf(buf, size, "%-5s $%02X,#$%02X", op->name, arg[0], arg[1]); break;
+        case BTX: snprintf(buf, size, "%-5s $%02X,%c,#$%02X", op->name, arg[0], index, arg[1]); break;
+        case BRD:
+          snprintf(buf, size, "%-5s $%02X,#$%02X,$%04X", op->name, arg[0], arg[1],
+                   (uint16_t)(adr + len + (int8_t)arg[2]));
+          break;
+        case BRX:
+          snprintf(buf, size, "%-5s $%02X,%c,#$%02X,$%04X", op->name, arg[0], index, arg[1],
+                   (uint16_t)(adr + len + (int8_t)arg[2]));
+          break;
+      }
+    return len;
+  }
+
+int hc11_disasm_core(struct hc11_core *core, uint16_t adr, char *buf, size_t size)
+  {
+    uint8_t code[HC11_DISASM_MAX];
+    int i;
+
+    for(i=0;i<HC11_DISASM_MAX;i++)
+      {
+        if(!hc11_core_peekb(core, adr + i, &code[i]))
+          {
+            code[i] = 0xFF;
+          }
+      }
+    return hc11_disasm(code, adr, buf, size);
+  }
@@ -0,0 +1,21 @@
+#ifndef __disasm__h__
+#define __disasm__h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "core.h"
+
+#define HC11_DISASM_MAX 5 //longest instruction, in bytes
+
+//disassemble the instruction in code (HC11_DISASM_MAX bytes) located at adr,
+//returns its length
+int hc11_disasm(const uint8_t *code, uint16_t adr, char *buf, size_t size);
+
+//length only, code needs the prefix and opcode bytes
+int hc11_disasm_len(const uint8_t *code);
+
+//same as hc11_disasm, reading the code from memory without side effects
+int hc11_disasm_core(struct hc11_core *core, uint16_t adr, char *buf, size_t size);
+
+#endif /* __disasm__h__ */
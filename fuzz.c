@@ -0,0 +1,541 @@
+/* coverage-guided fuzzing of firmware SCI input, see help() */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+
+#include "core.h"
+#include "hc11sim.h"
+#include "snapshot.h"
+#include "disasm.h"
+
+#define FUZZ_MAP_SIZE 65536   //edge bitmap, same size as AFL's
+#define FUZZ_BUDGET   200000  //default clocks per input
+#define FUZZ_SETTLE   5000    //default clocks run once all the input is read
+#define FUZZ_POLL     256     //clocks between checks of the SCI input
+#define FUZZ_BOOT     1000000 //default clocks from reset to the post-boot state
+#define FUZZ_STACK    0x400   //default stack depth allowed below the post-boot SP
+#define FUZZ_INPUT    4096    //longest input, what the SCI host fifo holds
+
+//AFL forkserver descriptors
+#define FORKSRV_FD 198
+
+enum
+  {
+    FUZZ_OK,
+    FUZZ_ILLEGAL, //illegal opcode
+    FUZZ_SP,      //stack pointer out of its window
+    FUZZ_ROM,     //write to a rom mapping
+  };
+
+struct fuzz
+  {
+    struct hc11_sim      *sim;
+    struct hc11_core     *core;
+    struct hc11_baseline *base;
+    uint8_t              *cov;
+    bool                  rom[0x10000];
+    uint16_t              stacklo;
+    uint16_t              stackhi;
+    uint64_t              budget;
+    uint64_t              settle;
+    //last run
+    int                   crash;
+    uint16_t              crashpc;
+    uint16_t              crashadr;
+  };
+
+static struct fuzz fz;
+
+#ifdef HC11_LIBFUZZER
+//picked up by libFuzzer as additional coverage counters
+__attribute__((section("__libfuzzer_extra_counters"), used))
+static uint8_t fuzz_counters[FUZZ_MAP_SIZE];
+#else
+static uint8_t fuzz_counters[FUZZ_MAP_SIZE];
+#endif
+
+void help(void)
+  {
+    printf("hc11fuzz [options] [input]...\n"
+           "\n"
+           "  -b <adr,file>    Map a ROM image at address, can be repeated\n"
+           "  -m <adr,hex>     Map a ROM holding the given bytes, can be repeated\n"
+           "  -l <file>        Post-boot state from a snapshot instead of booting\n"
+           "  -p <pc>          Boot from pc instead of the reset vector\n"
+           "  -B <clocks>      Clocks to boot before taking the post-boot state, default %d\n"
+           "  -c <clocks>      Clocks run for each input at most, default %d\n"
+           "  -i <clocks>      Clocks run once the firmware has read all the input, default %d\n"
+           "  -s <lo,hi>       Stack pointer window, default %d bytes below the post-boot SP\n"
+           "  -n <count>       Run count random inputs and report throughput\n"
+           "  -q               Only report crashes\n"
+           "\n"
+           "RAM is mapped at 0000-7FFF. Each input is fed to the SCI receiver of the\n"
+           "post-boot machine, which then runs for the clock budget. Crashes are\n"
+           "illegal opcodes, stack pointer escapes and writes to ROM; they are reported\n"
+           "with the input and the exit code is 1.\n"
+           "Under afl-fuzz (use @@ or stdin), coverage goes to the AFL shared bitmap\n"
+           "and a forkserver is started. Built with 'make hc11fuzz-libfuzzer', the same\n"
+           "options are given on the libFuzzer command line.\n",
+           FUZZ_BOOT, FUZZ_BUDGET, FUZZ_SETTLE, FUZZ_STACK);
+  }
+
+//AFL style edge index, from and to are scrambled so that nearby addresses spread
+static inline uint32_t fuzz_loc(uint16_t pc)
+  {
+    return (pc * 40503u) & (FUZZ_MAP_SIZE - 1);
+  }
+
+static void fuzz_write_hook(void *ctx, uint16_t adr, uint8_t val)
+  {
+    struct fuzz *f = ctx;
+    if(f->rom[adr] && f->crash == FUZZ_OK)
+      {
+        f->crash    = FUZZ_ROM;
+        f->crashpc  = f->core->pc_opcode;
+        f->crashadr = adr;
+      }
+  }
+
+//run one input from the post-boot state, returns the crash kind
+static int fuzz_run(const uint8_t *data, size_t len)
+  {
+    struct hc11_core *core = fz.core;
+    uint8_t code[2];
+    uint16_t from;
+    uint16_t to;
+    uint64_t end;
+    uint64_t poll;
+
+    hc11_baseline_restore(fz.base);
+    if(len > FUZZ_INPUT)
+      {
+        len = FUZZ_INPUT;
+      }
+    hc11_sim_sci_input(fz.sim, data, len);
+    fz.crash = FUZZ_OK;
+    end  = core->clocks + fz.budget;
+    poll = core->clocks + FUZZ_POLL;
+    core->status = STATUS_RUNNING;
+    while(core->clocks < end && fz.crash == FUZZ_OK)
+      {
+        //the firmware is left to settle after reading the last byte
+        if(core->clocks >= poll)
+          {
+            poll = core->clocks + FUZZ_POLL;
+            if(end > core->clocks + fz.settle && hc11_sim_sci_idle(fz.sim))
+              {
+                end = core->clocks + fz.settle;
+              }
+          }
+        from = core->regs.pc;
+        hc11_core_step(core);
+        if(core->regs.sp < fz.stacklo || core->regs.sp > fz.stackhi)
+          {
+            fz.crash   = FUZZ_SP;
+            fz.crashpc = core->pc_opcode;
+          }
+        if(core->status != STATUS_RUNNING)
+          {
+            if(core->status == STATUS_STOPPED && core->busadr == VECTOR_ILLEGAL)
+              {
+                fz.crash   = FUZZ_ILLEGAL;
+                fz.crashpc = core->regs.pc;
+              }
+            break;
+          }
+
+        //only taken branches, jumps, calls, returns and interrupts are edges
+        to = core->regs.pc;
+        if((uint16_t)(to - from) <= HC11_DISASM_MAX &&
+           hc11_core_peekb(core, from, &code[0]) &&
+           hc11_core_peekb(core, from + 1, &code[1]) &&
+           hc11_disasm_len(code) == (uint16_t)(to - from))
+          {
+            continue;
+          }
+        fz.cov[(fuzz_loc(from) >> 1) ^ fuzz_loc(to)]++;
+      }
+    return fz.crash;
+  }
+
+static void fuzz_report(const char *name, const uint8_t *data, size_t len)
+  {
+    size_t i;
+
+    switch(fz.crash)
+      {
+        case FUZZ_ILLEGAL:
+          printf("crash: illegal opcode at pc=0x%04X", fz.crashpc);
+          break;
+        case FUZZ_SP:
+          printf("crash: SP=0x%04X out of %04X-%04X after pc=0x%04X",
+                 fz.core->regs.sp, fz.stacklo, fz.stackhi, fz.crashpc);
+          break;
+        case FUZZ_ROM:
+          printf("crash: write to ROM at 0x%04X from pc=0x%04X", fz.crashadr, fz.crashpc);
+          break;
+      }
+    printf(" (%s, clock %"PRIu64")\ninput %zu bytes:", name, fz.core->clocks, len);
+    for(i=0;i<len;i++)
+      {
+        printf(" %02X", data[i]);
+      }
+    printf("\n");
+    fflush(stdout);
+  }
+
+static uint8_t *fuzz_read(FILE *f, size_t *len)
+  {
+    static uint8_t buf[FUZZ_INPUT];
+    *len = fread(buf, 1, sizeof(buf), f);
+    return buf;
+  }
+
+//-b adr,file or -m adr,hex
+static int fuzz_rom(char *arg, bool hex)
+  {
+    char *ptr = strchr(arg, ',');
+    uint8_t data[256];
+    unsigned byte;
+    uint16_t adr;
+    int len;
+
+    if(!ptr)
+      {
+        printf(hex ? "-m adr,hex\n" : "-b adr,file\n");
+        return -1;
+      }
+    *ptr++ = 0;
+    adr = strtoul(arg, NULL, 16);
+    if(!hex)
+      {
+        return hc11_sim_load_bin(fz.sim, adr, ptr);
+      }
+    for(len = 0; len < sizeof(data) && sscanf(ptr, "%2x", &byte) == 1; len++, ptr += 2)
+      {
+        data[len] = byte;
+      }
+    if(len == 0)
+      {
+        printf("-m %04X: no data\n", adr);
+        return -1;
+      }
+    return hc11_sim_map_rom(fz.sim, adr, data, len);
+  }
+
+//Options are taken out of argv, what is left is given back: inputs, or the
+//libFuzzer options. Returns the random run count, or -1 on error.
+static long fuzz_setup(int *argc, char **argv, bool *quiet)
+  {
+    struct hc11_mapping *map;
+    char *snap = NULL;
+    bool jump = false;
+    uint16_t pc = 0;
+    uint64_t boot = FUZZ_BOOT;
+    long lo = -1;
+    long hi = -1;
+    long count = 0;
+    int ret;
+    int out = 1;
+    int i;
+
+    fz.sim = hc11_sim_create();
+    if(!fz.sim)
+      {
+        return -1;
+      }
+    fz.core   = hc11_sim_core(fz.sim);
+    fz.budget = FUZZ_BUDGET;
+    fz.settle = FUZZ_SETTLE;
+    fz.cov    = fuzz_counters;
+    if(hc11_sim_map_ram(fz.sim, 0x0000, 0x8000) < 0)
+      {
+        return -1;
+      }
+
+    for(i=1;i<*argc;i++)
+      {
+        char *opt = argv[i];
+        char *val = (i + 1 < *argc) ? argv[i + 1] : NULL;
+
+        if(opt[0] != '-' || strlen(opt) != 2 || !strchr("bmlpBcisnq", opt[1]))
+          {
+            argv[out++] = opt;
+            continue;
+          }
+        if(opt[1] == 'q')
+          {
+            *quiet = true;
+            continue;
+          }
+        if(!val)
+          {
+            help();
+            return -1;
+          }
+        i++;
+        switch(opt[1])
+          {
+            case 'b':
+            case 'm':
+              if(fuzz_rom(val, opt[1] == 'm') < 0)
+                {
+                  return -1;
+                }
+              break;
+            case 'l': snap  = val; break;
+            case 'p': pc    = strtoul(val, NULL, 16); jump = true; break;
+            case 'B': boot  = strtoull(val, NULL, 0); break;
+            case 'c': fz.budget = strtoull(val, NULL, 0); break;
+            case 'i': fz.settle = strtoull(val, NULL, 0); break;
+            case 'n': count = strtol(val, NULL, 0); break;
+            case 's':
+              lo = strtol(val, &val, 16);
+              hi = (*val == ',') ? strtol(val + 1, NULL, 16) : -1;
+              break;
+          }
+      }
+    *argc = out;
+    argv[out] = NULL;
+
+    if(hc11_sim_sci(fz.sim, "file:,", true) < 0)
+      {
+        printf("cannot start SCI\n");
+        return -1;
+      }
+    for(map = fz.core->maps; map; map = map->next)
+      {
+        if(map->mem && !map->wrf)
+          {
+            memset(fz.rom + map->start, true, map->len);
+          }
+      }
+
+    //post-boot state
+    if(snap)
+      {
+        if(hc11_snapshot_read(fz.core, snap) < 0)
+          {
+            printf("cannot load snapshot %s\n", snap);
+            return -1;
+          }
+      }
+    else
+      {
+        if(jump)
+          {
+            hc11_sim_start(fz.sim, pc);
+          }
+        else
+          {
+            hc11_sim_reset(fz.sim);
+          }
+        ret = hc11_sim_run(fz.sim, boot);
+        if(ret != HC11_SIM_BUDGET)
+          {
+            printf("firmware did not boot: %s at pc=0x%04X\n",
+                   (ret == HC11_SIM_ILLEGAL) ? "illegal opcode" : "stopped",
+                   fz.core->regs.pc);
+            return -1;
+          }
+      }
+    if(hi < 0)
+      {
+        hi = fz.core->regs.sp;
+      }
+    if(lo < 0)
+      {
+        lo = (hi > FUZZ_STACK) ? hi - FUZZ_STACK : 0;
+      }
+    fz.stacklo = lo;
+    fz.stackhi = hi;
+
+    fz.base = hc11_baseline_capture(fz.core);
+    if(!fz.base)
+      {
+        return -1;
+      }
+    fz.core->wrhook     = fuzz_write_hook;
+    fz.core->wrhook_ctx = &fz;
+    return count;
+  }
+
+#ifdef HC11_LIBFUZZER
+
+static bool fuzz_quiet;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+  {
+    if(fuzz_setup(argc, *argv, &fuzz_quiet) < 0)
+      {
+        exit(2);
+      }
+    return 0;
+  }
+
+//crashes abort, libFuzzer then saves the input
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t len)
+  {
+    if(fuzz_run(data, len) != FUZZ_OK)
+      {
+        fuzz_report("libfuzzer", data, len);
+        abort();
+      }
+    return 0;
+  }
+
+#else
+
+//Under afl-fuzz, fork a child from the post-boot state for each input.
+//Returns in the child, or when not started by afl-fuzz.
+static void fuzz_forkserver(void)
+  {
+    uint32_t tmp = 0;
+    int status;
+    pid_t pid;
+
+    if(write(FORKSRV_FD + 1, &tmp, 4) != 4)
+      {
+        return;
+      }
+    while(1)
+      {
+        if(read(FORKSRV_FD, &tmp, 4) != 4)
+          {
+            exit(0);
+          }
+        pid = fork();
+        if(pid < 0)
+          {
+            exit(1);
+          }
+        if(pid == 0)
+          {
+            close(FORKSRV_FD);
+            close(FORKSRV_FD + 1);
+            return;
+          }
+        if(write(FORKSRV_FD + 1, &pid, 4) != 4 || waitpid(pid, &status, 0) < 0 ||
+           write(FORKSRV_FD + 1, &status, 4) != 4)
+          {
+            exit(1);
+          }
+      }
+  }
+
+//random inputs, to measure throughput and check the setup
+static int fuzz_random(long count, bool quiet)
+  {
+    uint8_t buf[64];
+    size_t len;
+    struct timespec t0, t1;
+    double secs;
+    long crashes = 0;
+    long edges = 0;
+    long n;
+    size_t i;
+
+    srand(1);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(n=0;n<count;n++)
+      {
+        len = 1 + rand() % sizeof(buf);
+        for(i=0;i<len;i++)
+          {
+            buf[i] = rand();
+          }
+        if(fuzz_run(buf, len) != FUZZ_OK)
+          {
+            crashes++;
+            fuzz_report("random", buf, len);
+          }
+      }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    for(i=0;i<FUZZ_MAP_SIZE;i++)
+      {
+        edges += fz.cov[i] != 0;
+      }
+    if(!quiet)
+      {
+        printf("%ld inputs in %.3fs, %.0f execs/s, %ld edges, %ld crashes\n",
+               count, secs, count / secs, edges, crashes);
+      }
+    return crashes ? 1 : 0;
+  }
+
+int main(int argc, char **argv)
+  {
+    const char *shm;
+    uint8_t *data;
+    size_t len;
+    FILE *f;
+    bool quiet = false;
+    bool afl;
+    long count;
+    int failed = 0;
+    int i;
+
+    count = fuzz_setup(&argc, argv, &quiet);
+    if(count < 0)
+      {
+        return 2;
+      }
+    if(count > 0)
+      {
+        return fuzz_random(count, quiet);
+      }
+
+    shm = getenv("__AFL_SHM_ID");
+    afl = shm != NULL;
+    if(afl)
+      {
+        fz.cov = shmat(atoi(shm), NULL, 0);
+        if(fz.cov == (void*)-1)
+          {
+            perror("shmat");
+            return 2;
+          }
+        fuzz_forkserver();
+      }
+
+    for(i=1;i<argc || (i == 1 && argc == 1);i++)
+      {
+        const char *name = (argc == 1) ? "stdin" : argv[i];
+        f = (argc == 1) ? stdin : fopen(name, "rb");
+        if(!f)
+          {
+            perror(name);
+            return 2;
+          }
+        data = fuzz_read(f, &len);
+        if(f != stdin)
+          {
+            fclose(f);
+          }
+        if(fuzz_run(data, len) != FUZZ_OK)
+          {
+            failed++;
+            fuzz_report(name, data, len);
+            if(afl)
+              {
+                abort(); //afl-fuzz keeps the input
+              }
+          }
+        else if(!quiet)
+          {
+            printf("%s: ok\n", name);
+          }
+      }
+    return failed ? 1 : 0;
+  }
+
+#endif
@@ -6,12 +6,25 @@
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
-#include <signal.h>
 #include <errno.h>
+#include <ctype.h>
+#include <poll.h>
+#include <time.h>
+#include <inttypes.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "gdbremote.h"
+#include "log.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "history.h"
+#include "agent.h"
+#include "profile.h"
 
 #define STATE_WAIT_START 1
 #define STATE_WAIT_CSUM  2
@@ -20,95 +33,678 @@
 #define STATE_CSUM_2     5
 
 
-int gdbremote_putc(const char ch, int client)
+static const char hexdigits[16] = "0123456789abcdef";
+
+//value of each hex digit, -1 for other chars. Shared by every server of
+//the process, filled once.
+static int8_t hexvalues[256];
+static pthread_once_t hex_once = PTHREAD_ONCE_INIT;
+
+static void hex_init(void)
   {
-  int ret = send(client, &ch, 1, 0);
-  fputc(ch, stdout);
-  return ret;
+    int i;
+    memset(hexvalues, -1, sizeof(hexvalues));
+    for(i=0;i<16;i++)
+      {
+        hexvalues[(uint8_t)hexdigits[i]] = i;
+        hexvalues[toupper(hexdigits[i])] = i;
+      }
   }
 
-static int gdbremote_tx(struct gdbremote_t *gr, bool req_ack)
+//crc32 as computed by gdb for qCRC: polynomial 04C11DB7, msb first, no
+//final inversion. The table is shared by every server, filled once.
+static uint32_t crctable[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
   {
-    uint8_t csum;
-    char ack, tx, rx;
-    int ret;
-    char sum[3];
-    int index;
-    int len;
-    printf("<<<");
+    uint32_t crc;
+    int i, j;
+    for(i=0;i<256;i++)
+      {
+        crc = (uint32_t)i << 24;
+        for(j=0;j<8;j++)
+          {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+          }
+        crctable[i] = crc;
+      }
+  }
 
-    len = gr->txlen;
-    index = 0;
-    csum = 0;
-    gdbremote_putc('$', gr->client);
-    while(len > 0)
+static uint32_t crc_update(uint32_t crc, const uint8_t *buf, uint32_t len)
+  {
+    while(len--)
       {
-        tx = gr->txbuf[index];
-        if(tx == '#' || tx == '%' || tx == '}' || tx == '*')
+        crc = (crc << 8) ^ crctable[((crc >> 24) ^ *buf++) & 0xFF];
+      }
+    return crc;
+  }
+
+static void hex_encode(char *dst, const uint8_t *src, int len)
+  {
+    uint8_t val;
+    int i;
+    for(i=0;i<len;i++)
+      {
+        val = src[i]; //dst may overlap src
+        dst[2*i  ] = hexdigits[val >> 4];
+        dst[2*i+1] = hexdigits[val & 0x0F];
+      }
+  }
+
+//returns -1 if src holds a non hex char
+static int hex_decode(uint8_t *dst, const char *src, int len)
+  {
+    int hi, lo;
+    int i;
+    for(i=0;i<len;i++)
+      {
+        hi = hexvalues[(uint8_t)src[2*i  ]];
+        lo = hexvalues[(uint8_t)src[2*i+1]];
+        if(hi < 0 || lo < 0)
           {
-            csum += '}';
-            gdbremote_putc('}', gr->client);
-            tx ^= 0x20;
+            return -1;
           }
-        csum = csum + (uint8_t)tx;
-        gdbremote_putc(tx, gr->client);
-        index++;
-        len--;
+        dst[i] = (hi << 4) | lo;
       }
-    gdbremote_putc('#', gr->client);
-    sprintf(sum, "%02x", csum&0xFF);
-    gdbremote_putc(sum[0], gr->client);
-    gdbremote_putc(sum[1], gr->client);
-    printf("\n");
+    return 0;
+  }
 
-    if(req_ack)
+static int gdbremote_send(int client, const char *buf, int len)
+  {
+    int ret;
+    while(len > 0)
       {
-        ret = recv(gr->client, &rx, 1, 0);
-        if(ret < 0) return -1;
-        if(ret == 0) return -1;
-        if(rx != '+')
+        ret = send(client, buf, len, MSG_NOSIGNAL);
+        if(ret < 0 && errno == EINTR)
+          {
+            continue;
+          }
+        if(ret <= 0)
           {
-            printf("no ack received (got %02X, '%c')\n", rx, rx);
+            return -1;
           }
+        buf += ret;
+        len -= ret;
       }
     return 0;
   }
 
+//frame the packet and send it in one go
+static int gdbremote_tx(struct gdbremote_t *gr, const char *buf, int len)
+  {
+    uint8_t csum = 0;
+    char tx;
+    int ret = -1;
+    int i;
+    int n = 0;
+
+    pthread_mutex_lock(&gr->txlock);
+    gr->frame[n++] = '$';
+    for(i=0;i<len;i++)
+      {
+        tx = buf[i];
+        if(tx == '#' || tx == '$' || tx == '}' || tx == '*')
+          {
+            csum += '}';
+            gr->frame[n++] = '}';
+            tx ^= 0x20;
+          }
+        csum += (uint8_t)tx;
+        gr->frame[n++] = tx;
+      }
+    gr->frame[n++] = '#';
+    gr->frame[n++] = hexdigits[csum >> 4];
+    gr->frame[n++] = hexdigits[csum & 0x0F];
+    gr->framelen = n;
+    log_msg(gr->core, SYS_GDB, GDB_PACKET, "<<< %.*s\n", n, gr->frame);
+    if(gr->client >= 0)
+      {
+        ret = gdbremote_send(gr->client, gr->frame, n);
+      }
+    pthread_mutex_unlock(&gr->txlock);
+    //the ack, if any, is seen by the gdb thread
+    return ret;
+  }
+
+//gdb thread: ack a packet, or send the last frame again after a nack
+static void gdbremote_ack(struct gdbremote_t *gr, char ack)
+  {
+    pthread_mutex_lock(&gr->txlock);
+    if(gr->client >= 0)
+      {
+        gdbremote_send(gr->client, &ack, 1);
+      }
+    pthread_mutex_unlock(&gr->txlock);
+  }
+
+static void gdbremote_retransmit(struct gdbremote_t *gr)
+  {
+    pthread_mutex_lock(&gr->txlock);
+    if(gr->client >= 0 && gr->framelen)
+      {
+        log_msg(gr->core, SYS_GDB, GDB_PACKET, "nack, sending again\n");
+        gdbremote_send(gr->client, gr->frame, gr->framelen);
+      }
+    pthread_mutex_unlock(&gr->txlock);
+  }
+
 int gdbremote_txraw(struct gdbremote_t *gr)
   {
-    return gdbremote_tx(gr, true);
+    return gdbremote_tx(gr, gr->txbuf, gr->txlen);
   }
 
 int gdbremote_txstr(struct gdbremote_t *gr, const char *fmt, ...)
   {
     va_list ap;
     va_start(ap, fmt);
-    gr->txlen = vsprintf(gr->txbuf, fmt, ap);
+    gr->txlen = vsnprintf(gr->txbuf, sizeof(gr->txbuf), fmt, ap);
     va_end(ap);
-    return gdbremote_tx(gr, true);
+    return gdbremote_tx(gr, gr->txbuf, gr->txlen);
   }
 
-int gdbremote_txnotif(struct gdbremote_t *gr, const char *fmt, ...)
+static uint64_t gdbremote_micros(void)
   {
-    va_list ap;
-    va_start(ap, fmt);
-    gr->txlen = vsprintf(gr->txbuf, fmt, ap);
-    va_end(ap);
-    return gdbremote_tx(gr, false);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+//text with \r \n \t \\ and \xHH escapes, decoded in place, returns the length
+static int gdbremote_unescape(char *str)
+  {
+    char *in = str, *out = str;
+    while(*in)
+      {
+        if(*in != '\\' || !in[1])
+          {
+            *out++ = *in++;
+            continue;
+          }
+        in++;
+        switch(*in)
+          {
+          case 'r': *out++ = '\r'; in++; break;
+          case 'n': *out++ = '\n'; in++; break;
+          case 't': *out++ = '\t'; in++; break;
+          case 'x':
+            if(hexvalues[(uint8_t)in[1]] >= 0 && hexvalues[(uint8_t)in[2]] >= 0)
+              {
+                *out++ = hexvalues[(uint8_t)in[1]] << 4 | hexvalues[(uint8_t)in[2]];
+                in += 3;
+                break;
+              }
+            /* FALLTHROUGH */
+          default:  *out++ = *in++; break;
+          }
+      }
+    return out - str;
   }
 
 void gdbremote_monitor(struct gdbremote_t *gr)
   {
     if(!strncmp("help", gr->rxbuf, strlen("help")))
       {
-        gr->txlen = sprintf(gr->txbuf, "reset - restart cpu\n");
+        gr->txlen = sprintf(gr->txbuf, "reset - restart cpu\n"
+                                       "irq|xirq <0|1> - set external interrupt line level\n"
+                                       "sci [turbo|accurate] - show or set SCI timing\n"
+                                       "sci send <text> - receive chars on the SCI, \\r \\n \\xHH escapes\n"
+                                       "mode [accurate|fast|realtime] - show or set the run mode\n"
+                                       "speed - host simulation speed since the last call\n"
+                                       "profile start|stop|clear - count executed opcodes and clocks per pc\n"
+                                       "profile [file] - show the opcode counts, or write them to file\n"
+                                       "profile callgrind <file> - write the pc profile for KCachegrind\n"
+                                       "profile symbols <file> - name functions from address name lines\n"
+                                       "log [<name> on|off] - show or set log messages, name is all,\n"
+                                       "    a system (core, sci, gdb) or system.subsystem (core.inst)\n"
+                                       "snapshot save|load <file> - save or restore the machine state\n"
+                                       "baseline [restore] - capture the machine state in memory, or go back to it\n"
+                                       "bt - call chain from the shadow call stack\n");
+      }
+    else if(!strcmp("bt", gr->rxbuf))
+      {
+        struct hc11_call calls[HC11_CALL_NUM];
+        int i, n;
+        n = hc11_core_calls(gr->core, calls, HC11_CALL_NUM);
+        gr->txlen = sprintf(gr->txbuf, "#0  %04X\n", gr->core->regs.pc);
+        for(i=0;i<n;i++)
+          {
+            if(calls[i].vector)
+              {
+                gr->txlen += sprintf(gr->txbuf + gr->txlen, "#%-2d %04X  %s %04X  (vector %04X, sp %04X)\n", i+1,
+                                     calls[i].from, (calls[i].vector == VECTOR_SWI) ? "swi" : "irq",
+                                     calls[i].to, calls[i].vector, calls[i].sp);
+              }
+            else
+              {
+                gr->txlen += sprintf(gr->txbuf + gr->txlen, "#%-2d %04X  call %04X  (sp %04X)\n", i+1,
+                                     calls[i].from, calls[i].to, calls[i].sp);
+              }
+          }
+        if(gr->core->ncalls > HC11_CALL_NUM)
+          {
+            gr->txlen += sprintf(gr->txbuf + gr->txlen, "... %u older frames not recorded\n",
+                                 gr->core->ncalls - HC11_CALL_NUM);
+          }
+      }
+    else if(!strcmp("speed", gr->rxbuf))
+      {
+        uint64_t now    = gdbremote_micros();
+        uint64_t clocks = gr->core->clocks - gr->speedclocks;
+        double   secs   = (now - gr->speedmicros) / 1e6;
+        double   mhz    = (secs > 0) ? clocks / secs / 1e6 : 0;
+        gr->txlen = sprintf(gr->txbuf, "%.3f MHz over %.1f s, %.2fx real time at %.1f MHz E clock\n"
+                                       "%"PRIu64" clocks since reset\n",
+                                       mhz, secs, mhz * 1e6 / HC11_ECLOCK, HC11_ECLOCK / 1e6,
+                                       gr->core->clocks);
+        gr->speedclocks = gr->core->clocks;
+        gr->speedmicros = now;
+      }
+    else if(!strncmp("profile", gr->rxbuf, strlen("profile")))
+      {
+        char *arg = gr->rxbuf + strlen("profile");
+        FILE *f;
+        while(*arg == ' ') arg++;
+        if(!strcmp(arg, "start"))
+          {
+            gr->core->istats = true;
+            if(!gr->profile)
+              {
+                gr->profile = hc11_profile_create(gr->core);
+              }
+            else
+              {
+                hc11_profile_attach(gr->profile, true);
+              }
+            gr->txlen = sprintf(gr->txbuf, "profiling\n");
+          }
+        else if(!strcmp(arg, "stop"))
+          {
+            gr->core->istats = false;
+            if(gr->profile)
+              {
+                hc11_profile_attach(gr->profile, false);
+              }
+            gr->txlen = sprintf(gr->txbuf, "profiling stopped\n");
+          }
+        else if(!strcmp(arg, "clear"))
+          {
+            hc11_core_istats_clear(gr->core);
+            if(gr->profile)
+              {
+                hc11_profile_clear(gr->profile);
+              }
+            gr->txlen = sprintf(gr->txbuf, "profile cleared\n");
+          }
+        else if(!strncmp(arg, "callgrind ", 10) || !strncmp(arg, "symbols ", 8))
+          {
+            char *fname = strchr(arg, ' ') + 1;
+            int ret;
+            if(!gr->profile)
+              {
+                gr->txlen = sprintf(gr->txbuf, "no pc profile, use profile start\n");
+                return;
+              }
+            ret = (arg[0] == 'c') ? hc11_profile_callgrind(gr->profile, fname) :
+                                    hc11_profile_symbols(gr->profile, fname);
+            gr->txlen = sprintf(gr->txbuf, "%s %s %s\n", (arg[0] == 'c') ? "profile" : "symbols", fname,
+                                (ret < 0) ? "failed" : (arg[0] == 'c') ? "written" : "loaded");
+          }
+        else if(*arg)
+          {
+            f = fopen(arg, "w");
+            if(!f)
+              {
+                gr->txlen = sprintf(gr->txbuf, "cannot write %s\n", arg);
+                return;
+              }
+            hc11_core_istats(f, gr->core);
+            fclose(f);
+            gr->txlen = sprintf(gr->txbuf, "profile written to %s\n", arg);
+          }
+        else
+          {
+            //reply is hex encoded in place, half the buffer is usable
+            f = fmemopen(gr->txbuf, GDBREMOTE_MAX_TX / 2, "w");
+            if(!f)
+              {
+                return;
+              }
+            hc11_core_istats(f, gr->core);
+            gr->txlen = ftell(f);
+            fclose(f);
+            if(gr->txlen == 0)
+              {
+                //an empty reply means an unknown command to gdb
+                gr->txlen = sprintf(gr->txbuf, "no opcodes counted\n");
+              }
+          }
+      }
+    else if(!strncmp("log", gr->rxbuf, strlen("log")))
+      {
+        char name[32], onoff[4];
+        int sys, sub;
+        if(sscanf(gr->rxbuf + strlen("log"), "%31s %3s", name, onoff) == 2)
+          {
+            if(log_lookup(name, &sys, &sub) < 0 || (strcmp(onoff, "on") && strcmp(onoff, "off")))
+              {
+                gr->txlen = sprintf(gr->txbuf, "usage: log [<name> on|off]\n");
+                return;
+              }
+            if(!strcmp(onoff, "on"))
+              {
+                log_enable(gr->core, sys, sub);
+              }
+            else
+              {
+                log_disable(gr->core, sys, sub);
+              }
+          }
+        else if(gr->rxbuf[strlen("log")])
+          {
+            gr->txlen = sprintf(gr->txbuf, "usage: log [<name> on|off]\n");
+            return;
+          }
+        gr->txlen = sprintf(gr->txbuf, "log: ");
+        gr->txlen += log_list(gr->core, gr->txbuf + gr->txlen, GDBREMOTE_MAX_TX / 2 - gr->txlen - 8);
+        gr->txlen += sprintf(gr->txbuf + gr->txlen, "%s\n", gr->core->logmask ? "" : "none");
+      }
+    else if(!strncmp("mode", gr->rxbuf, strlen("mode")))
+      {
+        char *arg = gr->rxbuf + strlen("mode");
+        while(*arg == ' ') arg++;
+        if(*arg && strcmp(arg, "accurate") && strcmp(arg, "fast") && strcmp(arg, "realtime"))
+          {
+            gr->txlen = sprintf(gr->txbuf, "usage: mode [accurate|fast|realtime]\n");
+            return;
+          }
+        if(*arg && gr->sci && hc11_journal_replaying(gr->core))
+          {
+            gr->txlen = sprintf(gr->txbuf, "not available while replaying a journal\n");
+            return;
+          }
+        if(*arg)
+          {
+            gr->realtime = !strcmp(arg, "realtime");
+            if(gr->sci)
+              {
+                hc11_sci_set_turbo(gr->sci, !strcmp(arg, "fast"));
+              }
+          }
+        gr->txlen = sprintf(gr->txbuf, "run mode: %s\n", gr->realtime ? "realtime" :
+                            (gr->sci && hc11_sci_get_turbo(gr->sci)) ? "fast" : "accurate");
+      }
+    else if(hc11_journal_replaying(gr->core) && strncmp("sci", gr->rxbuf, strlen("sci")))
+      {
+        gr->txlen = sprintf(gr->txbuf, "not available while replaying a journal\n");
       }
     else if(!strncmp("reset", gr->rxbuf, strlen("reset")))
       {
+        hc11_journal_debug(gr->core, JRN_RESET, 0, 0);
         hc11_core_reset(gr->core);
         hc11_core_step (gr->core);
         gr->txlen = sprintf(gr->txbuf, "target was reset\n");
       }
+    else if(!strncmp("irq", gr->rxbuf, strlen("irq")) || !strncmp("xirq", gr->rxbuf, strlen("xirq")))
+      {
+        uint16_t vector = (gr->rxbuf[0] == 'x') ? VECTOR_XIRQ : VECTOR_IRQ;
+        char *arg = strchr(gr->rxbuf, ' ');
+        int level;
+        if(!arg || sscanf(arg, "%d", &level) != 1)
+          {
+            gr->txlen = sprintf(gr->txbuf, "usage: irq|xirq <0|1>\n");
+            return;
+          }
+        hc11_journal_debug(gr->core, JRN_IRQ, vector, level != 0);
+        hc11_core_irq(gr->core, vector, level != 0);
+        gr->txlen = sprintf(gr->txbuf, "%s line %s\n", (vector == VECTOR_XIRQ) ? "XIRQ" : "IRQ", level ? "asserted" : "released");
+      }
+    else if(!strncmp("snapshot ", gr->rxbuf, strlen("snapshot ")))
+      {
+        char *arg = gr->rxbuf + strlen("snapshot ");
+        char *fname = strchr(arg, ' ');
+        int ret;
+        if(!fname || (strncmp(arg, "save ", 5) && strncmp(arg, "load ", 5)))
+          {
+            gr->txlen = sprintf(gr->txbuf, "usage: snapshot save|load <file>\n");
+            return;
+          }
+        fname++;
+        //commands run between instructions, a running core can be saved
+        if(arg[0] == 's')
+          {
+            ret = hc11_snapshot_write(gr->core, fname);
+          }
+        else if(gr->core->status == STATUS_RUNNING)
+          {
+            gr->txlen = sprintf(gr->txbuf, "stop the target first\n");
+            return;
+          }
+        else if(gr->core->journal)
+          {
+            gr->txlen = sprintf(gr->txbuf, "not available while recording a journal\n");
+            return;
+          }
+        else
+          {
+            ret = hc11_snapshot_read(gr->core, fname);
+          }
+        gr->txlen = sprintf(gr->txbuf, "snapshot %s %s\n", fname, (ret < 0) ? "failed" : (arg[0] == 's') ? "saved" : "loaded");
+      }
+    else if(!strncmp("baseline", gr->rxbuf, strlen("baseline")))
+      {
+        if(strstr(gr->rxbuf, "restore"))
+          {
+            if(gr->core->status == STATUS_RUNNING)
+              {
+                gr->txlen = sprintf(gr->txbuf, "stop the target first\n");
+              }
+            else if(!gr->baseline)
+              {
+                gr->txlen = sprintf(gr->txbuf, "no baseline\n");
+              }
+            else if(gr->core->journal)
+              {
+                gr->txlen = sprintf(gr->txbuf, "not available while recording a journal\n");
+              }
+            else
+              {
+                hc11_baseline_restore(gr->baseline);
+                gr->txlen = sprintf(gr->txbuf, "baseline restored\n");
+              }
+          }
+        else
+          {
+            if(gr->baseline)
+              {
+                hc11_baseline_free(gr->baseline);
+              }
+            gr->baseline = hc11_baseline_capture(gr->core);
+            gr->txlen = sprintf(gr->txbuf, gr->baseline ? "baseline captured\n" : "baseline failed\n");
+          }
+      }
+    else if(!strncmp("sci", gr->rxbuf, strlen("sci")))
+      {
+        char *arg = gr->rxbuf + strlen("sci");
+        while(*arg == ' ') arg++;
+        if(gr->sci == NULL)
+          {
+            gr->txlen = sprintf(gr->txbuf, "no SCI\n");
+            return;
+          }
+        if(*arg && hc11_journal_replaying(gr->core))
+          {
+            gr->txlen = sprintf(gr->txbuf, "not available while replaying a journal\n");
+            return;
+          }
+        if(!strncmp(arg, "send ", 5))
+          {
+            int len = gdbremote_unescape(arg + 5);
+            int sent = hc11_sci_inject(gr->sci, (uint8_t*)arg + 5, len);
+            gr->txlen = sprintf(gr->txbuf, "%d of %d chars queued\n", sent, len);
+            return;
+          }
+        if(!strcmp(arg, "turbo"))
+          {
+            hc11_sci_set_turbo(gr->sci, true);
+          }
+        else if(!strcmp(arg, "accurate"))
+          {
+            hc11_sci_set_turbo(gr->sci, false);
+          }
+        else if(*arg)
+          {
+            gr->txlen = sprintf(gr->txbuf, "usage: sci [turbo|accurate]\n");
+            return;
+          }
+        gr->txlen = sprintf(gr->txbuf, "SCI timing: %s\n", hc11_sci_get_turbo(gr->sci) ? "turbo" : "accurate");
+      }
+  }
+
+static const char target_xml[] =
+  "<?xml version=\"1.0\"?>\n"
+  "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+  "<target version=\"1.0\">\n"
+  "  <architecture>m68hc11</architecture>\n"
+  "  <feature name=\"org.gnu.gdb.m68hc11.cpu\">\n"
+  "    <reg name=\"x\"   bitsize=\"16\" type=\"uint16\" regnum=\"0\"/>\n"
+  "    <reg name=\"d\"   bitsize=\"16\" type=\"uint16\"/>\n"
+  "    <reg name=\"y\"   bitsize=\"16\" type=\"uint16\"/>\n"
+  "    <reg name=\"sp\"  bitsize=\"16\" type=\"data_ptr\"/>\n"
+  "    <reg name=\"pc\"  bitsize=\"16\" type=\"code_ptr\"/>\n"
+  "    <reg name=\"a\"   bitsize=\"8\"  type=\"uint8\"/>\n"
+  "    <reg name=\"b\"   bitsize=\"8\"  type=\"uint8\"/>\n"
+  "    <reg name=\"ccr\" bitsize=\"8\"  type=\"uint8\"/>\n"
+  "  </feature>\n"
+  "</target>\n";
+
+enum
+  {
+    MEMTYPE_NONE,
+    MEMTYPE_ROM,
+    MEMTYPE_RAM, //also the register block
+  };
+
+//what the cpu finds at adr, with the same priorities as hc11_core_readb
+static int gdbremote_memtype(struct hc11_core *core, uint32_t adr)
+  {
+    struct hc11_mapping *cur;
+
+    if(adr >= core->iobase && adr < core->iobase + 0x40)
+      {
+        return MEMTYPE_RAM;
+      }
+    if(adr >= core->rambase && adr < core->rambase + 256)
+      {
+        return MEMTYPE_RAM;
+      }
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(adr >= cur->start && adr < cur->start + cur->len)
+          {
+            return cur->wrf ? MEMTYPE_RAM : MEMTYPE_ROM;
+          }
+      }
+    return MEMTYPE_NONE;
+  }
+
+//memory map of the live mappings, runs of the same type become one region
+static int gdbremote_memory_map(struct gdbremote_t *gr, char *buf, int size)
+  {
+    static const char *names[] = { NULL, "rom", "ram" };
+    uint32_t adr, start = 0;
+    int type, prev = MEMTYPE_NONE;
+    int len;
+
+    len = snprintf(buf, size, "<?xml version=\"1.0\"?>\n"
+                              "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" "
+                              "\"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+                              "<memory-map>\n");
+    for(adr = 0; adr <= 0x10000; adr++)
+      {
+        type = (adr < 0x10000) ? gdbremote_memtype(gr->core, adr) : MEMTYPE_NONE;
+        if(type == prev)
+          {
+            continue;
+          }
+        if(prev != MEMTYPE_NONE && len < size)
+          {
+            len += snprintf(buf + len, size - len, "  <memory type=\"%s\" start=\"0x%04x\" length=\"0x%x\"/>\n",
+                            names[prev], start, adr - start);
+          }
+        start = adr;
+        prev  = type;
+      }
+    if(len < size)
+      {
+        len += snprintf(buf + len, size - len, "</memory-map>\n");
+      }
+    return (len < size) ? len : -1;
+  }
+
+//qXfer:object:read:annex:offset,length, a window of the object
+static void gdbremote_xfer(struct gdbremote_t *gr)
+  {
+    char *obj = gr->rxbuf + strlen("qXfer:");
+    char map[4096];
+    const char *data;
+    unsigned int off, len;
+    int total;
+    char *annex;
+
+    annex = strstr(obj, ":read:");
+    if(!annex)
+      {
+        gdbremote_txstr(gr, "");
+        return;
+      }
+    annex += strlen(":read:");
+    if(!strncmp(obj, "features:", strlen("features:")) &&
+       !strncmp(annex, "target.xml:", strlen("target.xml:")))
+      {
+        data  = target_xml;
+        total = strlen(target_xml);
+        annex += strlen("target.xml:");
+      }
+    else if(!strncmp(obj, "memory-map:", strlen("memory-map:")) && annex[0] == ':')
+      {
+        total = gdbremote_memory_map(gr, map, sizeof(map));
+        if(total < 0)
+          {
+            gdbremote_txstr(gr, "E02");
+            return;
+          }
+        data  = map;
+        annex += 1;
+      }
+    else
+      {
+        gdbremote_txstr(gr, "E00");
+        return;
+      }
+    if(sscanf(annex, "%X,%X", &off, &len) != 2)
+      {
+        gdbremote_txstr(gr, "E01");
+        return;
+      }
+    if(off >= (unsigned int)total)
+      {
+        gdbremote_txstr(gr, "l");
+        return;
+      }
+    if(len > GDBREMOTE_MAX_TX - 1)
+      {
+        len = GDBREMOTE_MAX_TX - 1;
+      }
+    if(len > total - off)
+      {
+        len = total - off;
+      }
+    //m: more to come, l: last part
+    gr->txbuf[0] = (off + len < (unsigned int)total) ? 'm' : 'l';
+    memcpy(gr->txbuf + 1, data + off, len);
+    gr->txlen = len + 1;
+    gdbremote_txraw(gr);
   }
 
 void gdbremote_query(struct gdbremote_t *gr)
@@ -116,9 +712,15 @@ void gdbremote_query(struct gdbremote_t *gr)
     if(!strncmp("qSupported", gr->rxbuf, strlen("qSupported")))
       {
         //gdb request supported features at boot
-        gdbremote_txstr(gr, "PacketSize=%x", GDBREMOTE_MAX_RX);
+        gdbremote_txstr(gr, "PacketSize=%x;QStartNoAckMode+;binary-upload+;ConditionalBreakpoints+;"
+                        "qXfer:memory-map:read+;qXfer:features:read+%s", GDBREMOTE_MAX_RX,
+                        gr->core->history ? ";ReverseStep+;ReverseContinue+" : "");
         //gdbremote_tx(gr, io, "");
       }
+    else if(!strncmp("qXfer:", gr->rxbuf, strlen("qXfer:")))
+      {
+        gdbremote_xfer(gr);
+      }
     else if(!strncmp("qfThreadInfo", gr->rxbuf, strlen("qfThreadInfo")))
       {
         gdbremote_txstr(gr, "m0");
@@ -133,15 +735,15 @@ void gdbremote_query(struct gdbremote_t *gr)
       }
     else if(!strncmp("qRcmd,", gr->rxbuf, strlen("qRcmd,")))
       {
-        int i,buf;
-        //convert hex to chars
-        for(i=0;i<(gr->rxlen-6)/2;i++)
+        int len = (gr->rxlen - 6) / 2;
+        //command is hex encoded
+        if(hex_decode((uint8_t*)gr->rxbuf, gr->rxbuf + 6, len) < 0)
           {
-            sscanf(gr->rxbuf + 6 + (2 * i), "%02x", &buf);
-            gr->rxbuf[i] = buf & 0xFF;
+            gdbremote_txstr(gr, "E01");
+            return;
           }
-        gr->rxbuf[i] = 0;
-        printf("monitor: %s\n", gr->rxbuf);
+        gr->rxbuf[len] = 0;
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "monitor: %s\n", gr->rxbuf);
         gr->txlen = 0;
         gdbremote_monitor(gr);
         if(gr->txlen == 0)
@@ -150,42 +752,207 @@ void gdbremote_query(struct gdbremote_t *gr)
           }
         else
           {
-            char buf[3];
-            //convert response to hex
-            if(gr->txlen > (GDBREMOTE_MAX_TX/2) - 4)
+            //response is hex encoded too, in place from the end
+            int i;
+            if(gr->txlen > GDBREMOTE_MAX_TX/2)
               {
-                gr->txlen = GDBREMOTE_MAX_TX/2 - 4;
+                gr->txlen = GDBREMOTE_MAX_TX/2;
               }
             for(i=gr->txlen-1; i>=0; i--)
               {
-                sprintf(buf, "%02X", gr->txbuf[i]);
-                gr->txbuf[2*i  ] = buf[0];
-                gr->txbuf[2*i+1] = buf[1];
+                hex_encode(gr->txbuf + 2*i, (uint8_t*)gr->txbuf + i, 1);
               }
             gr->txlen *= 2;
             gdbremote_txraw(gr);
           }
       }
+    else if(!strncmp("qCRC:", gr->rxbuf, strlen("qCRC:")))
+      {
+        //qCRC:adr,len, reply Cxxxxxxxx
+        unsigned int adr, len, run;
+        uint8_t buf[4096];
+        uint32_t crc = 0xFFFFFFFF;
+        if(sscanf(gr->rxbuf + 5, "%X,%X", &adr, &len) != 2 ||
+           adr > 0xFFFF || len > 0x10000 - adr)
+          {
+            gdbremote_txstr(gr, "E01");
+            return;
+          }
+        while(len)
+          {
+            run = (len > sizeof(buf)) ? sizeof(buf) : len;
+            hc11_core_debug_read_block(gr->core, adr, buf, run);
+            crc = crc_update(crc, buf, run);
+            adr += run;
+            len -= run;
+          }
+        gdbremote_txstr(gr, "C%08x", crc);
+      }
+    else if(!strncmp("qSearch:memory:", gr->rxbuf, strlen("qSearch:memory:")))
+      {
+        //qSearch:memory:adr;len;pattern, reply 0 or 1,adr
+        unsigned int adr, len;
+        int n, plen;
+        uint8_t *mem, *found;
+        if(sscanf(gr->rxbuf + 15, "%X;%X;%n", &adr, &len, &n) != 2 || adr > 0xFFFF)
+          {
+            gdbremote_txstr(gr, "E01");
+            return;
+          }
+        if(len > 0x10000 - adr)
+          {
+            len = 0x10000 - adr;
+          }
+        //the pattern is binary, its length comes from the packet
+        plen = gr->rxlen - 15 - n;
+        mem  = malloc(len ? len : 1);
+        if(!mem)
+          {
+            gdbremote_txstr(gr, "E02");
+            return;
+          }
+        hc11_core_debug_read_block(gr->core, adr, mem, len);
+        found = memmem(mem, len, gr->rxbuf + 15 + n, plen);
+        if(found)
+          {
+            gdbremote_txstr(gr, "1,%x", adr + (unsigned int)(found - mem));
+          }
+        else
+          {
+            gdbremote_txstr(gr, "0");
+          }
+        free(mem);
+      }
     else if(!strncmp("qC", gr->rxbuf, strlen("qC")))
       {
         gdbremote_txstr(gr, "0");
       }
     else
       {
-        printf("Unsupported GDB query\n");
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "Unsupported GDB query\n");
         gdbremote_txstr(gr, "");
       }
 
   }
 
+//bs and bc: go back in the execution history, the core is stopped
+static void gdbremote_reverse(struct gdbremote_t *gr, bool cont)
+  {
+    struct hc11_core *core = gr->core;
+
+    if(!core->history || core->journal)
+      {
+        gdbremote_txstr(gr, "E01");
+        return;
+      }
+    do
+      {
+        if(hc11_history_back(core->history) < 0)
+          {
+            gdbremote_txstr(gr, "T%02Xreplaylog:begin;", GDBREMOTE_STOP_NORMAL);
+            return;
+          }
+        if(cont && hc11_core_at_bkpt(core))
+          {
+            cont = false;
+          }
+      }
+    while(cont);
+    gdbremote_txstr(gr, "S%02X", GDBREMOTE_STOP_NORMAL);
+  }
+
+//breakpoint conditions after a Z packet, as a list of agent expressions.
+//Breakpoint commands (;cmds:) are not supported and not advertised.
+static int gdbremote_conditions(struct gdbremote_t *gr, struct hc11_agent **list)
+  {
+    struct hc11_agent *ax, **tail = list;
+    uint8_t code[AGENT_MAX_CODE];
+    unsigned int len;
+    char *ptr = strchr(gr->rxbuf, ';');
+    int n;
+
+    while(ptr && ptr[1] == 'X')
+      {
+        if(sscanf(ptr + 2, "%X,%n", &len, &n) != 1 || len > AGENT_MAX_CODE ||
+           strlen(ptr + 2 + n) < 2*len ||
+           hex_decode(code, ptr + 2 + n, len) < 0)
+          {
+            goto fail;
+          }
+        ax = hc11_agent_create(code, len);
+        if(!ax)
+          {
+            log_msg(gr->core, SYS_GDB, GDB_CMD, "unsupported agent expression\n");
+            goto fail;
+          }
+        *tail = ax;
+        tail  = &ax->next;
+        ptr = strchr(ptr + 2 + n + 2*len, ';');
+      }
+    return 0;
+
+fail:
+    hc11_agent_free(*list);
+    *list = NULL;
+    return -1;
+  }
+
+//resume with vCont. There is a single thread, the first action applies.
+//Signals of C and S are ignored.
+static void gdbremote_vcont(struct gdbremote_t *gr)
+  {
+    unsigned int start, end;
+    char *action = gr->rxbuf + strlen("vCont");
+
+    if(*action == '?')
+      {
+        gdbremote_txstr(gr, "vCont;c;C;s;S;r");
+        return;
+      }
+    if(*action++ != ';')
+      {
+        gdbremote_txstr(gr, "E01");
+        return;
+      }
+    switch(*action)
+      {
+      case 'c': case 'C':
+        hc11_core_set_range(gr->core, 0, 0);
+        gr->core->status = STATUS_RUNNING;
+        gr->lastcommand  = 'c';
+        break;
+      case 's': case 'S':
+        hc11_core_set_range(gr->core, 0, 0);
+        gr->core->status = STATUS_STEPPING;
+        gr->lastcommand  = 's';
+        break;
+      case 'r':
+        //step at least once, then keep going while pc is in [start, end)
+        if(sscanf(action + 1, "%X,%X", &start, &end) != 2)
+          {
+            gdbremote_txstr(gr, "E01");
+            return;
+          }
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "range step %04X-%04X\n", start, end);
+        hc11_core_set_range(gr->core, start, end);
+        gr->core->status = (start < end) ? STATUS_RUNNING : STATUS_STEPPING;
+        gr->lastcommand  = 'c';
+        break;
+      default:
+        gdbremote_txstr(gr, "E01");
+        return;
+      }
+    //the stop reply comes when the core stops
+  }
+
 void gdbremote_command(struct gdbremote_t *gr)
   {
-    printf(">>> %s\n", gr->rxbuf);
+    log_msg(gr->core, SYS_GDB, GDB_PACKET, ">>> %.*s\n", gr->rxlen, gr->rxbuf);
     gr->lastcommand = gr->rxbuf[0];
 
     if(gr->rxbuf[0] == 0x03)
       {
-        printf("break request\n");
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "break request\n");
         gr->core->status = STATUS_STOPPED;
         //no response!
       }
@@ -193,17 +960,37 @@ void gdbremote_command(struct gdbremote_t *gr)
       {
         gdbremote_txstr(gr, "S02"); //core is stopped
       }
+    else if(!strcmp(gr->rxbuf, "QStartNoAckMode"))
+      {
+        //this reply is still acknowledged
+        gdbremote_txstr(gr, "OK");
+        atomic_store(&gr->noack, true);
+      }
+    else if(gr->rxbuf[0] == 'b' && (gr->rxbuf[1] == 's' || gr->rxbuf[1] == 'c'))
+      {
+        gdbremote_reverse(gr, gr->rxbuf[1] == 'c');
+      }
+    else if(!strncmp("vCont", gr->rxbuf, strlen("vCont")))
+      {
+        gdbremote_vcont(gr);
+      }
     else if(gr->rxbuf[0] == 'c')
       {
         //continue
+        hc11_core_set_range(gr->core, 0, 0);
         gr->core->status = STATUS_RUNNING;
         //no response!
       }
     else if(gr->rxbuf[0] == 'D')
       {
-        //detach
+        //detach, the gdb thread sees the connection end
         gdbremote_txstr(gr, "OK");
-        gr->connected= false;
+        pthread_mutex_lock(&gr->txlock);
+        if(gr->client >= 0)
+          {
+            shutdown(gr->client, SHUT_RDWR);
+          }
+        pthread_mutex_unlock(&gr->txlock);
       }
     else if(gr->rxbuf[0] == 'g')
       {
@@ -236,42 +1023,64 @@ void gdbremote_command(struct gdbremote_t *gr)
       }
     else if(gr->rxbuf[0] == 'm')
       {
-        unsigned int adr, len, i, buf;
+        unsigned int adr, len;
+        uint8_t *data;
         //memory read: MAAAA,len  reply :HH..HH
-        if(sscanf(gr->rxbuf+1, "%X,%X", &adr, &len) != 2)
+        if(sscanf(gr->rxbuf+1, "%X,%X", &adr, &len) != 2 || adr > 0xFFFF)
           {
             gdbremote_txstr(gr, "E01");
             return;
           }
-        if(len > (GDBREMOTE_MAX_TX/2) - 4)
+        if(len > GDBREMOTE_MAX_TX/2)
           {
-            len = GDBREMOTE_MAX_TX/2 - 4;
+            len = GDBREMOTE_MAX_TX/2;
           }
-        printf("adr=%04X len=%d\n",adr,len);
-        for(i=0;i<len;i++)
+        if(adr + len > 0x10000)
           {
-            int ch = hc11_core_readb(gr->core, adr+i);
-            sprintf(gr->txbuf+(2*i), "%02x", ch);
+            len = 0x10000 - adr;
           }
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "adr=%04X len=%d\n",adr,len);
+        //bytes in the second half of txbuf, encoded to the first half
+        data = (uint8_t*)gr->txbuf + GDBREMOTE_MAX_TX/2;
+        hc11_core_debug_read_block(gr->core, adr, data, len);
+        hex_encode(gr->txbuf, data, len);
         gr->txlen = len * 2;
         gdbremote_txraw(gr);
       }
     else if(gr->rxbuf[0] == 'M')
       {
-        unsigned int adr, len, count, i, buf;
-        char *next;
+        unsigned int adr, len, count, i;
+        uint8_t *data;
         //memory write: MAAAA,len:HH..HH
-        if(sscanf(gr->rxbuf+1, "%X,%X:%n", &adr, &len, &count) != 2)
+        if(sscanf(gr->rxbuf+1, "%X,%X:%n", &adr, &len, &count) != 2 ||
+           adr > 0xFFFF || len > 0x10000 - adr ||
+           len > (gr->rxlen - 1 - count) / 2)
+          {
+            gdbremote_txstr(gr, "E01");
+            return;
+          }
+        if(hc11_journal_replaying(gr->core))
+          {
+            gdbremote_txstr(gr, "E03");
+            return;
+          }
+        //decoded in place, the data is before its hex
+        data = (uint8_t*)gr->rxbuf;
+        if(hex_decode(data, gr->rxbuf+1+count, len) < 0)
           {
             gdbremote_txstr(gr, "E01");
             return;
           }
-        next = gr->rxbuf+1+count;
-        printf("adr=%04X len=%d\n",adr,len);
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "adr=%04X len=%d\n",adr,len);
+        if(hc11_core_debug_write_block(gr->core, adr, data, len) < 0)
+          {
+            gdbremote_txstr(gr, "E02");
+            return;
+          }
+        //only writes that happened, the block is written completely or not at all
         for(i=0;i<len;i++)
           {
-            sscanf(next+(2*i), "%02x", &buf);
-            hc11_core_writeb(gr->core, adr+i, buf & 0xFF);
+            hc11_journal_debug(gr->core, JRN_MEMWR, adr+i, data[i]);
           }
         gdbremote_txstr(gr, "OK");
       }
@@ -284,19 +1093,19 @@ void gdbremote_command(struct gdbremote_t *gr)
             gdbremote_txstr(gr, "E01");
             return;
           }
-        printf("set reg %d val %04X\n", reg, val);
-        switch(reg)
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "set reg %d val %04X\n", reg, val);
+        if(hc11_journal_replaying(gr->core))
           {
-            case 0: gr->core->regs.x  = val; break;
-            case 1: gr->core->regs.d  = val; break;
-            case 2: gr->core->regs.y  = val; break;
-            case 3: gr->core->regs.sp = val; break;
-            case 4: gr->core->regs.pc = val; break;
-            case 5: gr->core->regs.d = (gr->core->regs.d & 0x00FF) | (val<<8  ); break; //set a
-            case 6: gr->core->regs.d = (gr->core->regs.d & 0xFF00) | (val&0xFF); break; //set b
-            case 7: gr->core->regs.ccr = val; break;
-            default: gdbremote_txstr(gr, "E02"); return;
+            gdbremote_txstr(gr, "E03");
+            return;
           }
+        if(reg < 0 || reg >= HC11_REG_COUNT)
+          {
+            gdbremote_txstr(gr, "E02");
+            return;
+          }
+        hc11_journal_debug(gr->core, JRN_REGWR, reg, val);
+        hc11_core_set_reg(gr->core, reg, val);
         gdbremote_txstr(gr, "OK");
       }
     else if(gr->rxbuf[0] == 'p')
@@ -337,6 +1146,7 @@ void gdbremote_command(struct gdbremote_t *gr)
     else if(gr->rxbuf[0] == 's')
       {
         //single step
+        hc11_core_set_range(gr->core, 0, 0);
         gr->core->status = STATUS_STEPPING;
         //no response
       }
@@ -345,37 +1155,80 @@ void gdbremote_command(struct gdbremote_t *gr)
         unsigned int adr, len, count, i, buf;
         uint8_t *next;
         // memory write: XAAAA,len:binary
-        if(sscanf(gr->rxbuf+1, "%X,%X:%n", &adr, &len, &count) != 2)
+        if(sscanf(gr->rxbuf+1, "%X,%X:%n", &adr, &len, &count) != 2 ||
+           adr > 0xFFFF || len > 0x10000 - adr ||
+           len > gr->rxlen - 1 - count)
           {
             gdbremote_txstr(gr, "E01");
             return;
           }
+        if(hc11_journal_replaying(gr->core))
+          {
+            gdbremote_txstr(gr, "E03");
+            return;
+          }
         next = (uint8_t*)(gr->rxbuf+1+count);
-        printf("adr=%04X len=%d\n",adr,len);
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "adr=%04X len=%d\n",adr,len);
+        if(hc11_core_debug_write_block(gr->core, adr, next, len) < 0)
+          {
+            gdbremote_txstr(gr, "E02");
+            return;
+          }
+        //only writes that happened, the block is written completely or not at all
         for(i=0;i<len;i++)
           {
-            //printf("%02X", next[i]);
-            hc11_core_writeb(gr->core, adr+i, next[i] & 0xFF);
+            hc11_journal_debug(gr->core, JRN_MEMWR, adr+i, next[i]);
           }
         gdbremote_txstr(gr, "OK");
       }
+    else if(gr->rxbuf[0] == 'x')
+      {
+        unsigned int adr, len;
+        //binary memory read: xAAAA,len  reply bDD..DD
+        if(sscanf(gr->rxbuf+1, "%X,%X", &adr, &len) != 2 || adr > 0xFFFF)
+          {
+            gdbremote_txstr(gr, "E01");
+            return;
+          }
+        if(len > GDBREMOTE_MAX_TX - 1)
+          {
+            len = GDBREMOTE_MAX_TX - 1;
+          }
+        if(adr + len > 0x10000)
+          {
+            len = 0x10000 - adr;
+          }
+        log_msg(gr->core, SYS_GDB, GDB_CMD, "adr=%04X len=%d\n",adr,len);
+        //escaping is done when framing
+        gr->txbuf[0] = 'b';
+        hc11_core_debug_read_block(gr->core, adr, (uint8_t*)gr->txbuf + 1, len);
+        gr->txlen = len + 1;
+        gdbremote_txraw(gr);
+      }
     else if(gr->rxbuf[0] == 'Z')
       {
         unsigned int type, adr, kind;
-        // add breakpoint
-        if(sscanf(gr->rxbuf+1, "%d,%X,%d", &type, &adr, &kind) != 3)
+        struct hc11_agent *cond = NULL;
+        // add breakpoint: Ztype,adr,kind[;X len,bytecode]...
+        if(sscanf(gr->rxbuf+1, "%d,%X,%d", &type, &adr, &kind) != 3 ||
+           gdbremote_conditions(gr, &cond) < 0)
           {
             gdbremote_txstr(gr, "E01");
             return;
           }
         if(type == 0 || type == 1)
           {
-            printf("set bkpt type %d at %04X\n", type, adr);
-            hc11_core_set_bkpt(gr->core, adr);
+            log_msg(gr->core, SYS_GDB, GDB_CMD, "set bkpt type %d at %04X%s\n", type, adr, cond ? " (conditional)" : "");
+            if(hc11_core_set_bkpt_cond(gr->core, adr, cond) < 0)
+              {
+                gdbremote_txstr(gr, "E03");
+                return;
+              }
             gdbremote_txstr(gr, "OK");
           }
         else
           {
+            hc11_agent_free(cond);
             gdbremote_txstr(gr, "E02");
           }
       }
@@ -390,7 +1243,7 @@ void gdbremote_command(struct gdbremote_t *gr)
           }
         if(type == 0 || type == 1)
           {
-            printf("clr bkpt type %d at %04X\n", type, adr);
+            log_msg(gr->core, SYS_GDB, GDB_CMD, "clr bkpt type %d at %04X\n", type, adr);
             hc11_core_clr_bkpt(gr->core, adr);
             gdbremote_txstr(gr, "OK");
           }
@@ -405,151 +1258,246 @@ void gdbremote_command(struct gdbremote_t *gr)
       }
   }
 
-int gdbremote_rx(struct gdbremote_t *gr)
+//gdb thread: next free queue slot, waits for the simulation thread if the
+//queue is full
+static struct gdbremote_cmd *gdbremote_slot(struct gdbremote_t *gr)
   {
-    int state;
-    char c,ack;
-    char cs[5];
-    uint8_t sum;
-    int ret;
+    unsigned int head = atomic_load_explicit(&gr->qhead, memory_order_relaxed);
+    while(head - atomic_load_explicit(&gr->qtail, memory_order_acquire) == GDBREMOTE_QUEUE)
+      {
+        if(atomic_load(&gr->quit))
+          {
+            return NULL;
+          }
+        usleep(100);
+      }
+    return &gr->queue[head % GDBREMOTE_QUEUE];
+  }
 
-    state = STATE_WAIT_START;
-    while(gr->connected)
+static void gdbremote_push(struct gdbremote_t *gr)
+  {
+    uint64_t one = 1;
+    atomic_fetch_add_explicit(&gr->qhead, 1, memory_order_release);
+    if(write(gr->cmdfd, &one, sizeof(one)) != sizeof(one))
       {
-        ret = recv(gr->client, &c, 1, 0);
-        if(ret < 0) return -1;
-        if(ret == 0) return -1;
+        perror("gdbremote: eventfd");
+      }
+  }
 
-        //printf(">> %02X (%c) state=%d\n", c&0xFF, c, state);
+//gdb thread: unframe the received chars into the command queue
+static int gdbremote_rx(struct gdbremote_t *gr, const uint8_t *buf, int len)
+  {
+    struct gdbremote_cmd *cmd = gr->rxcmd;
+    uint8_t c;
+    int i;
 
-        switch(state)
+    for(i=0;i<len;i++)
+      {
+        c = buf[i];
+        switch(gr->rxstate)
           {
             case STATE_WAIT_START:
               if(c == 0x03)
                 {
                   //special case
-                  gr->rxbuf[0] = c;
-                  gr->rxlen = 1;
-                  gdbremote_command(gr);
+                  cmd = gdbremote_slot(gr);
+                  if(!cmd)
+                    {
+                      return -1;
+                    }
+                  cmd->data[0] = c;
+                  cmd->data[1] = 0;
+                  cmd->len = 1;
+                  gdbremote_push(gr);
                 }
               else if(c == '$')
                 {
-                  gr->rxlen = 0;
-                  sum       = 0;
-                  state     = STATE_WAIT_CSUM;
+                  cmd = gdbremote_slot(gr);
+                  if(!cmd)
+                    {
+                      return -1;
+                    }
+                  cmd->len     = 0;
+                  gr->rxcmd    = cmd;
+                  gr->rxsum    = 0;
+                  gr->rxstate  = STATE_WAIT_CSUM;
                 }
+              else if(c == '-')
+                {
+                  gdbremote_retransmit(gr);
+                }
+              //'+' acks need nothing
               break;
 
             case STATE_WAIT_CSUM:
               if(c == 0x7D)
                 {
-                  sum = sum + (uint8_t)c;
-                  state = STATE_ESCAPE;
+                  gr->rxsum += c;
+                  gr->rxstate = STATE_ESCAPE;
                 }
               else if(c == '#')
                 {
-                  state = STATE_CSUM_1;
+                  gr->rxstate = STATE_CSUM_1;
+                }
+              else if(cmd->len < GDBREMOTE_MAX_RX)
+                {
+                  cmd->data[cmd->len++] = c;
+                  gr->rxsum += c;
                 }
               else
                 {
-                  if(gr->rxlen < GDBREMOTE_MAX_RX)
-                    {
-                      gr->rxbuf[gr->rxlen] = c;
-                      sum = sum + (uint8_t)c;
-                      gr->rxlen += 1;
-                    }
-                  else
-                    {
-                      printf("gdbremote: rx buf ovf prevented\n");
-                    }
+                  log_msg(gr->core, SYS_GDB, GDB_PACKET, "gdbremote: rx buf ovf prevented\n");
                 }
               break;
 
             case STATE_ESCAPE:
-              sum = sum + (uint8_t)c;
-              gr->rxbuf[gr->rxlen] = c ^ 0x20;
-              gr->rxlen += 1;
-              state = STATE_WAIT_CSUM;
-              //printf("escape 7D %02X -> %02X\n", c&0xFF, (c^0x20)&0xFF);
+              gr->rxsum += c;
+              if(cmd->len < GDBREMOTE_MAX_RX)
+                {
+                  cmd->data[cmd->len++] = c ^ 0x20;
+                }
+              gr->rxstate = STATE_WAIT_CSUM;
               break;
 
             case STATE_CSUM_1:
-              cs[0] = c;
-              state = STATE_CSUM_2;
+              gr->rxcs = (hexvalues[c] & 0x0F) << 4;
+              gr->rxstate = STATE_CSUM_2;
               break;
 
             case STATE_CSUM_2:
-              cs[1] = c;
-              sprintf(cs+2, "%02x", sum & 0xFF);
-              if(cs[0] == cs[2] && cs[1] == cs[3])
+              gr->rxcs |= hexvalues[c] & 0x0F;
+              gr->rxstate = STATE_WAIT_START;
+              cmd->data[cmd->len] = 0;
+              if(atomic_load(&gr->noack))
                 {
-                  ack = '+';
+                  //the transport is reliable, the checksum is not checked either
+                  gdbremote_push(gr);
                 }
-              else
+              else if(gr->rxcs == gr->rxsum)
                 {
-                  ack = '-';
+                  gdbremote_ack(gr, '+');
+                  gdbremote_push(gr);
                 }
-              send(gr->client, &ack, 1, 0);
-              if(ack == '+')
+              else
                 {
-                  gr->rxbuf[gr->rxlen] = 0;
-                  gdbremote_command(gr);
+                  gdbremote_ack(gr, '-');
                 }
-              state = STATE_WAIT_START;
               break;
           }
       }
+    return 0;
   }
 
+static void gdbremote_connect(struct gdbremote_t *gr)
+  {
+    struct epoll_event ev;
+    struct sockaddr_in client;
+    socklen_t clientsize = sizeof(client);
+    int yes = 1;
+    int fd;
+
+    fd = accept(gr->sock, (struct sockaddr*)&client, &clientsize);
+    if(fd < 0)
+      {
+        perror("accept()");
+        return;
+      }
+    if(gr->client >= 0)
+      {
+        log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: already connected, refusing client\n");
+        close(fd);
+        return;
+      }
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: client connected\n");
+    //replies are single send() calls, do not hold them back
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(gr->epfd, EPOLL_CTL_ADD, fd, &ev);
+    gr->rxstate = STATE_WAIT_START;
+    atomic_store(&gr->noack, false);
+    pthread_mutex_lock(&gr->txlock);
+    gr->client   = fd;
+    gr->framelen = 0;
+    pthread_mutex_unlock(&gr->txlock);
+  }
 
-static void gdbremote_thread_sig(int num, siginfo_t *info, void *v)
+static void gdbremote_disconnect(struct gdbremote_t *gr)
   {
-    struct gdbremote_t *sgr = info->si_value.sival_ptr;
-    printf("gdbremote: thread signal caught\n");
-    sgr->connected = false;
-    sgr->running   = false;
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: connection closed\n");
+    epoll_ctl(gr->epfd, EPOLL_CTL_DEL, gr->client, NULL);
+    pthread_mutex_lock(&gr->txlock);
+    close(gr->client);
+    gr->client = -1;
+    pthread_mutex_unlock(&gr->txlock);
   }
 
 static void* gdbremote_thread(void *param)
   {
     struct gdbremote_t *gr = param;
-    struct sockaddr_in client;
-    struct sigaction sa_thread;
-    int ret;
-
-    memset(&sa_thread, 0, sizeof(struct sigaction));
-    sa_thread.sa_sigaction = gdbremote_thread_sig;
-    sa_thread.sa_flags     = SA_SIGINFO;
-    sigaction(SIGUSR1, &sa_thread, NULL);
+    struct epoll_event ev[4];
+    uint64_t count;
+    char buf[4];
+    int n, i, ret;
 
-    gr->running = true;
-    printf("gdbremote: listen thread start (port %u)\n", gr->port);
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: listen thread start (port %u)\n", gr->port);
     sem_post(&gr->startstop);
 
-    while(gr->running)
+    while(!atomic_load(&gr->quit))
       {
-        int clientsize = sizeof(client);
-        gr->client = accept(gr->sock, (struct sockaddr*)&client, &clientsize);
-        if(gr->client < 0)
+        n = epoll_wait(gr->epfd, ev, 4, -1);
+        if(n < 0 && errno == EINTR)
           {
-            perror("accept()");
+            continue;
+          }
+        if(n < 0)
+          {
+            perror("epoll_wait()");
             break;
           }
-        printf("gdbremote: client connected\n");
-        gr->connected = true;
-        while(gr->connected)
+        for(i=0;i<n;i++)
           {
-            ret = gdbremote_rx(gr);
-            if(ret < 0) break;
+            if(ev[i].data.fd == gr->sock)
+              {
+                gdbremote_connect(gr);
+              }
+            else if(ev[i].data.fd == gr->stopfd)
+              {
+                if(read(gr->stopfd, &count, sizeof(count)) == sizeof(count))
+                  {
+                    ret = snprintf(buf, sizeof(buf), "S%02X", atomic_load(&gr->stopreason) & 0xFF);
+                    gdbremote_tx(gr, buf, ret);
+                  }
+              }
+            else if(ev[i].data.fd == gr->client)
+              {
+                ret = recv(gr->client, gr->inbuf, sizeof(gr->inbuf), 0);
+                if((ret < 0 && errno != EINTR) || ret == 0 ||
+                   (ret > 0 && gdbremote_rx(gr, (uint8_t*)gr->inbuf, ret) < 0))
+                  {
+                    gdbremote_disconnect(gr);
+                  }
+              }
+            //quitfd only ends the wait
           }
-        printf("gdbremote: connection closed\n");
-        close(gr->client);
       }
 
-    printf("gdbremote: listen thread done\n");
+    if(gr->client >= 0)
+      {
+        gdbremote_disconnect(gr);
+      }
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: listen thread done\n");
     return NULL;
   }
 
+static int gdbremote_watch(struct gdbremote_t *gr, int fd)
+  {
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(gr->epfd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
 int gdbremote_init(struct gdbremote_t *gr)
   {
     pthread_t id;
@@ -557,8 +1505,34 @@ int gdbremote_init(struct gdbremote_t *gr)
     int ret;
     int yes = 1;
 
-    printf("gdbremote: starting\n");
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: starting\n");
     sem_init(&gr->startstop, 0, 0);
+    pthread_mutex_init(&gr->txlock, NULL);
+    gr->baseline = NULL;
+    gr->client   = -1;
+    gr->framelen = 0;
+    gr->rxstate  = STATE_WAIT_START;
+    gr->lastcommand = 0;
+    gr->realtime    = false;
+    gr->speedclocks = gr->core->clocks;
+    gr->speedmicros = gdbremote_micros();
+    atomic_init(&gr->quit, false);
+    atomic_init(&gr->noack, false);
+    atomic_init(&gr->stopreason, 0);
+    atomic_init(&gr->qhead, 0);
+    atomic_init(&gr->qtail, 0);
+    pthread_once(&hex_once, hex_init);
+    pthread_once(&crc_once, crc_init);
+
+    gr->epfd   = epoll_create1(EPOLL_CLOEXEC);
+    gr->cmdfd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    gr->stopfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    gr->quitfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(gr->epfd < 0 || gr->cmdfd < 0 || gr->stopfd < 0 || gr->quitfd < 0)
+      {
+        perror("gdbremote: epoll/eventfd");
+        return -1;
+      }
 
     // create tcp socket to allow gdb incoming connection
     gr->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -592,11 +1566,17 @@ int gdbremote_init(struct gdbremote_t *gr)
         goto close;
       }
 
+    if(gdbremote_watch(gr, gr->sock) < 0 || gdbremote_watch(gr, gr->stopfd) < 0 ||
+       gdbremote_watch(gr, gr->quitfd) < 0)
+      {
+        perror("epoll_ctl()");
+        goto close;
+      }
 
     pthread_create(&id, NULL, gdbremote_thread, gr);
 
     sem_wait(&gr->startstop);
-    printf("gdbremote: started\n");
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: started\n");
     gr->tid = id;
     return 0;
 
@@ -607,27 +1587,72 @@ close:
 
 int gdbremote_close(struct gdbremote_t *gr)
   {
+    uint64_t one = 1;
     void *ret;
-    sigval_t val;
-
-    printf("gdbremote: terminating...\n");
-    close(gr->sock);
 
-    val.sival_ptr = gr;
-    pthread_sigqueue(gr->tid, SIGUSR1, val);
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: terminating...\n");
+    atomic_store(&gr->quit, true);
+    if(write(gr->quitfd, &one, sizeof(one)) != sizeof(one))
+      {
+        perror("gdbremote: eventfd");
+      }
     pthread_join(gr->tid, &ret);
-    printf("gdbremote: thread terminated\n");
+    close(gr->sock);
+    close(gr->epfd);
+    close(gr->cmdfd);
+    close(gr->stopfd);
+    close(gr->quitfd);
+    if(gr->baseline)
+      {
+        hc11_baseline_free(gr->baseline);
+      }
+    log_msg(gr->core, SYS_GDB, GDB_CONN, "gdbremote: thread terminated\n");
     return 0;
   }
 
+//simulation thread: the reply is sent by the gdb thread
 int gdbremote_stopped(struct gdbremote_t *gr, uint8_t reason)
   {
-    printf("gdbremote: core has stopped\n");
+    uint64_t one = 1;
+
+    log_msg(gr->core, SYS_GDB, GDB_CMD, "gdbremote: core has stopped\n");
     if(gr->lastcommand != 'c' && gr->lastcommand != 's' && gr->lastcommand != 0x03)
       {
         return 0;
       }
-    gdbremote_txnotif(gr,"S%02X", (int)(reason&0xFF)); //this is a notification, there is no ack!
-    return 0;
+    atomic_store(&gr->stopreason, reason);
+    return (write(gr->stopfd, &one, sizeof(one)) == sizeof(one)) ? 0 : -1;
+  }
+
+//called between instructions, a cheap check when nothing is queued
+void gdbremote_service(struct gdbremote_t *gr)
+  {
+    unsigned int tail = atomic_load_explicit(&gr->qtail, memory_order_relaxed);
+    struct gdbremote_cmd *cmd;
+
+    while(tail != atomic_load_explicit(&gr->qhead, memory_order_acquire))
+      {
+        cmd = &gr->queue[tail % GDBREMOTE_QUEUE];
+        gr->rxbuf = cmd->data;
+        gr->rxlen = cmd->len;
+        gdbremote_command(gr);
+        tail++;
+        atomic_store_explicit(&gr->qtail, tail, memory_order_release);
+      }
   }
 
+void gdbremote_wait(struct gdbremote_t *gr, int ms)
+  {
+    struct pollfd pfd;
+    uint64_t count;
+
+    pfd.fd     = gr->cmdfd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, ms) > 0)
+      {
+        if(read(gr->cmdfd, &count, sizeof(count)) < 0)
+          {
+            perror("gdbremote: eventfd");
+          }
+      }
+  }
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/socket.h>
@@ -11,32 +12,74 @@
 #include <semaphore.h>
 
 #include "core.h"
+#include "sci.h"
+#include "snapshot.h"
 
-#define GDBREMOTE_MAX_RX 1023
-#define GDBREMOTE_MAX_TX 1023
+#define GDBREMOTE_MAX_RX 16384 //advertised as PacketSize
+#define GDBREMOTE_MAX_TX 16384
+#define GDBREMOTE_INBUF  4096  //receive buffering
+#define GDBREMOTE_QUEUE  4     //packets waiting for the simulation thread
 
 #define GDBREMOTE_STOP_NORMAL 0x02
 #define GDBREMOTE_STOP_FAIL   0x05
 
+/* The gdb thread only does I/O: it waits in epoll for the client, the
+ * listening socket and stop notifications, acks and unframes packets, and
+ * queues them. The simulation thread runs the queued commands between
+ * instructions (gdbremote_service) and sends the replies, so the core is
+ * never touched from the gdb thread. */
+
+struct gdbremote_cmd
+  {
+    int  len;
+    char data[GDBREMOTE_MAX_RX + 1];
+  };
+
 struct gdbremote_t
   {
     uint16_t port;
     int sock;
     int client;
+    int epfd;
+    int cmdfd;  //eventfd, commands were queued
+    int stopfd; //eventfd, the core stopped after c, s or a break request
+    int quitfd; //eventfd, gdbremote_close was called
+    atomic_bool quit;
     sem_t startstop;
-    bool running;
-    bool connected;
     pthread_t tid;
     int rxlen,txlen;
+    char *rxbuf; //command being run, in the queue
     struct hc11_core *core;
+    struct hc11_sci  *sci;
+    struct hc11_baseline *baseline; //captured by monitor baseline
+    struct hc11_profile *profile; //set by the caller or by monitor profile start
+    bool realtime;          //monitor mode realtime, paced by the main loop
+    uint64_t speedclocks;   //last monitor speed sample
+    uint64_t speedmicros;
     int lastcommand; //flag to allow an async response when core was running then is stopped
-    char rxbuf[GDBREMOTE_MAX_RX + 1];
+    atomic_bool noack;     //QStartNoAckMode received on this connection
+    atomic_int  stopreason;
+    pthread_mutex_t txlock; //replies come from the simulation thread, acks from the gdb thread
+    int framelen;           //last frame, sent again on a nack
+    //packet parser, gdb thread only
+    int rxstate;
+    uint8_t rxsum, rxcs;
+    struct gdbremote_cmd *rxcmd;
+    char inbuf[GDBREMOTE_INBUF];
+    //single producer (gdb thread), single consumer (simulation thread)
+    atomic_uint qhead, qtail;
+    struct gdbremote_cmd queue[GDBREMOTE_QUEUE];
     char txbuf[GDBREMOTE_MAX_TX + 1];
+    char frame[2 * GDBREMOTE_MAX_TX + 4]; //escaped packet
   };
 
 int gdbremote_init(struct gdbremote_t *gr);
 int gdbremote_close(struct gdbremote_t *gr);
 int gdbremote_stopped(struct gdbremote_t *gr, uint8_t reason);
 
+//simulation thread: run queued commands, or wait up to ms for some
+void gdbremote_service(struct gdbremote_t *gr);
+void gdbremote_wait   (struct gdbremote_t *gr, int ms);
+
 #endif /* __gdb__h__ */
 
@@ -0,0 +1,195 @@
+/* embedding API: one self-contained simulator per instance */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "log.h"
+#include "sci.h"
+#include "image.h"
+#include "hc11sim.h"
+
+struct hc11_sim
+  {
+    struct hc11_core core;
+    struct hc11_sci *sci; //or NULL
+  };
+
+struct hc11_sim *hc11_sim_create(void)
+  {
+    struct hc11_sim *sim;
+
+    sim = malloc(sizeof(struct hc11_sim));
+    if(!sim)
+      {
+        return NULL;
+      }
+    hc11_core_init(&sim->core);
+    hc11_core_reset(&sim->core);
+    sim->sci = NULL;
+    return sim;
+  }
+
+void hc11_sim_destroy(struct hc11_sim *sim)
+  {
+    if(sim->sci)
+      {
+        hc11_sci_close(sim->sci);
+      }
+    hc11_core_unmap_all(&sim->core);
+    free(sim);
+  }
+
+struct hc11_core *hc11_sim_core(struct hc11_sim *sim)
+  {
+    return &sim->core;
+  }
+
+int hc11_sim_map_ram(struct hc11_sim *sim, uint16_t start, uint16_t len)
+  {
+    return hc11_core_map_ram(&sim->core, "ram", start, len);
+  }
+
+int hc11_sim_map_rom(struct hc11_sim *sim, uint16_t start, const uint8_t *data,
+                     uint16_t len)
+  {
+    uint8_t *rom;
+
+    rom = malloc(len);
+    if(!rom)
+      {
+        return -1;
+      }
+    memcpy(rom, data, len);
+    if(hc11_core_map_rom(&sim->core, "rom", start, len, rom) < 0)
+      {
+        free(rom);
+        return -1;
+      }
+    return 0;
+  }
+
+int hc11_sim_load_bin(struct hc11_sim *sim, uint16_t start, const char *fname)
+  {
+    struct hc11_image *img;
+    int ret;
+
+    img = hc11_image_open(fname);
+    if(!img)
+      {
+        return -1;
+      }
+    ret = hc11_core_map_image(&sim->core, "rom", start, img, false);
+    hc11_image_close(img);
+    return ret;
+  }
+
+int hc11_sim_map_image(struct hc11_sim *sim, uint16_t start, struct hc11_image *img,
+                       bool writable)
+  {
+    return hc11_core_map_image(&sim->core, writable ? "ram" : "rom", start, img, writable);
+  }
+
+int hc11_sim_sci(struct hc11_sim *sim, const char *backend, bool turbo)
+  {
+    if(sim->sci)
+      {
+        return -1;
+      }
+    sim->sci = hc11_sci_init(&sim->core, backend);
+    if(!sim->sci)
+      {
+        return -1;
+      }
+    hc11_sci_set_turbo(sim->sci, turbo);
+    return 0;
+  }
+
+int hc11_sim_sci_input(struct hc11_sim *sim, const uint8_t *buf, uint32_t len)
+  {
+    if(!sim->sci)
+      {
+        return -1;
+      }
+    hc11_sci_flush(sim->sci);
+    return hc11_sci_inject(sim->sci, buf, len);
+  }
+
+bool hc11_sim_sci_idle(struct hc11_sim *sim)
+  {
+    return !sim->sci || hc11_sci_rx_idle(sim->sci);
+  }
+
+void hc11_sim_log(struct hc11_sim *sim, int system, int subsystem)
+  {
+    log_enable(&sim->core, system, subsystem);
+  }
+
+void hc11_sim_reset(struct hc11_sim *sim)
+  {
+    hc11_core_reset(&sim->core);
+    sim->core.status = STATUS_RUNNING;
+  }
+
+void hc11_sim_start(struct hc11_sim *sim, uint16_t pc)
+  {
+    hc11_core_jump(&sim->core, pc);
+    sim->core.status = STATUS_RUNNING;
+  }
+
+int hc11_sim_run(struct hc11_sim *sim, uint64_t clocks)
+  {
+    struct hc11_core *core = &sim->core;
+    uint64_t end = core->clocks + clocks;
+
+    if(core->status == STATUS_EXECUTED_STOP)
+      {
+        return HC11_SIM_STOP;
+      }
+    core->status = STATUS_RUNNING;
+    while(core->clocks < end)
+      {
+        hc11_core_step(core);
+        if(core->status != STATUS_RUNNING)
+          {
+            break;
+          }
+      }
+    if(core->status == STATUS_RUNNING)
+      {
+        return HC11_SIM_BUDGET;
+      }
+    if(core->status == STATUS_EXECUTED_STOP)
+      {
+        return HC11_SIM_STOP;
+      }
+    return (core->busadr == VECTOR_ILLEGAL) ? HC11_SIM_ILLEGAL : HC11_SIM_BREAK;
+  }
+
+uint64_t hc11_sim_clocks(struct hc11_sim *sim)
+  {
+    return sim->core.clocks;
+  }
+
+int hc11_sim_get_reg(struct hc11_sim *sim, int reg, uint16_t *val)
+  {
+    return hc11_core_get_reg(&sim->core, reg, val);
+  }
+
+int hc11_sim_set_reg(struct hc11_sim *sim, int reg, uint16_t val)
+  {
+    return hc11_core_set_reg(&sim->core, reg, val);
+  }
+
+int hc11_sim_read(struct hc11_sim *sim, uint16_t adr, uint8_t *buf, uint16_t len)
+  {
+    return hc11_core_read_block(&sim->core, adr, buf, len);
+  }
+
+int hc11_sim_write(struct hc11_sim *sim, uint16_t adr, const uint8_t *buf, uint16_t len)
+  {
+    return hc11_core_write_block(&sim->core, adr, buf, len);
+  }
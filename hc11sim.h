@@ -0,0 +1,63 @@
+#ifndef __hc11sim__h__
+#define __hc11sim__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+#include "image.h"
+
+/* Embedding API, built as libhc11sim.a and libhc11sim.so. Each simulator
+ * instance owns all its state, so independent instances can run in
+ * different threads of the same process. One instance must not be used by
+ * two threads at the same time. */
+
+struct hc11_sim;
+
+//reasons for hc11_sim_run to return
+enum
+  {
+    HC11_SIM_BUDGET,  //clock budget exhausted, the core is still running
+    HC11_SIM_BREAK,   //breakpoint reached
+    HC11_SIM_ILLEGAL, //illegal opcode, PC is at the faulty instruction
+    HC11_SIM_STOP,    //STOP (test opcode 00) executed, the simulation is over
+  };
+
+//a core out of reset, with no memory mapped except internal RAM and registers
+struct hc11_sim  *hc11_sim_create (void);
+void              hc11_sim_destroy(struct hc11_sim *sim);
+struct hc11_core *hc11_sim_core   (struct hc11_sim *sim); //for the other modules
+
+int hc11_sim_map_ram (struct hc11_sim *sim, uint16_t start, uint16_t len);
+int hc11_sim_map_rom (struct hc11_sim *sim, uint16_t start, const uint8_t *data,
+                      uint16_t len);
+int hc11_sim_load_bin(struct hc11_sim *sim, uint16_t start, const char *fname);
+//Copy-on-write view of an image (see image.h) shared by all the instances
+//mapping it: ROM, or RAM starting from common contents.
+int hc11_sim_map_image(struct hc11_sim *sim, uint16_t start, struct hc11_image *img,
+                       bool writable);
+int hc11_sim_sci     (struct hc11_sim *sim, const char *backend, bool turbo);
+void hc11_sim_log    (struct hc11_sim *sim, int system, int subsystem);
+
+//replace the SCI input not yet received by the core, returns the bytes queued
+int hc11_sim_sci_input(struct hc11_sim *sim, const uint8_t *buf, uint32_t len);
+//true once the firmware has read all of it
+bool hc11_sim_sci_idle(struct hc11_sim *sim);
+
+//start from the reset vector, or directly at pc
+void hc11_sim_reset(struct hc11_sim *sim);
+void hc11_sim_start(struct hc11_sim *sim, uint16_t pc);
+
+//execute whole instructions for at least clocks cycles, or until the core stops
+int      hc11_sim_run   (struct hc11_sim *sim, uint64_t clocks);
+uint64_t hc11_sim_clocks(struct hc11_sim *sim);
+
+int hc11_sim_get_reg(struct hc11_sim *sim, int reg, uint16_t *val);
+int hc11_sim_set_reg(struct hc11_sim *sim, int reg, uint16_t val);
+
+//Memory is accessed directly, rom included, registers and callback mappings
+//through the bus like cpu accesses. Blocks may not run past 0xFFFF.
+int hc11_sim_read (struct hc11_sim *sim, uint16_t adr, uint8_t *buf, uint16_t len);
+int hc11_sim_write(struct hc11_sim *sim, uint16_t adr, const uint8_t *buf, uint16_t len);
+
+#endif /* __hc11sim__h__ */
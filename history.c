@@ -0,0 +1,145 @@
+/* undo log for reverse execution */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core.h"
+#include "history.h"
+#include "log.h"
+
+struct history_step
+  {
+    struct hc11_regs regs;
+    uint64_t clocks;
+    uint16_t state;
+    uint16_t busadr;
+    uint64_t memidx; //first memory write done by this instruction
+  };
+
+struct history_mem
+  {
+    uint16_t adr;
+    uint8_t  old;
+  };
+
+/* Both logs are rings indexed by ever increasing counters. When the memory
+ * ring wraps, the steps whose writes were overwritten cannot be undone. */
+struct hc11_history
+  {
+    struct hc11_core    *core;
+    struct history_step *steps;
+    uint32_t             nsteps;
+    uint64_t             stephead; //next step to record
+    uint64_t             steptail; //oldest step that can be undone
+    struct history_mem  *mem;
+    uint32_t             nmem;
+    uint64_t             memhead;
+  };
+
+struct hc11_history *hc11_history_create(struct hc11_core *core, uint32_t steps)
+  {
+    struct hc11_history *h;
+
+    h = malloc(sizeof(struct hc11_history));
+    if(!h)
+      {
+        return NULL;
+      }
+    h->core   = core;
+    h->nsteps = steps;
+    h->nmem   = steps * HISTORY_MEM_RATIO;
+    h->steps  = malloc(h->nsteps * sizeof(struct history_step));
+    h->mem    = malloc(h->nmem   * sizeof(struct history_mem));
+    if(!h->steps || !h->mem)
+      {
+        printf("history: cannot allocate %u steps\n", steps);
+        hc11_history_destroy(h);
+        return NULL;
+      }
+    hc11_history_clear(h);
+    core->history = h;
+    return h;
+  }
+
+void hc11_history_destroy(struct hc11_history *h)
+  {
+    if(h->core->history == h)
+      {
+        h->core->history = NULL;
+      }
+    free(h->steps);
+    free(h->mem);
+    free(h);
+  }
+
+void hc11_history_clear(struct hc11_history *h)
+  {
+    h->stephead = 0;
+    h->steptail = 0;
+    h->memhead  = 0;
+  }
+
+void hc11_history_step(struct hc11_history *h)
+  {
+    struct hc11_core *core = h->core;
+    struct history_step *s = &h->steps[h->stephead % h->nsteps];
+
+    s->regs   = core->regs;
+    s->clocks = core->clocks;
+    s->state  = core->state;
+    s->busadr = core->busadr;
+    s->memidx = h->memhead;
+    h->stephead += 1;
+    if(h->stephead - h->steptail > h->nsteps)
+      {
+        h->steptail += 1;
+      }
+  }
+
+void hc11_history_write(struct hc11_history *h, uint16_t adr, uint8_t old)
+  {
+    struct history_mem *m = &h->mem[h->memhead % h->nmem];
+    m->adr = adr;
+    m->old = old;
+    h->memhead += 1;
+  }
+
+int hc11_history_back(struct hc11_history *h)
+  {
+    struct hc11_core *core = h->core;
+    struct history_step *s;
+    struct history_mem *m;
+
+    if(h->stephead == h->steptail)
+      {
+        return -1;
+      }
+    s = &h->steps[(h->stephead - 1) % h->nsteps];
+    if(h->memhead - s->memidx > h->nmem)
+      {
+        //its memory writes are lost, and so are all older steps
+        h->steptail = h->stephead;
+        return -1;
+      }
+    h->stephead -= 1;
+
+    while(h->memhead > s->memidx)
+      {
+        h->memhead -= 1;
+        m = &h->mem[h->memhead % h->nmem];
+        hc11_core_pokeb(core, m->adr, m->old);
+      }
+    core->regs   = s->regs;
+    core->state  = s->state;
+    core->busadr = s->busadr;
+    hc11_core_set_clocks(core, s->clocks);
+    return 0;
+  }
+
+uint32_t hc11_history_depth(struct hc11_history *h)
+  {
+    return h->stephead - h->steptail;
+  }
@@ -0,0 +1,28 @@
+#ifndef __history__h__
+#define __history__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* Execution history for reverse debugging. Before each instruction the cpu
+ * registers are saved, and every memory write logs the byte it replaces.
+ * Stepping back restores both. Peripheral registers are not part of the
+ * history: they keep their current state when going back. */
+
+#define HISTORY_MEM_RATIO 4 //logged memory writes per instruction
+
+struct hc11_history *hc11_history_create(struct hc11_core *core, uint32_t steps);
+void hc11_history_destroy(struct hc11_history *h);
+void hc11_history_clear(struct hc11_history *h);
+
+//called by the core
+void hc11_history_step (struct hc11_history *h);
+void hc11_history_write(struct hc11_history *h, uint16_t adr, uint8_t old);
+
+//undo the last instruction, -1 if the history is exhausted
+int      hc11_history_back (struct hc11_history *h);
+uint32_t hc11_history_depth(struct hc11_history *h);
+
+#endif /* __history__h__ */
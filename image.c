@@ -0,0 +1,127 @@
+/* shared copy-on-write memory images */
+
+#define _GNU_SOURCE //memfd_create
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "image.h"
+
+struct hc11_image
+  {
+    int      fd;
+    uint32_t len;
+  };
+
+static struct hc11_image *image_new(int fd, uint32_t len)
+  {
+    struct hc11_image *img = malloc(sizeof(struct hc11_image));
+    if(!img)
+      {
+        close(fd);
+        return NULL;
+      }
+    img->fd  = fd;
+    img->len = len;
+    return img;
+  }
+
+//the file is copied once, so rebuilding or truncating it while the
+//simulator runs does not change or pull pages under the running core
+struct hc11_image *hc11_image_open(const char *fname)
+  {
+    struct hc11_image *img;
+    uint8_t *data;
+    uint32_t len = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = open(fname, O_RDONLY);
+    if(fd < 0)
+      {
+        printf("Unable to open: %s\n", fname);
+        return NULL;
+      }
+    //one byte more than fits, to see files that are too big
+    data = malloc(0x10001);
+    if(!data)
+      {
+        close(fd);
+        return NULL;
+      }
+    while(len < 0x10001 && (ret = read(fd, data + len, 0x10001 - len)) > 0)
+      {
+        len += ret;
+      }
+    close(fd);
+    if(len == 0 || len > 0x10000)
+      {
+        printf("file %s is empty or too big\n", fname);
+        free(data);
+        return NULL;
+      }
+    img = hc11_image_create("rom", data, len);
+    free(data);
+    return img;
+  }
+
+struct hc11_image *hc11_image_create(const char *name, const uint8_t *data, uint32_t len)
+  {
+    uint32_t done;
+    ssize_t ret;
+    int fd;
+
+    fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if(fd < 0)
+      {
+        perror("memfd_create");
+        return NULL;
+      }
+    for(done = 0; done < len; done += ret)
+      {
+        ret = write(fd, data + done, len - done);
+        if(ret <= 0)
+          {
+            perror("image write");
+            close(fd);
+            return NULL;
+          }
+      }
+    //contents are fixed from now on, for every process sharing the image
+    if(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+      {
+        perror("image seal");
+        close(fd);
+        return NULL;
+      }
+    return image_new(fd, len);
+  }
+
+void hc11_image_close(struct hc11_image *img)
+  {
+    close(img->fd);
+    free(img);
+  }
+
+uint32_t hc11_image_len(struct hc11_image *img)
+  {
+    return img->len;
+  }
+
+uint8_t *hc11_image_map(struct hc11_image *img)
+  {
+    void *mem;
+
+    mem = mmap(NULL, img->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, img->fd, 0);
+    if(mem == MAP_FAILED)
+      {
+        perror("image mmap");
+        return NULL;
+      }
+    return mem;
+  }
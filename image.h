@@ -0,0 +1,23 @@
+#ifndef __image__h__
+#define __image__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Memory images shared between instances and processes. An image lives in
+ * a sealed memfd that child processes inherit, a file image is a copy of
+ * the file taken when it is opened. Each mapping is a private copy-on-write
+ * view: pages stay shared until an instance writes them. Mappings remain
+ * valid after the image is closed. */
+
+struct hc11_image;
+
+struct hc11_image *hc11_image_open  (const char *fname);
+struct hc11_image *hc11_image_create(const char *name, const uint8_t *data, uint32_t len);
+void               hc11_image_close (struct hc11_image *img);
+uint32_t           hc11_image_len   (struct hc11_image *img);
+
+//new copy-on-write view, to be released with munmap, or NULL
+uint8_t *hc11_image_map(struct hc11_image *img);
+
+#endif /* __image__h__ */
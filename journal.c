@@ -0,0 +1,342 @@
+/* record/replay of external inputs */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "core.h"
+#include "journal.h"
+#include "log.h"
+
+/* File format: 8 bytes magic, one version byte, then entries:
+ *   varint  clock delta from previous entry (from 0 after a JRN_RESET)
+ *   uint8   type, JRN_DEBUG set if applied between two clocks
+ *   payload depending on type, little endian:
+ *     JRN_SCI_RX, JRN_SCI_MODE : val8
+ *     JRN_MEMWR                : arg16 val8
+ *     JRN_REGWR                : arg8 val16
+ *     JRN_IRQ                  : arg16 val8
+ *     JRN_END, JRN_RESET       : none
+ */
+static const char journal_magic[8] = "HC11JRN";
+
+struct journal_sink
+  {
+    void      *ctx;
+    journal_f cb;
+  };
+
+struct hc11_journal
+  {
+    struct hc11_core *core;
+    FILE     *f;
+    bool     replay;
+    bool     eof;
+    int      event;
+    uint64_t base;      //clock of the previous entry
+    pthread_mutex_t lock; //inputs come from the core and the gdb threads
+    //next entry to replay
+    uint64_t when;
+    uint8_t  type;
+    bool     debug;
+    uint16_t arg;
+    uint16_t val;
+    struct journal_sink sinks[JRN_TYPES];
+  };
+
+static void journal_putvar(FILE *f, uint64_t v)
+  {
+    while(v >= 0x80)
+      {
+        fputc((v & 0x7F) | 0x80, f);
+        v >>= 7;
+      }
+    fputc(v, f);
+  }
+
+static int journal_getvar(FILE *f, uint64_t *v)
+  {
+    int c, shift = 0;
+    *v = 0;
+    do
+      {
+        c = fgetc(f);
+        if(c == EOF || shift > 63)
+          {
+            return -1;
+          }
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+      }
+    while(c & 0x80);
+    return 0;
+  }
+
+static void journal_put16(FILE *f, uint16_t v)
+  {
+    fputc(v & 0xFF, f);
+    fputc(v >> 8  , f);
+  }
+
+static int journal_get8(FILE *f, uint16_t *v)
+  {
+    int c = fgetc(f);
+    *v = c;
+    return (c == EOF) ? -1 : 0;
+  }
+
+static int journal_get16(FILE *f, uint16_t *v)
+  {
+    int lo = fgetc(f);
+    int hi = fgetc(f);
+    *v = (lo & 0xFF) | ((hi & 0xFF) << 8);
+    return (hi == EOF) ? -1 : 0;
+  }
+
+static void journal_write(struct hc11_journal *j, uint64_t when, uint8_t type,
+                          bool debug, uint16_t arg, uint16_t val)
+  {
+    pthread_mutex_lock(&j->lock);
+    journal_putvar(j->f, when - j->base);
+    fputc(type | (debug ? JRN_DEBUG : 0), j->f);
+    switch(type)
+      {
+        case JRN_SCI_RX:
+        case JRN_SCI_MODE: fputc(val, j->f); break;
+        case JRN_MEMWR   :
+        case JRN_IRQ     : journal_put16(j->f, arg); fputc(val, j->f); break;
+        case JRN_REGWR   : fputc(arg, j->f); journal_put16(j->f, val); break;
+      }
+    j->base = (type == JRN_RESET) ? 0 : when;
+    pthread_mutex_unlock(&j->lock);
+  }
+
+//load the next entry to replay
+static int journal_read(struct hc11_journal *j)
+  {
+    uint64_t delta;
+    int c;
+    int ret = 0;
+
+    j->arg = 0;
+    j->val = 0;
+    if(journal_getvar(j->f, &delta) < 0 || (c = fgetc(j->f)) == EOF)
+      {
+        return -1;
+      }
+    j->type  = c & ~JRN_DEBUG;
+    j->debug = (c & JRN_DEBUG) != 0;
+    j->when = j->base + delta;
+    switch(j->type)
+      {
+        case JRN_SCI_RX:
+        case JRN_SCI_MODE: ret = journal_get8(j->f, &j->val); break;
+        case JRN_MEMWR   :
+        case JRN_IRQ     : ret = journal_get16(j->f, &j->arg) | journal_get8(j->f, &j->val); break;
+        case JRN_REGWR   : ret = journal_get8(j->f, &j->arg) | journal_get16(j->f, &j->val); break;
+        case JRN_END     :
+        case JRN_RESET   : break;
+        default:
+          printf("journal: unknown entry type %d\n", j->type);
+          return -1;
+      }
+    j->base = (j->type == JRN_RESET) ? 0 : j->when;
+    return ret;
+  }
+
+//apply all entries due at this clock, then wait for the next one
+static void journal_fire(void *ctx)
+  {
+    struct hc11_journal *j = ctx;
+    struct journal_sink *sink;
+
+    while(!j->eof && j->type != JRN_END && j->when <= j->core->clocks)
+      {
+        log_msg(j->core, SYS_CORE, CORE_DBG, "journal: [%"PRIu64"] type %d arg %04X val %04X\n", j->when, j->type, j->arg, j->val);
+        sink = &j->sinks[j->type];
+        if(sink->cb)
+          {
+            //Debugger inputs were applied before this clock started: make
+            //the sink see the same clock count as when they were recorded.
+            j->core->clocks -= j->debug;
+            sink->cb(sink->ctx, j->arg, j->val);
+            j->core->clocks += j->debug;
+          }
+        if(journal_read(j) < 0)
+          {
+            printf("journal: truncated\n");
+            j->eof = true;
+          }
+      }
+    if(!j->eof && j->type != JRN_END)
+      {
+        hc11_core_event_schedule(j->core, j->event, j->when - j->core->clocks);
+      }
+  }
+
+//replay sinks for inputs that act on the core itself
+static void journal_memwr(void *ctx, uint16_t arg, uint16_t val)
+  {
+    uint8_t byte = val;
+    //same path as the debugger write that was recorded
+    hc11_core_debug_write_block(ctx, arg, &byte, 1);
+  }
+
+static void journal_regwr(void *ctx, uint16_t arg, uint16_t val)
+  {
+    hc11_core_set_reg(ctx, arg, val);
+  }
+
+static void journal_irq(void *ctx, uint16_t arg, uint16_t val)
+  {
+    hc11_core_irq(ctx, arg, val);
+  }
+
+static void journal_reset(void *ctx, uint16_t arg, uint16_t val)
+  {
+    hc11_core_reset(ctx);
+  }
+
+struct hc11_journal *hc11_journal_open(struct hc11_core *core, const char *fname,
+                                       bool replay)
+  {
+    struct hc11_journal *j;
+    char magic[sizeof(journal_magic)];
+    int version;
+
+    j = malloc(sizeof(struct hc11_journal));
+    if(!j)
+      {
+        return NULL;
+      }
+    memset(j, 0, sizeof(struct hc11_journal));
+    j->core   = core;
+    j->replay = replay;
+    j->base   = 0;
+    pthread_mutex_init(&j->lock, NULL);
+
+    j->f = fopen(fname, replay ? "rb" : "wb");
+    if(!j->f)
+      {
+        printf("journal: cannot open %s\n", fname);
+        goto release;
+      }
+
+    if(!replay)
+      {
+        fwrite(journal_magic, 1, sizeof(journal_magic), j->f);
+        fputc(JOURNAL_VERSION, j->f);
+        core->journal = j;
+        return j;
+      }
+
+    if(fread(magic, 1, sizeof(magic), j->f) != sizeof(magic) ||
+       memcmp(magic, journal_magic, sizeof(magic)))
+      {
+        printf("journal: %s is not a journal\n", fname);
+        goto close;
+      }
+    version = fgetc(j->f);
+    if(version != JOURNAL_VERSION)
+      {
+        printf("journal: unsupported version %d\n", version);
+        goto close;
+      }
+
+    hc11_journal_sink(j, JRN_MEMWR, core, journal_memwr);
+    hc11_journal_sink(j, JRN_REGWR, core, journal_regwr);
+    hc11_journal_sink(j, JRN_IRQ  , core, journal_irq  );
+    hc11_journal_sink(j, JRN_RESET, core, journal_reset);
+
+    j->event = hc11_core_event_register(core, j, journal_fire);
+    if(j->event < 0)
+      {
+        goto close;
+      }
+    if(journal_read(j) < 0)
+      {
+        j->eof = true;
+      }
+    else if(j->type != JRN_END)
+      {
+        hc11_core_event_schedule(core, j->event, j->when - core->clocks);
+      }
+    core->journal = j;
+    return j;
+
+close:
+    fclose(j->f);
+release:
+    free(j);
+    return NULL;
+  }
+
+void hc11_journal_close(struct hc11_journal *j)
+  {
+    if(!j->replay)
+      {
+        journal_write(j, j->core->clocks, JRN_END, false, 0, 0);
+      }
+    else
+      {
+        hc11_core_event_cancel(j->core, j->event);
+        j->core->events[j->event].cb = NULL;
+      }
+    j->core->journal = NULL;
+    fclose(j->f);
+    free(j);
+  }
+
+void hc11_journal_sink(struct hc11_journal *j, uint8_t type, void *ctx,
+                       journal_f cb)
+  {
+    if(type < JRN_TYPES)
+      {
+        j->sinks[type].ctx = ctx;
+        j->sinks[type].cb  = cb;
+      }
+  }
+
+void hc11_journal_input(struct hc11_core *core, uint8_t type, uint16_t arg,
+                        uint16_t val)
+  {
+    if(core->journal && !core->journal->replay)
+      {
+        journal_write(core->journal, core->clocks, type, false, arg, val);
+      }
+  }
+
+void hc11_journal_debug(struct hc11_core *core, uint8_t type, uint16_t arg,
+                        uint16_t val)
+  {
+    //takes effect before the next clock is executed
+    if(core->journal && !core->journal->replay)
+      {
+        journal_write(core->journal, core->clocks + 1, type, true, arg, val);
+      }
+  }
+
+bool hc11_journal_replaying(struct hc11_core *core)
+  {
+    return core->journal && core->journal->replay;
+  }
+
+//true when replay has reached the clock at which recording was stopped
+bool hc11_journal_finished(struct hc11_core *core)
+  {
+    struct hc11_journal *j = core->journal;
+    if(!j || !j->replay)
+      {
+        return false;
+      }
+    if(j->eof)
+      {
+        return true;
+      }
+    return j->type == JRN_END && core->clocks >= j->when;
+  }
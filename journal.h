@@ -0,0 +1,48 @@
+#ifndef __journal__h__
+#define __journal__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* Record and replay of everything that enters the simulation from outside,
+ * stamped with the core clock at which it takes effect. Replaying the journal
+ * with the same command line options gives back the same machine state. */
+
+#define JOURNAL_VERSION 1
+#define JRN_DEBUG       0x80 //type flag: input applied between two clocks
+
+enum journal_type
+  {
+    JRN_END,      //end of recording, no payload
+    JRN_SCI_RX,   //byte received by the SCI: val
+    JRN_SCI_MODE, //SCI turbo mode change: val
+    JRN_MEMWR,    //debugger memory write: arg=address val=byte
+    JRN_REGWR,    //debugger register write: arg=register number val=value
+    JRN_IRQ,      //external interrupt line: arg=vector val=level
+    JRN_RESET,    //core reset
+    JRN_TYPES
+  };
+
+typedef void (*journal_f)(void *ctx, uint16_t arg, uint16_t val);
+
+struct hc11_journal *hc11_journal_open(struct hc11_core *core, const char *fname,
+                                       bool replay);
+void hc11_journal_close(struct hc11_journal *j);
+
+//set the function that applies inputs of a given type during replay
+void hc11_journal_sink(struct hc11_journal *j, uint8_t type, void *ctx,
+                       journal_f cb);
+
+//record an input applied from a core event, at the current clock
+void hc11_journal_input(struct hc11_core *core, uint8_t type, uint16_t arg,
+                        uint16_t val);
+//record an input applied while the core is stopped between two clocks
+void hc11_journal_debug(struct hc11_core *core, uint8_t type, uint16_t arg,
+                        uint16_t val);
+
+bool hc11_journal_replaying(struct hc11_core *core);
+bool hc11_journal_finished (struct hc11_core *core);
+
+#endif /* __journal__h__ */
@@ -0,0 +1,554 @@
+/* differential checking of two execution engines */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "core.h"
+#include "lockstep.h"
+#include "disasm.h"
+
+struct engine
+  {
+    const char *name;
+    engine_f    step;
+  };
+
+static const struct engine engines[] =
+  {
+    {"step" , hc11_core_step      }, //production: breakpoints, history
+    {"clock", hc11_core_step_clock}, //reference state machine
+  };
+
+struct ls_access
+  {
+    uint16_t adr;
+    uint8_t  val;
+  };
+
+struct ls_log
+  {
+    struct ls_access acc[LOCKSTEP_ACCESS];
+    int              count;
+    bool             overflow;
+  };
+
+//a peripheral register of the main core, wrapped to record what it returns
+struct ls_port
+  {
+    struct hc11_lockstep *ls;
+    struct hc11_io        orig;
+  };
+
+//a main core event, wrapped to record interrupt line changes
+struct ls_event
+  {
+    struct hc11_lockstep *ls;
+    void                 *ctx;
+    event_f               cb;
+  };
+
+struct ls_irq
+  {
+    uint64_t when; //first clock that sees the new value
+    uint32_t pending;
+  };
+
+struct ls_trace
+  {
+    uint64_t         clocks;
+    uint16_t         pc;
+    uint8_t          code[HC11_DISASM_MAX];
+    struct hc11_regs regs; //after the instruction
+  };
+
+struct hc11_lockstep
+  {
+    struct hc11_core *core;
+    struct hc11_core  shadow;
+    const struct engine *main;
+    const struct engine *check;
+    struct ls_port    ports[64];
+    struct ls_event   events[HC11_EVENT_NUM];
+    int               irqevent;  //shadow event replaying interrupt changes
+    struct ls_irq     irqs[LOCKSTEP_ACCESS];
+    int               nirqs;
+    int               nextirq;
+    uint32_t          lastirq;
+    struct ls_log     reads;     //peripheral reads of the main core
+    int               readpos;   //next read returned to the shadow
+    bool              readbad;   //shadow read another register, or too many
+    struct ls_log     writes[2]; //main, shadow
+    uint32_t          epoch;     //main core pages written since are copied
+    struct ls_trace   trace[LOCKSTEP_TRACE];
+    uint64_t          count;     //instructions checked
+  };
+
+static void ls_log_add(struct ls_log *log, uint16_t adr, uint8_t val)
+  {
+    if(log->count == LOCKSTEP_ACCESS)
+      {
+        log->overflow = true;
+        return;
+      }
+    log->acc[log->count].adr = adr;
+    log->acc[log->count].val = val;
+    log->count++;
+  }
+
+static void ls_irq_check(struct hc11_lockstep *ls, uint64_t when)
+  {
+    if(ls->core->irq_pending == ls->lastirq || ls->nirqs == LOCKSTEP_ACCESS)
+      {
+        return;
+      }
+    ls->lastirq = ls->core->irq_pending;
+    ls->irqs[ls->nirqs].when    = when;
+    ls->irqs[ls->nirqs].pending = ls->lastirq;
+    ls->nirqs++;
+  }
+
+/* main core side */
+
+static uint8_t ls_main_read(void *ctx, uint16_t off)
+  {
+    struct ls_port *port = ctx;
+    uint8_t val = port->orig.rdf(port->orig.ctx, off);
+    ls_log_add(&port->ls->reads, off, val);
+    ls_irq_check(port->ls, port->ls->core->clocks + 1);
+    return val;
+  }
+
+//debugger accesses are not part of the comparison
+static uint8_t ls_main_debug_read(void *ctx, uint16_t off)
+  {
+    struct ls_port *port = ctx;
+    return port->orig.dbgrdf(port->orig.ctx, off);
+  }
+
+static void ls_main_debug_write(void *ctx, uint16_t off, uint8_t val)
+  {
+    struct ls_port *port = ctx;
+    port->orig.dbgwrf(port->orig.ctx, off, val);
+  }
+
+static void ls_main_write(void *ctx, uint16_t off, uint8_t val)
+  {
+    struct ls_port *port = ctx;
+    port->orig.wrf(port->orig.ctx, off, val);
+    ls_irq_check(port->ls, port->ls->core->clocks + 1);
+  }
+
+//events fire before the clock is processed, the change is seen at once
+static void ls_main_event(void *ctx)
+  {
+    struct ls_event *ev = ctx;
+    ev->cb(ev->ctx);
+    ls_irq_check(ev->ls, ev->ls->core->clocks);
+  }
+
+static void ls_write_hook(void *ctx, uint16_t adr, uint8_t val)
+  {
+    ls_log_add(ctx, adr, val);
+  }
+
+/* shadow side */
+
+static uint8_t ls_shadow_read(void *ctx, uint16_t off)
+  {
+    struct ls_port *port = ctx;
+    struct hc11_lockstep *ls = port->ls;
+    struct ls_access *acc;
+
+    if(ls->readpos >= ls->reads.count)
+      {
+        ls->readbad = true;
+        return 0xFF;
+      }
+    acc = &ls->reads.acc[ls->readpos++];
+    if(acc->adr != off)
+      {
+        ls->readbad = true;
+      }
+    return acc->val;
+  }
+
+static void ls_shadow_write(void *ctx, uint16_t off, uint8_t val)
+  {
+    //peripherals belong to the main core, the write is compared by the hook
+  }
+
+static void ls_shadow_irq(void *ctx)
+  {
+    struct hc11_lockstep *ls = ctx;
+    struct hc11_core *shadow = &ls->shadow;
+
+    shadow->irq_pending = ls->irqs[ls->nextirq++].pending;
+    if(ls->nextirq < ls->nirqs)
+      {
+        hc11_core_event_schedule(shadow, ls->irqevent,
+                                 ls->irqs[ls->nextirq].when - shadow->clocks);
+      }
+  }
+
+static const struct engine *ls_engine(const char *name, size_t len)
+  {
+    int i;
+    for(i=0;i<sizeof(engines)/sizeof(engines[0]);i++)
+      {
+        if(strlen(engines[i].name) == len && !strncmp(engines[i].name, name, len))
+          {
+            return &engines[i];
+          }
+      }
+    printf("lockstep: unknown engine %.*s\n", (int)len, name);
+    return NULL;
+  }
+
+void hc11_lockstep_help(void)
+  {
+    int i;
+    printf("Lockstep engines (main,shadow):");
+    for(i=0;i<sizeof(engines)/sizeof(engines[0]);i++)
+      {
+        printf(" %s", engines[i].name);
+      }
+    printf("\n");
+  }
+
+struct hc11_lockstep *hc11_lockstep_create(struct hc11_core *core, const char *spec)
+  {
+    struct hc11_lockstep *ls;
+    struct hc11_core *shadow;
+    struct hc11_mapping *cur;
+    struct hc11_mapping *dst;
+    struct hc11_mapping *ordered, **tail, **link;
+    uint8_t *rom;
+    const char *comma;
+    int i;
+
+    if(!spec || !*spec)
+      {
+        spec = "step,clock";
+      }
+    comma = strchr(spec, ',');
+    if(!comma)
+      {
+        printf("lockstep: expected main,shadow engines\n");
+        return NULL;
+      }
+
+    ls = malloc(sizeof(struct hc11_lockstep));
+    if(!ls)
+      {
+        return NULL;
+      }
+    ls->core  = core;
+    ls->main  = ls_engine(spec, comma - spec);
+    ls->check = ls_engine(comma + 1, strlen(comma + 1));
+    ls->count = 0;
+    memset(ls->trace, 0, sizeof(ls->trace));
+    if(!ls->main || !ls->check)
+      {
+        free(ls);
+        return NULL;
+      }
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(!cur->mem)
+          {
+            printf("lockstep: mapping %s has no backing store, not supported\n", cur->name);
+            free(ls);
+            return NULL;
+          }
+      }
+
+    shadow = &ls->shadow;
+    hc11_core_init(shadow);
+    ls->irqevent = hc11_core_event_register(shadow, ls, ls_shadow_irq);
+
+    //same memory map, its contents are copied before each instruction
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(cur->wrf)
+          {
+            if(hc11_core_map_ram(shadow, cur->name, cur->start, cur->len) < 0)
+              {
+                hc11_lockstep_destroy(ls);
+                return NULL;
+              }
+          }
+        else
+          {
+            rom = malloc(cur->len);
+            if(!rom || hc11_core_map_rom(shadow, cur->name, cur->start, cur->len, rom) < 0)
+              {
+                free(rom);
+                hc11_lockstep_destroy(ls);
+                return NULL;
+              }
+          }
+      }
+    //hc11_core_map does not keep the list sorted: put the shadow mappings in
+    //the order of the main ones, same lookup priority and pairs for copies
+    ordered = NULL;
+    tail    = &ordered;
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        for(link = &shadow->maps; *link != NULL; link = &(*link)->next)
+          {
+            if((*link)->start == cur->start && (*link)->len == cur->len)
+              {
+                break;
+              }
+          }
+        if(!*link)
+          {
+            printf("lockstep: no shadow mapping for %s\n", cur->name);
+            *tail = shadow->maps; //freed with the others
+            shadow->maps = ordered;
+            hc11_lockstep_destroy(ls);
+            return NULL;
+          }
+        dst   = *link;
+        *link = dst->next;
+        dst->next = NULL;
+        *tail = dst;
+        tail  = &dst->next;
+        memcpy(dst->mem, cur->mem, cur->len);
+      }
+    shadow->maps = ordered;
+    ls->epoch = hc11_core_mem_checkpoint(core);
+
+    //internal registers stay with each core, peripherals with the main one
+    for(i=0;i<64;i++)
+      {
+        ls->ports[i].ls   = ls;
+        ls->ports[i].orig = core->io[i];
+        if(core->io[i].ctx == core || (!core->io[i].rdf && !core->io[i].wrf))
+          {
+            continue;
+          }
+        core->io[i].ctx = &ls->ports[i];
+        core->io[i].rdf = ls->ports[i].orig.rdf ? ls_main_read  : NULL;
+        core->io[i].wrf = ls->ports[i].orig.wrf ? ls_main_write : NULL;
+        core->io[i].dbgrdf = ls->ports[i].orig.dbgrdf ? ls_main_debug_read  : NULL;
+        core->io[i].dbgwrf = ls->ports[i].orig.dbgwrf ? ls_main_debug_write : NULL;
+        shadow->io[i].ctx = &ls->ports[i];
+        shadow->io[i].rdf = ls_shadow_read;
+        shadow->io[i].wrf = ls_shadow_write;
+      }
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        ls->events[i].ls  = ls;
+        ls->events[i].ctx = core->events[i].ctx;
+        ls->events[i].cb  = core->events[i].cb;
+        if(core->events[i].cb)
+          {
+            core->events[i].ctx = &ls->events[i];
+            core->events[i].cb  = ls_main_event;
+          }
+      }
+
+    core->wrhook       = ls_write_hook;
+    core->wrhook_ctx   = &ls->writes[0];
+    shadow->wrhook     = ls_write_hook;
+    shadow->wrhook_ctx = &ls->writes[1];
+    return ls;
+  }
+
+void hc11_lockstep_destroy(struct hc11_lockstep *ls)
+  {
+    struct hc11_core *core = ls->core;
+    int i;
+
+    for(i=0;i<64;i++)
+      {
+        if(core->io[i].ctx == &ls->ports[i])
+          {
+            core->io[i] = ls->ports[i].orig;
+          }
+      }
+    for(i=0;i<HC11_EVENT_NUM;i++)
+      {
+        if(core->events[i].ctx == &ls->events[i])
+          {
+            core->events[i].ctx = ls->events[i].ctx;
+            core->events[i].cb  = ls->events[i].cb;
+          }
+      }
+    core->wrhook = NULL;
+    hc11_core_unmap_all(&ls->shadow);
+    free(ls);
+  }
+
+//copy the pages of main memory written since the last instruction
+static void ls_sync_mem(struct hc11_lockstep *ls)
+  {
+    struct hc11_core *core = ls->core;
+    struct hc11_mapping *src;
+    struct hc11_mapping *dst;
+    uint32_t page;
+    uint32_t start;
+    uint32_t end;
+
+    //both lists are in the same order, see hc11_lockstep_create
+    for(src = core->maps, dst = ls->shadow.maps; src && dst; src = src->next, dst = dst->next)
+      {
+        for(page = src->start >> HC11_PAGE_SHIFT;
+            page <= (src->start + src->len - 1) >> HC11_PAGE_SHIFT; page++)
+          {
+            if(!hc11_core_page_dirty(core, page, ls->epoch))
+              {
+                continue;
+              }
+            start = page << HC11_PAGE_SHIFT;
+            end   = start + HC11_PAGE_SIZE;
+            if(start < src->start)
+              {
+                start = src->start;
+              }
+            if(end > src->start + src->len)
+              {
+                end = src->start + src->len;
+              }
+            memcpy(dst->mem + start - src->start, src->mem + start - src->start, end - start);
+          }
+      }
+    ls->epoch = hc11_core_mem_checkpoint(core);
+  }
+
+static void ls_sync(struct hc11_lockstep *ls)
+  {
+    struct hc11_core *core   = ls->core;
+    struct hc11_core *shadow = &ls->shadow;
+
+    ls_sync_mem(ls);
+    memcpy(shadow->iram, core->iram, sizeof(core->iram));
+    memcpy(shadow->break_pc, core->break_pc, sizeof(core->break_pc));
+    shadow->regs        = core->regs;
+    shadow->rambase     = core->rambase;
+    shadow->iobase      = core->iobase;
+    shadow->state       = core->state;
+    shadow->status      = core->status;
+    shadow->irq_pending = core->irq_pending;
+    shadow->busadr      = core->busadr;
+    shadow->busdat      = core->busdat;
+    shadow->prefix      = core->prefix;
+    shadow->opcode      = core->opcode;
+    shadow->stackcnt    = core->stackcnt;
+    shadow->irqvec      = core->irqvec;
+    shadow->pc_opcode   = core->pc_opcode;
+    hc11_core_event_cancel(shadow, ls->irqevent);
+    hc11_core_set_clocks(shadow, core->clocks);
+
+    ls->reads.count     = 0;
+    ls->reads.overflow  = false;
+    ls->readpos         = 0;
+    ls->readbad         = false;
+    ls->writes[0].count = 0;
+    ls->writes[0].overflow = false;
+    ls->writes[1].count = 0;
+    ls->writes[1].overflow = false;
+    ls->nirqs           = 0;
+    ls->nextirq         = 0;
+    ls->lastirq         = core->irq_pending;
+  }
+
+static void ls_regs(const char *who, struct hc11_regs *r, uint64_t clocks)
+  {
+    printf("  %-6s PC=%04X D=%04X X=%04X Y=%04X SP=%04X CCR=%02X clocks=%"PRIu64"\n",
+           who, r->pc, r->d, r->x, r->y, r->sp, r->ccr, clocks);
+  }
+
+static void ls_writes(const char *who, struct ls_log *log)
+  {
+    int i;
+    printf("  %-6s writes:", who);
+    for(i=0;i<log->count;i++)
+      {
+        printf(" %04X<-%02X", log->acc[i].adr, log->acc[i].val);
+      }
+    printf("%s\n", log->overflow ? " ..." : "");
+  }
+
+static void ls_report(struct hc11_lockstep *ls, const char *what)
+  {
+    struct ls_trace *t;
+    char text[48];
+    int i;
+
+    printf("lockstep: %s and %s diverge on %s after %"PRIu64" instructions\n",
+           ls->main->name, ls->check->name, what, ls->count);
+    for(i=0;i<LOCKSTEP_TRACE;i++)
+      {
+        t = &ls->trace[(ls->count + 1 + i) % LOCKSTEP_TRACE];
+        if(t->clocks == 0 && t->pc == 0)
+          {
+            continue;
+          }
+        hc11_disasm(t->code, t->pc, text, sizeof(text));
+        printf("  %c %10"PRIu64" %04X  %-28s D=%04X X=%04X Y=%04X SP=%04X CCR=%02X\n",
+               (i == LOCKSTEP_TRACE - 1) ? '>' : ' ', t->clocks, t->pc, text,
+               t->regs.d, t->regs.x, t->regs.y, t->regs.sp, t->regs.ccr);
+      }
+    ls_regs(ls->main->name , &ls->core->regs , ls->core->clocks);
+    ls_regs(ls->check->name, &ls->shadow.regs, ls->shadow.clocks);
+    ls_writes(ls->main->name , &ls->writes[0]);
+    ls_writes(ls->check->name, &ls->writes[1]);
+  }
+
+int hc11_lockstep_step(struct hc11_lockstep *ls)
+  {
+    struct hc11_core *core   = ls->core;
+    struct hc11_core *shadow = &ls->shadow;
+    struct ls_trace *t = &ls->trace[ls->count % LOCKSTEP_TRACE];
+    int i;
+
+    ls_sync(ls);
+    t->clocks = core->clocks;
+    t->pc     = core->regs.pc;
+    for(i=0;i<HC11_DISASM_MAX;i++)
+      {
+        if(!hc11_core_peekb(core, t->pc + i, &t->code[i]))
+          {
+            t->code[i] = 0xFF;
+          }
+      }
+
+    ls->main->step(core);
+    if(ls->nirqs)
+      {
+        hc11_core_event_schedule(shadow, ls->irqevent, ls->irqs[0].when - shadow->clocks);
+      }
+    ls->check->step(shadow);
+    t->regs = core->regs;
+
+    if(memcmp(&core->regs, &shadow->regs, sizeof(struct hc11_regs)))
+      {
+        ls_report(ls, "registers");
+        return -1;
+      }
+    if(core->clocks != shadow->clocks)
+      {
+        ls_report(ls, "clock count");
+        return -1;
+      }
+    if(ls->writes[0].count != ls->writes[1].count ||
+       memcmp(ls->writes[0].acc, ls->writes[1].acc,
+              ls->writes[0].count * sizeof(struct ls_access)))
+      {
+        ls_report(ls, "memory writes");
+        return -1;
+      }
+    if(ls->readbad || ls->readpos != ls->reads.count)
+      {
+        ls_report(ls, "peripheral reads");
+        return -1;
+      }
+    ls->count++;
+    return 0;
+  }
@@ -0,0 +1,34 @@
+#ifndef __lockstep__h__
+#define __lockstep__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* Differential checking of execution engines. A shadow core runs every
+ * instruction of the main core again with another engine, and registers,
+ * clock count and memory writes are compared at each instruction boundary.
+ * Before each instruction the shadow is brought back to the state of the
+ * main core, so debugger writes, resets and snapshot loads are followed.
+ * Peripherals only exist on the main core: the shadow gets the values the
+ * main core read from them and the interrupt line changes they made.
+ * Start after all peripherals are registered. */
+
+#define LOCKSTEP_TRACE  16 //instructions shown before a divergence
+#define LOCKSTEP_ACCESS 32 //peripheral reads or memory writes per instruction
+
+typedef void (*engine_f)(struct hc11_core *core);
+
+struct hc11_lockstep;
+
+//engines are given as "main,shadow", default "step,clock"
+struct hc11_lockstep *hc11_lockstep_create(struct hc11_core *core, const char *engines);
+void hc11_lockstep_destroy(struct hc11_lockstep *ls);
+
+//run one instruction on both, -1 on divergence after printing a report
+int hc11_lockstep_step(struct hc11_lockstep *ls);
+
+void hc11_lockstep_help(void);
+
+#endif /* __lockstep__h__ */
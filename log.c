@@ -2,41 +2,127 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "core.h"
+#include "log.h"
 
-bool enables[65536];
+void log_init(struct hc11_core *core)
+  {
+    core->logmask = 0;
+    core->logfile = stdout;
+  }
 
-void log_init(void)
+static const char *log_systems[SYS_COUNT] = {"core", "sci", "gdb"};
+
+//per system, NULL for unused subsystems
+static const char *log_subsystems[SYS_COUNT][LOG_SUBSYS] =
   {
-    int i;
-    for(i=0;i<65536;i++)
+    [SYS_CORE] = {"admode", "mem", "inst", "dbg", "error"},
+    [SYS_SCI]  = {"msg"},
+    [SYS_GDB]  = {"conn", "packet", "cmd"},
+  };
+
+static void log_set(struct hc11_core *core, int system, int subsystem, bool on)
+  {
+    int sys;
+    int sub;
+    for(sys=0;sys<SYS_COUNT;sys++)
       {
-        enables[i] = false;
+        if(system != LOG_ALL && system != sys)
+          {
+            continue;
+          }
+        for(sub=0;sub<LOG_SUBSYS;sub++)
+          {
+            if(subsystem == LOG_ALL || subsystem == sub)
+              {
+                if(on)
+                  {
+                    core->logmask |= LOG_BIT(sys, sub);
+                  }
+                else
+                  {
+                    core->logmask &= ~LOG_BIT(sys, sub);
+                  }
+              }
+          }
       }
   }
 
-void log_enable(uint8_t system, uint8_t subsystem)
+void log_enable(struct hc11_core *core, int system, int subsystem)
   {
-    //enables[system<<8+subsystem] = true;
-    int i;
-    for(i=0;i<65536;i++)
+    log_set(core, system, subsystem, true);
+  }
+
+void log_disable(struct hc11_core *core, int system, int subsystem)
+  {
+    log_set(core, system, subsystem, false);
+  }
+
+int log_lookup(const char *name, int *system, int *subsystem)
+  {
+    const char *dot = strchr(name, '.');
+    size_t len = dot ? (size_t)(dot - name) : strlen(name);
+    int sys, sub;
+
+    *system    = LOG_ALL;
+    *subsystem = LOG_ALL;
+    if(!strcmp(name, "all"))
+      {
+        return 0;
+      }
+    for(sys=0;sys<SYS_COUNT;sys++)
+      {
+        if(strlen(log_systems[sys]) == len && !strncmp(name, log_systems[sys], len))
+          {
+            break;
+          }
+      }
+    if(sys == SYS_COUNT)
+      {
+        return -1;
+      }
+    *system = sys;
+    if(!dot)
+      {
+        return 0;
+      }
+    for(sub=0;sub<LOG_SUBSYS;sub++)
       {
-        enables[i] = true;
+        if(log_subsystems[sys][sub] && !strcmp(dot + 1, log_subsystems[sys][sub]))
+          {
+            *subsystem = sub;
+            return 0;
+          }
       }
+    return -1;
   }
 
-void log_msg(uint8_t system, uint8_t subsystem, const char *fmt, ...)
+int log_list(struct hc11_core *core, char *buf, int len)
   {
-    va_list ap;
+    int sys, sub, n = 0;
 
-    if(!enables[system<<8+subsystem])
+    buf[0] = 0;
+    for(sys=0;sys<SYS_COUNT;sys++)
       {
-        return;
+        for(sub=0;sub<LOG_SUBSYS;sub++)
+          {
+            if(log_subsystems[sys][sub] && (core->logmask & LOG_BIT(sys, sub)) && n < len)
+              {
+                n += snprintf(buf + n, len - n, "%s%s.%s", n ? " " : "",
+                              log_systems[sys], log_subsystems[sys][sub]);
+              }
+          }
       }
+    return (n < len) ? n : len - 1;
+  }
+
+void log_printf(struct hc11_core *core, const char *fmt, ...)
+  {
+    va_list ap;
 
     va_start(ap,fmt); 
-    vprintf(fmt,ap);
+    vfprintf(core->logfile,fmt,ap);
     va_end(ap);
   }
-
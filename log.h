@@ -1,11 +1,14 @@
 #ifndef __log__h__
 #define __log__h__
 
+#include "core.h"
+
 enum
   {
   SYS_CORE,
   SYS_SCI,
   SYS_GDB,
+  SYS_COUNT
   };
 
 enum
@@ -17,8 +20,34 @@ enum
   CORE_ERROR,
   };
 
-void log_init(void);
-void log_enable(int system, int subsystem);
-void log_msg(int system, int subsystem, const char *fmt, ...);
+enum
+  {
+  GDB_CONN,   //server and connection life
+  GDB_PACKET, //packets sent and received
+  GDB_CMD,    //command details
+  };
+
+#define LOG_ALL    -1 //as system or subsystem
+#define LOG_SUBSYS 16 //subsystems per system
+
+//Enables are kept per core. The check is done before evaluating the
+//arguments, disabled messages cost nothing in the instruction loop.
+#define LOG_BIT(system, subsystem) (1ULL << ((system) * LOG_SUBSYS + (subsystem)))
+#define log_msg(core, system, subsystem, ...) \
+  do \
+    { \
+      if((core)->logmask & LOG_BIT(system, subsystem)) \
+        log_printf((core), __VA_ARGS__); \
+    } \
+  while(0)
+
+void log_init   (struct hc11_core *core);
+void log_enable (struct hc11_core *core, int system, int subsystem);
+void log_disable(struct hc11_core *core, int system, int subsystem);
+//"all", "core" or "core.inst" to system and subsystem (or LOG_ALL), -1 if unknown
+int  log_lookup (const char *name, int *system, int *subsystem);
+//names of the enabled messages, space separated, returns the length
+int  log_list   (struct hc11_core *core, char *buf, int len);
+void log_printf(struct hc11_core *core, const char *fmt, ...);
 
 #endif /* __log__h__ */
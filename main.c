@@ -11,11 +11,19 @@
 #include <semaphore.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <inttypes.h>
 
 #include "log.h"
 #include "core.h"
 #include "sci.h"
+#include "scibackend.h"
 #include "gdbremote.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "history.h"
+#include "profile.h"
+#include "lockstep.h"
+#include "image.h"
 
 static struct option long_options[] =
   {
@@ -29,56 +37,22 @@ static struct option long_options[] =
     {"preset-mem" , required_argument, 0, 'm' },
     {"run"        , no_argument      , 0, 'r' },
     {"expect-regs", required_argument, 0, 'e' },
+    {"sci-turbo"  , no_argument      , 0, 't' },
+    {"sci"        , required_argument, 0, 'c' },
+    {"record"     , required_argument, 0, 'R' },
+    {"replay"     , required_argument, 0, 'P' },
+    {"load-snapshot", required_argument, 0, 'l' },
+    {"save-snapshot", required_argument, 0, 'S' },
+    {"checkpoint" , required_argument, 0, 'k' },
+    {"history"    , required_argument, 0, 'H' },
+    {"lockstep"   , required_argument, 0, 'L' },
+    {"profile"    , required_argument, 0, 'F' },
 
     {0         , 0                , 0,  0  }
   };
 
 sem_t end;
 
-struct hc11_regs initial_regs;
-static uint8_t* loadbin(const char *fname, uint16_t *size)
-  {
-    FILE *f;
-    uint32_t lsize;
-    uint8_t *blob;
-
-    f = fopen(fname, "rb");
-
-    if(!f)
-      {
-        printf("Unable to open: %s\n",fname);
-        return NULL;
-      }
-
-    fseek(f, 0, SEEK_END);
-    lsize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    if(lsize > 65536)
-      {
-        printf("file %s is too big\n", fname);
-err:
-        fclose(f);
-        return NULL;
-      }
-    blob = malloc(lsize);
-    if(!blob)
-      {
-        printf("cannot alloc mem for %s\n", fname);
-        goto err;
-      }
-    if(fread(blob, 1, lsize, f) != lsize)
-      {
-        printf("cannot read: %s\n", fname);
-        free(blob);
-        goto err;
-      }
-
-    fclose(f);
-    *size = (uint16_t)lsize;
-    return blob;
-  }
-
 void help(void)
   {
     printf("sim -d [-s,--s19 <file>] [-b,--bin <adr,file>] [-w,--writable]\n"
@@ -94,7 +68,25 @@ void help(void)
            "  -m --preset-mem <adr,hex> load hex bytes at specified address\n"
            "  -r --run                  start executing instructions as soon as inits are done\n"
            "  -e --expect-regs          Set expected register values after execution\n"
+           "  -t --sci-turbo            Start with SCI in turbo mode (no baud rate timing)\n"
+           "  -c --sci <backend>        Select SCI host endpoint, default %s\n"
+           "  -R --record <file>        Record external inputs (SCI, debugger) to a journal\n"
+           "  -P --replay <file>        Replay a journal instead of taking external inputs,\n"
+           "                            other options must be the same as when recording\n"
+           "  -l --load-snapshot <file[@n]> Start from a saved machine state, or from\n"
+           "                            frame n (default last) of a checkpoint file\n"
+           "  -k --checkpoint <file,clocks[,keyint]> Append a checkpoint to file every\n"
+           "                            clocks, complete every keyint frames (default %d)\n"
+           "  -S --save-snapshot <file> Save the machine state when the simulation ends\n"
+           "  -H --history <n>          Keep the last n instructions for gdb reverse execution\n"
+           "  -L --lockstep <main,shadow> Check each instruction against a second engine,\n"
+           "                            stop at the first divergence\n"
+           "  -F --profile <file[,symbols]> Profile the firmware, write callgrind output to\n"
+           "                            file at the end, symbols is a file of address name lines\n"
+           "\n", SCI_BACKEND_DEFAULT, SNAPCHAIN_KEYINT
          );
+    sci_backend_help();
+    hc11_lockstep_help();
   }
 
 void version(void)
@@ -108,8 +100,6 @@ void sig(int sig)
     sem_post(&end);
   }
 
-struct hc11_core core;
-
 uint64_t getmicros(void)
   {
   struct timeval tv;
@@ -179,9 +169,9 @@ static int parse_preset_mem(struct hc11_core *core, char *param)
   {
     char *ptr;
     uint16_t adr;
-    uint16_t size;
+    uint32_t size, i;
     int val;
-    uint8_t *bin;
+    uint8_t bin[0x10000];
     ptr = strchr(optarg, ',');
     if(!ptr)
       {
@@ -192,25 +182,29 @@ static int parse_preset_mem(struct hc11_core *core, char *param)
     ptr++;
     adr = (uint16_t)strtoul(optarg, NULL, 0);
     size = strlen(ptr);
-    if(size & 1)
+    if((size & 1) || size/2 > sizeof(bin))
       {
         fprintf(stderr,"bad hex data\n");
         return -1;
       }
+    size /= 2;
 
-    while(size>1)
+    for(i=0;i<size;i++)
       {
         if(sscanf(ptr,"%02X",&val) != 1)
           {
             fprintf(stderr, "bad hex data: %s\n",ptr);
             return -1;
           }
-        hc11_core_writeb(core,adr,val&0xFF);
-        adr  += 1;
-        ptr  += 2;
-        size -= 2;
+        bin[i] = val;
+        ptr += 2;
       }
 
+    if(hc11_core_write_block(core, adr, bin, size) < 0)
+      {
+        fprintf(stderr,"preset data does not fit at %04X\n", adr);
+        return -1;
+      }
     return 0;
   }
 
@@ -267,13 +261,16 @@ static int parse_check_reg(struct hc11_core *core, char *param)
             printf("WARNING REG %s VALUE 0x%04X (%d) EXPECTED 0x%04X (%d)\n",param, real, real, val, val);
           }
       }
+    return check ? 0 : 1;
   }
 
+//returns the number of registers that do not match
 int parse_check_regs(struct hc11_core *core, char *param)
   {
     //split using commas
     char *ptr;
     int   ret;
+    int   failed = 0;
     ptr = param;
     while(*param)
       {
@@ -286,9 +283,21 @@ int parse_check_regs(struct hc11_core *core, char *param)
         ret = parse_check_reg(core,ptr);
         if(ret != 0)
           {
+            failed++;
           }
         ptr = param;
       }
+    return failed;
+  }
+
+//one instruction, -1 if the lockstep engines diverge
+static int step(struct hc11_core *core, struct hc11_lockstep *lockstep)
+  {
+    if(lockstep)
+      {
+        return hc11_lockstep_step(lockstep);
+      }
+    hc11_core_step(core);
     return 0;
   }
 
@@ -321,11 +330,31 @@ int main(int argc, char **argv)
     int prev;
     uint64_t cycles;
     uint64_t micros;
+    uint64_t rtmicros, rtclocks; //realtime mode reference point, 0 to take a new one
     bool debug = false;
     bool dogdb = true;
+    bool sciturbo = false;
+    bool scistdio;
+    char *sciback = NULL;
     char *regcheck = NULL;
-
-    log_init();
+    char *jrnfile = NULL;
+    bool replay = false;
+    struct hc11_journal *journal = NULL;
+    char *snapload = NULL;
+    char *snapsave = NULL;
+    char *ckptfile = NULL;
+    struct hc11_snapchain *chain = NULL;
+    uint64_t ckptclocks = 0;
+    uint64_t ckptnext = 0;
+    unsigned ckptkey = SNAPCHAIN_KEYINT;
+    uint32_t histsteps = 0;
+    char *lsengines = NULL;
+    char *proffile = NULL;
+    char *profsyms = NULL;
+    struct hc11_profile *profile = NULL;
+    struct hc11_lockstep *lockstep = NULL;
+    int failed = 0;
+    struct hc11_core core;
 
     sem_init(&end,0,0);
     memset(&sa_mine, 0, sizeof(struct sigaction));
@@ -336,11 +365,14 @@ int main(int argc, char **argv)
     hc11_core_reset(&core);
 
     //map 32k of RAM in the first half of the address space
-    hc11_core_map_ram(&core, "ram", 0x0000, 0x8000); //100h bytes masked by internal mem
+    if(hc11_core_map_ram(&core, "ram", 0x0000, 0x8000) < 0) //100h bytes masked by internal mem
+      {
+        return -1;
+      }
     while (1)
       {
         int option_index = 0;
-        c = getopt_long(argc, argv, "b:s:wdp:m:re:gv", long_options, &option_index);
+        c = getopt_long(argc, argv, "b:s:wdp:m:re:gvtc:R:P:l:S:k:H:L:F:", long_options, &option_index);
         if (c == -1)
           {
             break;
@@ -348,7 +380,7 @@ int main(int argc, char **argv)
         switch (c)
           {
             case 'd':
-              log_enable(0,0);
+              log_enable(&core, LOG_ALL, LOG_ALL);
               debug = true;
               break;
 
@@ -358,8 +390,7 @@ int main(int argc, char **argv)
               {
                 char *ptr;
                 uint16_t adr;
-                uint16_t size;
-                uint8_t *bin;
+                struct hc11_image *img;
                 ptr = strchr(optarg, ',');
                 if(!ptr)
                   {
@@ -369,20 +400,25 @@ int main(int argc, char **argv)
                 *ptr = 0;
                 ptr++;
                 printf("map something: file %s @ %s\n", ptr, optarg);
-                bin = loadbin(ptr,&size);
-                if(!bin)
+                //shared with every other simulator mapping the same file
+                img = hc11_image_open(ptr);
+                adr = (uint16_t)strtoul(optarg, NULL, 0);
+                if(!img || hc11_core_map_image(&core, "rom", adr, img, false) < 0)
                   {
                     printf("map failed\n");
                     return -1;
                   }
-                adr = (uint16_t)strtoul(optarg, NULL, 0);
-                hc11_core_map_rom(&core, "rom", adr, size, bin);
+                hc11_image_close(img);
                 break;
               }
 
             case 'w':
               {
-                hc11_core_map_ram(&core, "rom", 0xE000, 0x2000);
+                if(hc11_core_map_ram(&core, "rom", 0xE000, 0x2000) < 0)
+                  {
+                    printf("map failed\n");
+                    return -1;
+                  }
                 break;
               }
             case 's':
@@ -411,7 +447,7 @@ int main(int argc, char **argv)
             case 'r': //--run
               {
                 core.status = STATUS_RUNNING;
-                core.state  = 2; //set core to the FETCH state, avoiding any vector fetch
+                hc11_core_jump(&core, core.regs.pc); //avoid any vector fetch
                 break;
               }
             case 'e': //--expect-regs
@@ -419,6 +455,65 @@ int main(int argc, char **argv)
                 regcheck = optarg;
                 break;
               }
+            case 't': //--sci-turbo
+              {
+                sciturbo = true;
+                break;
+              }
+            case 'c': //--sci
+              {
+                sciback = optarg;
+                break;
+              }
+            case 'R': //--record
+            case 'P': //--replay
+              {
+                jrnfile = optarg;
+                replay  = (c == 'P');
+                break;
+              }
+            case 'l': //--load-snapshot
+              {
+                snapload = optarg;
+                break;
+              }
+            case 'S': //--save-snapshot
+              {
+                snapsave = optarg;
+                break;
+              }
+            case 'H': //--history
+              {
+                histsteps = strtoul(optarg, NULL, 0);
+                break;
+              }
+            case 'L': //--lockstep
+              {
+                lsengines = optarg;
+                break;
+              }
+            case 'F': //--profile
+              {
+                proffile = optarg;
+                break;
+              }
+            case 'k': //--checkpoint
+              {
+                char *ptr = strchr(optarg, ',');
+                if(!ptr)
+                  {
+                    fprintf(stderr,"--checkpoint file,clocks[,keyint]\n");
+                    return -1;
+                  }
+                *ptr++ = 0;
+                ckptfile   = optarg;
+                ckptclocks = strtoull(ptr, &ptr, 0);
+                if(*ptr == ',')
+                  {
+                    ckptkey = strtoul(ptr+1, NULL, 0);
+                  }
+                break;
+              }
             case '?':
               {
                 help();
@@ -442,16 +537,108 @@ int main(int argc, char **argv)
         printf("\n");
       }
 
-    sci = hc11_sci_init(&core);
+    //before any peripheral, so that replayed inputs are applied first in each clock
+    if(jrnfile)
+      {
+        journal = hc11_journal_open(&core, jrnfile, replay);
+        if(!journal)
+          {
+            return -1;
+          }
+        if(replay && !dogdb)
+          {
+            core.status = STATUS_RUNNING;
+          }
+      }
+
+    scistdio = sciback && !strcmp(sciback, "stdio"); //speed display would mix with SCI output
+    sci = hc11_sci_init(&core, sciback);
+    if(!sci)
+      {
+        fprintf(stderr, "cannot start SCI\n");
+        return -1;
+      }
+    if(sci && sciturbo)
+      {
+        hc11_sci_set_turbo(sci, true);
+      }
+
+    //all peripherals must exist before their state is restored
+    if(snapload)
+      {
+        char *frame = strrchr(snapload, '@');
+        if(frame)
+          {
+            *frame++ = 0;
+            val = hc11_snapchain_read(&core, snapload, atoi(frame));
+          }
+        else
+          {
+            val = hc11_snapshot_read(&core, snapload);
+          }
+        if(val < 0)
+          {
+            fprintf(stderr, "cannot load snapshot %s\n", snapload);
+            hc11_sci_close(sci);
+            return -1;
+          }
+      }
+
+    if(ckptfile)
+      {
+        chain = hc11_snapchain_create(&core, ckptfile, ckptkey);
+        if(!chain)
+          {
+            hc11_sci_close(sci);
+            return -1;
+          }
+        ckptnext = core.clocks;
+      }
+
+    if(histsteps && !hc11_history_create(&core, histsteps))
+      {
+        hc11_sci_close(sci);
+        return -1;
+      }
+
+    if(proffile)
+      {
+        profsyms = strchr(proffile, ',');
+        if(profsyms)
+          {
+            *profsyms++ = 0;
+          }
+        profile = hc11_profile_create(&core);
+        if(!profile || (profsyms && hc11_profile_symbols(profile, profsyms) < 0))
+          {
+            hc11_sci_close(sci);
+            return -1;
+          }
+      }
+
+    //wraps the peripherals, so it comes last
+    if(lsengines)
+      {
+        lockstep = hc11_lockstep_create(&core, lsengines);
+        if(!lockstep)
+          {
+            hc11_sci_close(sci);
+            return -1;
+          }
+      }
 
     if(dogdb)
       {
         remote.port = 3333;
         remote.core = &core;
+        remote.sci  = sci;
+        remote.profile = profile;
         gdbremote_init(&remote);
       }
 
     prev = -1;
+    rtmicros = 0;
+    rtclocks = 0;
     cycles = 0;
     micros = getmicros();
     while(1)
@@ -463,7 +650,7 @@ int main(int argc, char **argv)
             uint64_t deltacycles = core.clocks - cycles;
             cycles = core.clocks;
             micros = newmicros;
-            if((core.status == STATUS_RUNNING) && !debug)
+            if((core.status == STATUS_RUNNING) && !debug && !scistdio)
               {
                 printf("Running at %.3f MHz     \r", (double)deltacycles/(double)deltatime);
               }
@@ -475,6 +662,12 @@ int main(int argc, char **argv)
             break;
           }
 
+        //debugger commands run between instructions
+        if(dogdb)
+          {
+            gdbremote_service(&remote);
+          }
+
         if(prev != core.status)
           {
             if(debug) printf("status: %d -> %d\n", prev, core.status);
@@ -490,21 +683,82 @@ int main(int argc, char **argv)
             prev = core.status;
           }
 
-        if(core.status == STATUS_STEPPING)
+        //realtime mode: do not run ahead of the wall clock
+        if(dogdb && remote.realtime && core.status == STATUS_RUNNING)
           {
-            printf("doing a step\n");
-            hc11_core_step(&core);
+            int64_t ahead;
+            if(!rtmicros)
+              {
+                rtmicros = newmicros;
+                rtclocks = core.clocks;
+              }
+            ahead = (int64_t)((core.clocks - rtclocks) * 1000000 / HC11_ECLOCK) -
+                    (int64_t)(newmicros - rtmicros);
+            if(ahead >= 1000)
+              {
+                gdbremote_wait(&remote, ahead / 1000); //commands still wake us up
+                continue;
+              }
+            if(ahead < -100000)
+              {
+                rtmicros = 0; //host too slow, do not catch up in a burst
+              }
+          }
+        else
+          {
+            rtmicros = 0;
+          }
+
+        if(hc11_journal_finished(&core) &&
+           (core.status == STATUS_RUNNING || core.status == STATUS_STEPPING))
+          {
+            printf("end of journal at clock %"PRIu64"\n", core.clocks);
+            if(!dogdb)
+              {
+                sem_post(&end);
+                break;
+              }
+            core.status = STATUS_STOPPED;
+          }
+        else if(core.status == STATUS_STEPPING)
+          {
+            if(debug) printf("doing a step\n");
+            if(step(&core, lockstep) < 0)
+              {
+                failed = 1;
+              }
             if(debug) show_regs(&core);
             core.status = STATUS_STOPPED;
           }
         else if(core.status == STATUS_RUNNING)
           {
-            hc11_core_step(&core);
+            if(step(&core, lockstep) < 0)
+              {
+                failed = 1;
+                core.status = STATUS_STOPPED;
+                if(!dogdb)
+                  {
+                    sem_post(&end);
+                    break;
+                  }
+              }
             if(debug) show_regs(&core);
           }
+        else if(core.status == STATUS_STOPPED && journal && replay && !dogdb)
+          {
+            //nobody to resume the core: stops do not take clocks, keep going
+            core.status = STATUS_RUNNING;
+          }
         else if(core.status == STATUS_STOPPED)
           {
-              usleep(10000);
+            if(dogdb)
+              {
+                gdbremote_wait(&remote, 10);
+              }
+            else
+              {
+                usleep(10000);
+              }
           }
         else if(core.status == STATUS_EXECUTED_STOP)
           {
@@ -512,12 +766,19 @@ int main(int argc, char **argv)
             sem_post(&end);
             break;
           }
+
+        //only at instruction boundaries
+        if(chain && core.clocks >= ckptnext)
+          {
+            hc11_snapchain_append(chain);
+            ckptnext = core.clocks + ckptclocks;
+          }
       }
 
     //If register check was selected, parse and compare regs
     if(regcheck)
       {
-        parse_check_regs(&core, regcheck);
+        failed += parse_check_regs(&core, regcheck);
       }
 
     sem_getvalue(&end, &val);
@@ -529,11 +790,37 @@ int main(int argc, char **argv)
     if(dogdb)
       {
         gdbremote_close(&remote);
+        profile = remote.profile; //may have been started from gdb
+      }
+    if(profile)
+      {
+        if(proffile)
+          {
+            hc11_profile_callgrind(profile, proffile);
+          }
+        hc11_profile_destroy(profile);
+      }
+    if(snapsave)
+      {
+        hc11_snapshot_write(&core, snapsave);
+      }
+    if(chain)
+      {
+        hc11_snapchain_close(chain);
+      }
+    if(lockstep)
+      {
+        hc11_lockstep_destroy(lockstep);
       }
     hc11_sci_close(sci);
+    if(journal)
+      {
+        hc11_journal_close(journal);
+      }
     if(debug)
       {
         hc11_core_istats(stdout, &core);
       }
+    return failed ? 1 : 0;
   }
 
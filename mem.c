@@ -3,9 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "core.h"
 #include "log.h"
+#include "history.h"
+#include "image.h"
 
 static uint8_t ram_read(void *ctx, uint16_t off)
   {
@@ -24,7 +27,7 @@ uint8_t hc11_core_readb(struct hc11_core *core, uint16_t adr)
     struct hc11_mapping *cur;
     uint8_t ret;
 
-    log_msg(SYS_CORE, CORE_MEM, "[%8ld] ", core->clocks); fflush(stdout);
+    log_msg(core, SYS_CORE, CORE_MEM, "[%8ld] ", core->clocks);
     //prio: fist IO, then internal mem [ram], then ext mem [maps]
     if(adr >= core->iobase && adr < (core->iobase + 0x40))
       {
@@ -33,7 +36,7 @@ uint8_t hc11_core_readb(struct hc11_core *core, uint16_t adr)
         if(reg->rdf != NULL)
           {
             ret = reg->rdf(reg->ctx, adr - core->iobase);
-            log_msg(SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [reg] rdf=%p\n", adr, ret, reg->rdf);
+            log_msg(core, SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [reg] rdf=%p\n", adr, ret, reg->rdf);
             return ret;
           }
       }
@@ -42,7 +45,7 @@ uint8_t hc11_core_readb(struct hc11_core *core, uint16_t adr)
     if(adr >= core->rambase && adr < (core->rambase + 256))
       {
         ret = core->iram[adr - core->rambase];
-        log_msg(SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [iram]\n", adr, ret);
+        log_msg(core, SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [iram]\n", adr, ret);
         return ret;
       }
 
@@ -52,14 +55,14 @@ uint8_t hc11_core_readb(struct hc11_core *core, uint16_t adr)
         if(adr >= cur->start && adr < (cur->start + cur->len))
           {
             ret = cur->rdf(cur->ctx, adr - cur->start);
-            log_msg(SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [xmem/%s]\n", adr, ret, cur->name);
+            log_msg(core, SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> %02X [xmem/%s]\n", adr, ret, cur->name);
             return ret;
           }
         cur = cur->next;
       }
 
     //not io, not iram -> find adr in mappings
-    log_msg(SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> 0xFF [none]\n", adr);
+    log_msg(core, SYS_CORE, CORE_MEM, "READ  @ 0x%04X -> 0xFF [none]\n", adr);
     return 0xFF;
   }
 
@@ -67,15 +70,25 @@ void hc11_core_writeb(struct hc11_core *core, uint16_t adr,
                                 uint8_t val)
   {
     struct hc11_mapping *cur;
+    uint8_t old;
 
-    log_msg(SYS_CORE, CORE_MEM, "[%8ld] ", core->clocks); fflush(stdout);
+    core->page_epoch[adr >> HC11_PAGE_SHIFT] = core->mem_epoch;
+    if(core->history && hc11_core_peekb(core, adr, &old))
+      {
+        hc11_history_write(core->history, adr, old);
+      }
+    if(core->wrhook)
+      {
+        core->wrhook(core->wrhook_ctx, adr, val);
+      }
+    log_msg(core, SYS_CORE, CORE_MEM, "[%8ld] ", core->clocks);
     if(adr >= core->iobase && adr < core->iobase + 0x40)
       {
         //reading a reg
         struct hc11_io *reg = &core->io[adr - core->iobase];
         if(reg->wrf != NULL)
           {
-            log_msg(SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [reg] wrf=%p\n", adr, val, reg->wrf);
+            log_msg(core, SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [reg] wrf=%p\n", adr, val, reg->wrf);
             reg->wrf(reg->ctx, adr - core->iobase, val);
             return;
           }
@@ -84,7 +97,7 @@ void hc11_core_writeb(struct hc11_core *core, uint16_t adr,
     //not reading a reg. try iram
     if(adr >= core->rambase && adr < core->rambase + 256)
       {
-        log_msg(SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [iram]\n", adr, val);
+        log_msg(core, SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [iram]\n", adr, val);
         core->iram[adr - core->rambase] = val;
         return;
       }
@@ -96,33 +109,333 @@ void hc11_core_writeb(struct hc11_core *core, uint16_t adr,
           {
             if(cur->wrf)
               {
-                log_msg(SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [xmem/%s]\n", adr, val, cur->name);
+                log_msg(core, SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [xmem/%s]\n", adr, val, cur->name);
                 cur->wrf(cur->ctx, adr - cur->start, val);
               }
             else
               {
-                log_msg(SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [ro/%s]\n", adr, val, cur->name);
+                log_msg(core, SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [ro/%s]\n", adr, val, cur->name);
               }
             return;
           }
         cur = cur->next;
       }
 
-    log_msg(SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [none]\n", adr, val);
+    log_msg(core, SYS_CORE, CORE_MEM, "WRITE @ 0x%04X <- %02X [none]\n", adr, val);
+  }
+
+uint8_t hc11_core_debug_readb(struct hc11_core *core, uint16_t adr)
+  {
+    struct hc11_mapping *cur;
+
+    if(adr >= core->iobase && adr < (core->iobase + 0x40))
+      {
+        struct hc11_io *reg = &core->io[adr - core->iobase];
+        if(reg->dbgrdf != NULL)
+          {
+            return reg->dbgrdf(reg->ctx, adr - core->iobase);
+          }
+        if(reg->rdf != NULL)
+          {
+            return reg->rdf(reg->ctx, adr - core->iobase);
+          }
+      }
+    if(adr >= core->rambase && adr < (core->rambase + 256))
+      {
+        return core->iram[adr - core->rambase];
+      }
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(adr >= cur->start && adr < (cur->start + cur->len))
+          {
+            return cur->dbgrdf ? cur->dbgrdf(cur->ctx, adr - cur->start)
+                               : cur->rdf(cur->ctx, adr - cur->start);
+          }
+      }
+    return 0xFF;
+  }
+
+//registers and callback mappings without a debug writer take a bus write
+void hc11_core_debug_writeb(struct hc11_core *core, uint16_t adr, uint8_t val)
+  {
+    struct hc11_mapping *cur;
+
+    if(adr >= core->iobase && adr < (core->iobase + 0x40))
+      {
+        struct hc11_io *reg = &core->io[adr - core->iobase];
+        if(reg->dbgwrf != NULL)
+          {
+            log_msg(core, SYS_CORE, CORE_MEM, "DEBUG WRITE @ 0x%04X <- %02X [reg]\n", adr, val);
+            reg->dbgwrf(reg->ctx, adr - core->iobase, val);
+            return;
+          }
+        if(reg->wrf != NULL)
+          {
+            hc11_core_writeb(core, adr, val);
+            return;
+          }
+      }
+    if(!(adr >= core->rambase && adr < (core->rambase + 256)))
+      {
+        for(cur = core->maps; cur != NULL; cur = cur->next)
+          {
+            if(adr >= cur->start && adr < (cur->start + cur->len))
+              {
+                if(cur->dbgwrf && !cur->mem)
+                  {
+                    log_msg(core, SYS_CORE, CORE_MEM, "DEBUG WRITE @ 0x%04X <- %02X [xmem/%s]\n", adr, val, cur->name);
+                    cur->dbgwrf(cur->ctx, adr - cur->start, val);
+                    core->page_epoch[adr >> HC11_PAGE_SHIFT] = core->mem_epoch;
+                    return;
+                  }
+                break;
+              }
+          }
+      }
+    hc11_core_write_block(core, adr, &val, 1);
+  }
+
+//find the byte backing an address, NULL for registers and callbacks
+static uint8_t *mem_direct(struct hc11_core *core, uint16_t adr)
+  {
+    struct hc11_mapping *cur;
+
+    if(adr >= core->iobase && adr < core->iobase + 0x40 &&
+       (core->io[adr - core->iobase].rdf || core->io[adr - core->iobase].wrf))
+      {
+        return NULL;
+      }
+    if(adr >= core->rambase && adr < core->rambase + 256)
+      {
+        return &core->iram[adr - core->rambase];
+      }
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(adr >= cur->start && adr < (cur->start + cur->len))
+          {
+            return cur->mem ? &cur->mem[adr - cur->start] : NULL;
+          }
+      }
+    return NULL;
+  }
+
+bool hc11_core_peekb(struct hc11_core *core, uint16_t adr, uint8_t *val)
+  {
+    uint8_t *ptr = mem_direct(core, adr);
+    if(!ptr)
+      {
+        return false;
+      }
+    *val = *ptr;
+    return true;
   }
 
-void hc11_core_map(struct hc11_core *core, const char *name, uint16_t start,
-                   uint16_t count, void *ctx, read_f rd, write_f wr)
+bool hc11_core_pokeb(struct hc11_core *core, uint16_t adr, uint8_t val)
+  {
+    uint8_t *ptr = mem_direct(core, adr);
+    if(!ptr)
+      {
+        return false;
+      }
+    *ptr = val;
+    core->page_epoch[adr >> HC11_PAGE_SHIFT] = core->mem_epoch;
+    return true;
+  }
+
+//like mem_direct, also returns in len how many bytes from adr resolve the
+//same way, up to the next register block, internal RAM or mapping boundary
+static uint8_t *mem_span(struct hc11_core *core, uint16_t adr, uint32_t *len)
+  {
+    struct hc11_mapping *cur;
+    uint32_t end = 0x10000;
+    uint8_t *ptr = NULL;
+
+    if(adr >= core->iobase && adr < core->iobase + 0x40)
+      {
+        //registers are handled one at a time
+        *len = 1;
+        return mem_direct(core, adr);
+      }
+    if(core->iobase > adr)
+      {
+        end = core->iobase;
+      }
+    if(adr >= core->rambase && adr < core->rambase + 256)
+      {
+        if(core->rambase + 256 < end)
+          {
+            end = core->rambase + 256;
+          }
+        *len = end - adr;
+        return &core->iram[adr - core->rambase];
+      }
+    if(core->rambase > adr && core->rambase < end)
+      {
+        end = core->rambase;
+      }
+    //the first mapping containing an address wins, so a run also ends
+    //where a mapping listed before the one holding adr begins
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(adr >= cur->start && adr < (cur->start + cur->len))
+          {
+            if(cur->start + cur->len < end)
+              {
+                end = cur->start + cur->len;
+              }
+            ptr = cur->mem ? &cur->mem[adr - cur->start] : NULL;
+            break;
+          }
+        if(cur->start > adr && cur->start < end)
+          {
+            end = cur->start;
+          }
+      }
+    *len = end - adr;
+    return ptr;
+  }
+
+//copy len bytes starting at adr. RAM and ROM are copied from their backing
+//stores, registers and callback mappings are read one byte at a time.
+static int mem_read_block(struct hc11_core *core, uint16_t adr, uint8_t *buf, uint32_t len,
+                          bool debug)
+  {
+    uint32_t pos = adr;
+    uint32_t run, i;
+    uint8_t *ptr;
+
+    if(len > 0x10000 - adr)
+      {
+        return -1;
+      }
+    while(len)
+      {
+        ptr = mem_span(core, pos, &run);
+        if(run > len)
+          {
+            run = len;
+          }
+        if(ptr)
+          {
+            memcpy(buf, ptr, run);
+          }
+        else
+          {
+            for(i=0;i<run;i++)
+              {
+                buf[i] = debug ? hc11_core_debug_readb(core, pos + i)
+                               : hc11_core_readb(core, pos + i);
+              }
+          }
+        buf += run;
+        pos += run;
+        len -= run;
+      }
+    return 0;
+  }
+
+//store len bytes starting at adr, for loaders and debuggers. Unlike
+//hc11_core_writeb this also changes ROM. The history and the write hook
+//still see every byte.
+static int mem_write_block(struct hc11_core *core, uint16_t adr, const uint8_t *buf, uint32_t len,
+                           bool debug)
+  {
+    uint32_t pos = adr;
+    uint32_t run, i;
+    uint8_t *ptr;
+
+    if(len > 0x10000 - adr)
+      {
+        return -1;
+      }
+    while(len)
+      {
+        ptr = mem_span(core, pos, &run);
+        if(run > len)
+          {
+            run = len;
+          }
+        if(ptr)
+          {
+            for(i=0;i<run;i++)
+              {
+                if(core->history)
+                  {
+                    hc11_history_write(core->history, pos + i, ptr[i]);
+                  }
+                if(core->wrhook)
+                  {
+                    core->wrhook(core->wrhook_ctx, pos + i, buf[i]);
+                  }
+              }
+            log_msg(core, SYS_CORE, CORE_MEM, "[%8ld] WRITE @ 0x%04X <- %u bytes [block]\n",
+                    core->clocks, pos, run);
+            memcpy(ptr, buf, run);
+            hc11_core_mem_touch(core, pos, run);
+          }
+        else
+          {
+            for(i=0;i<run;i++)
+              {
+                if(debug)
+                  {
+                    hc11_core_debug_writeb(core, pos + i, buf[i]);
+                  }
+                else
+                  {
+                    hc11_core_writeb(core, pos + i, buf[i]);
+                  }
+              }
+          }
+        buf += run;
+        pos += run;
+        len -= run;
+      }
+    return 0;
+  }
+
+int hc11_core_read_block(struct hc11_core *core, uint16_t adr, uint8_t *buf, uint32_t len)
+  {
+    return mem_read_block(core, adr, buf, len, false);
+  }
+
+int hc11_core_write_block(struct hc11_core *core, uint16_t adr, const uint8_t *buf, uint32_t len)
+  {
+    return mem_write_block(core, adr, buf, len, false);
+  }
+
+int hc11_core_debug_read_block(struct hc11_core *core, uint16_t adr, uint8_t *buf, uint32_t len)
+  {
+    return mem_read_block(core, adr, buf, len, true);
+  }
+
+int hc11_core_debug_write_block(struct hc11_core *core, uint16_t adr, const uint8_t *buf, uint32_t len)
+  {
+    return mem_write_block(core, adr, buf, len, true);
+  }
+
+struct hc11_mapping *hc11_core_map(struct hc11_core *core, const char *name,
+                                   uint16_t start, uint16_t count,
+                                   void *ctx, read_f rd, write_f wr)
   {
     struct hc11_mapping *map = malloc(sizeof(struct hc11_mapping));
     struct hc11_mapping *cur, *next;
 
+    if(!map)
+      {
+        printf("cannot allocate mapping %s\n", name);
+        return NULL;
+      }
     map->next  = NULL;
     map->start = start;
     map->len   = count;
     map->ctx   = ctx;
     map->rdf   = rd;
     map->wrf   = wr;
+    map->dbgrdf = NULL;
+    map->dbgwrf = NULL;
+    map->mem   = NULL;
+    map->maplen = 0;
     strncpy(map->name, name, sizeof(map->name));
     map->name[sizeof(map->name)-1] = 0;
 
@@ -130,13 +443,13 @@ void hc11_core_map(struct hc11_core *core, const char *name, uint16_t start,
     if(!cur)
       {
         core->maps = map;
-        return;
+        return map;
       }
     else if(start < cur->start)
       {
         map->next = cur;
         core->maps = map;
-        return;
+        return map;
       }
 
     while(cur != NULL)
@@ -149,22 +462,124 @@ void hc11_core_map(struct hc11_core *core, const char *name, uint16_t start,
           }
         cur = cur->next;
       }
+    return map;
   }
 
-void hc11_core_map_ram(struct hc11_core *core, const char *name, uint16_t start,
-                          uint16_t count)
+int hc11_core_map_ram(struct hc11_core *core, const char *name, uint16_t start,
+                      uint16_t count)
   {
+    struct hc11_mapping *map;
     uint8_t *ram;
-    ram = malloc(count);
-    memset(ram,0,count);
-    log_msg(SYS_CORE, CORE_MEM, "Mapping %d bytes of RAM at address %04Xh\n", count, start);
-    hc11_core_map(core, name, start, count, ram, ram_read, ram_write);
+    //zero pages only take memory once written
+    ram = mmap(NULL, count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ram == MAP_FAILED)
+      {
+        perror("ram mmap");
+        return -1;
+      }
+    log_msg(core, SYS_CORE, CORE_MEM, "Mapping %d bytes of RAM at address %04Xh\n", count, start);
+    map = hc11_core_map(core, name, start, count, ram, ram_read, ram_write);
+    if(!map)
+      {
+        munmap(ram, count);
+        return -1;
+      }
+    map->mem    = ram;
+    map->maplen = count;
+    return 0;
   }
 
-void hc11_core_map_rom(struct hc11_core *core, const char *name, uint16_t start,
-                       uint16_t count, uint8_t *rom)
+//rom is freed with the mapping, but stays with the caller if this fails
+int hc11_core_map_rom(struct hc11_core *core, const char *name, uint16_t start,
+                      uint16_t count, uint8_t *rom)
   {
-    hc11_core_map(core, name, start, count, rom, ram_read, NULL);
+    struct hc11_mapping *map;
+    map = hc11_core_map(core, name, start, count, rom, ram_read, NULL);
+    if(!map)
+      {
+        return -1;
+      }
+    map->mem = rom;
+    return 0;
+  }
+
+//copy-on-write view of a shared image, as ROM or initialised RAM
+int hc11_core_map_image(struct hc11_core *core, const char *name, uint16_t start,
+                        struct hc11_image *img, bool writable)
+  {
+    struct hc11_mapping *map;
+    uint32_t len = hc11_image_len(img);
+    uint8_t *mem;
+
+    if(start + len > 0x10000 || len > 0xFFFF)
+      {
+        printf("image %s does not fit at %04X\n", name, start);
+        return -1;
+      }
+    mem = hc11_image_map(img);
+    if(!mem)
+      {
+        return -1;
+      }
+    log_msg(core, SYS_CORE, CORE_MEM, "Mapping %d bytes of shared %s at address %04Xh\n",
+            len, writable ? "RAM" : "ROM", start);
+    map = hc11_core_map(core, name, start, len, mem, ram_read, writable ? ram_write : NULL);
+    if(!map)
+      {
+        munmap(mem, len);
+        return -1;
+      }
+    map->mem    = mem;
+    map->maplen = len;
+    return 0;
+  }
+
+//remove all mappings. The ram and rom backing stores belong to the core and
+//are freed, contexts of other mappings belong to whoever mapped them.
+void hc11_core_unmap_all(struct hc11_core *core)
+  {
+    struct hc11_mapping *next;
+
+    while(core->maps)
+      {
+        next = core->maps->next;
+        if(core->maps->maplen)
+          {
+            munmap(core->maps->mem, core->maps->maplen);
+          }
+        else
+          {
+            free(core->maps->mem);
+          }
+        free(core->maps);
+        core->maps = next;
+      }
+  }
+
+//start a new memory epoch. Pages written from now on are dirty for the
+//returned checkpoint, see hc11_core_page_dirty.
+uint32_t hc11_core_mem_checkpoint(struct hc11_core *core)
+  {
+    return core->mem_epoch++;
+  }
+
+bool hc11_core_page_dirty(struct hc11_core *core, uint16_t page, uint32_t since)
+  {
+    return core->page_epoch[page] > since;
+  }
+
+//mark memory changed without going through hc11_core_writeb
+void hc11_core_mem_touch(struct hc11_core *core, uint16_t adr, uint32_t len)
+  {
+    uint32_t page;
+    if(len == 0)
+      {
+        return;
+      }
+    for(page = adr >> HC11_PAGE_SHIFT; page <= (adr + len - 1) >> HC11_PAGE_SHIFT; page++)
+      {
+        core->page_epoch[page] = core->mem_epoch;
+      }
   }
 
 void hc11_core_iocallback(struct hc11_core *core, uint8_t off, uint8_t count,
@@ -180,3 +595,15 @@ void hc11_core_iocallback(struct hc11_core *core, uint8_t off, uint8_t count,
       }
   }
 
+void hc11_core_iodebug(struct hc11_core *core, uint8_t off, uint8_t count,
+                       read_f rd, write_f wr)
+  {
+    uint8_t i;
+    for(i=0;i<count;i++)
+      {
+        core->io[off].dbgrdf = rd;
+        core->io[off].dbgwrf = wr;
+        off++;
+      }
+  }
+
@@ -0,0 +1,336 @@
+/* firmware profiler with callgrind output */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "core.h"
+#include "profile.h"
+#include "log.h"
+
+#define ENTRY_NONE UINT64_MAX //call made while not collecting
+
+struct profile_edge
+  {
+    bool     used;
+    uint16_t from; //call site
+    uint16_t to;   //callee
+    uint64_t calls;
+    uint64_t clocks; //inclusive
+    uint64_t instr;
+  };
+
+struct profile_sym
+  {
+    uint16_t adr;
+    char     name[PROFILE_NAME];
+  };
+
+struct hc11_profile
+  {
+    struct hc11_core   *core;
+    uint64_t            clocks[0x10000]; //self cost per pc
+    uint64_t            count [0x10000];
+    uint64_t            instr;           //total, for inclusive costs
+    //clocks and instructions when each shadow stack frame was entered
+    uint64_t            entry_clocks[HC11_CALL_NUM];
+    uint64_t            entry_instr [HC11_CALL_NUM];
+    uint32_t            pending; //depth + 1 of a call whose instruction is not done
+    struct profile_edge edges[PROFILE_EDGES];
+    uint32_t            lost; //returns not recorded, edge table full
+    struct profile_sym *syms;
+    uint32_t            nsyms;
+  };
+
+struct hc11_profile *hc11_profile_create(struct hc11_core *core)
+  {
+    struct hc11_profile *prof;
+
+    prof = malloc(sizeof(struct hc11_profile));
+    if(!prof)
+      {
+        printf("profile: cannot allocate\n");
+        return NULL;
+      }
+    prof->core  = core;
+    prof->syms  = NULL;
+    prof->nsyms = 0;
+    hc11_profile_clear(prof);
+    hc11_profile_attach(prof, true);
+    return prof;
+  }
+
+void hc11_profile_destroy(struct hc11_profile *prof)
+  {
+    hc11_profile_attach(prof, false);
+    free(prof->syms);
+    free(prof);
+  }
+
+void hc11_profile_clear(struct hc11_profile *prof)
+  {
+    memset(prof->clocks, 0, sizeof(prof->clocks));
+    memset(prof->count , 0, sizeof(prof->count));
+    memset(prof->edges , 0, sizeof(prof->edges));
+    prof->instr   = 0;
+    prof->lost    = 0;
+    prof->pending = 0;
+  }
+
+void hc11_profile_attach(struct hc11_profile *prof, bool on)
+  {
+    int i;
+    if(on && prof->core->profile != prof)
+      {
+        //frames already on the stack have no entry cost
+        for(i=0;i<HC11_CALL_NUM;i++)
+          {
+            prof->entry_clocks[i] = ENTRY_NONE;
+          }
+        prof->core->profile = prof;
+      }
+    else if(!on && prof->core->profile == prof)
+      {
+        prof->core->profile = NULL;
+      }
+  }
+
+void hc11_profile_step(struct hc11_profile *prof, uint16_t pc, uint32_t clocks)
+  {
+    prof->clocks[pc] += clocks;
+    prof->count[pc]  += 1;
+    prof->instr      += 1;
+    if(prof->pending)
+      {
+        //the call instruction is part of the caller cost, the callee starts now
+        prof->entry_clocks[prof->pending - 1] = prof->core->clocks;
+        prof->entry_instr [prof->pending - 1] = prof->instr;
+        prof->pending = 0;
+      }
+  }
+
+void hc11_profile_call(struct hc11_profile *prof, uint32_t depth)
+  {
+    prof->pending = depth + 1;
+  }
+
+void hc11_profile_return(struct hc11_profile *prof, const struct hc11_call *call, uint32_t depth)
+  {
+    struct profile_edge *e;
+    uint32_t key = (uint32_t)call->from << 16 | call->to;
+    uint32_t i, n;
+
+    if(prof->entry_clocks[depth] == ENTRY_NONE)
+      {
+        return;
+      }
+    i = (key * 2654435761u) % PROFILE_EDGES;
+    for(n = 0; n < PROFILE_EDGES; n++, i = (i + 1) % PROFILE_EDGES)
+      {
+        e = &prof->edges[i];
+        if(!e->used)
+          {
+            e->used = true;
+            e->from = call->from;
+            e->to   = call->to;
+          }
+        if(e->from == call->from && e->to == call->to)
+          {
+            e->calls  += 1;
+            e->clocks += prof->core->clocks - prof->entry_clocks[depth];
+            e->instr  += prof->instr + 1 - prof->entry_instr[depth]; //with the return
+            prof->entry_clocks[depth] = ENTRY_NONE;
+            return;
+          }
+      }
+    prof->lost++;
+  }
+
+int hc11_profile_symbols(struct hc11_profile *prof, const char *fname)
+  {
+    struct profile_sym *sym;
+    char line[256];
+    char *tok[3];
+    FILE *f;
+    int n, count = 0;
+
+    f = fopen(fname, "r");
+    if(!f)
+      {
+        printf("profile: cannot open symbols %s\n", fname);
+        return -1;
+      }
+    while(fgets(line, sizeof(line), f))
+      {
+        //"E00A name", "$E00A name" or "0000e00a T name" as printed by nm
+        for(n = 0; n < 3; n++)
+          {
+            tok[n] = strtok(n ? NULL : line, " \t\r\n");
+            if(!tok[n])
+              {
+                break;
+              }
+          }
+        if(n < 2 || tok[0][0] == '#' || tok[0][0] == ';')
+          {
+            continue;
+          }
+        if(n == 3 && strlen(tok[1]) == 1)
+          {
+            tok[1] = tok[2];
+          }
+        if(tok[0][0] == '$')
+          {
+            tok[0]++;
+          }
+        sym = realloc(prof->syms, (prof->nsyms + 1) * sizeof(struct profile_sym));
+        if(!sym)
+          {
+            break;
+          }
+        prof->syms = sym;
+        sym = &prof->syms[prof->nsyms++];
+        sym->adr = strtoul(tok[0], NULL, 16);
+        snprintf(sym->name, sizeof(sym->name), "%s", tok[1]);
+        count++;
+      }
+    fclose(f);
+    log_msg(prof->core, SYS_CORE, CORE_DBG, "profile: %d symbols from %s\n", count, fname);
+    return 0;
+  }
+
+static int profile_edge_cmp(const void *a, const void *b)
+  {
+    const struct profile_edge *ea = a, *eb = b;
+    if(ea->from != eb->from)
+      {
+        return (int)ea->from - (int)eb->from;
+      }
+    return (int)ea->to - (int)eb->to;
+  }
+
+//name of the function starting at adr
+static void profile_fn_name(struct hc11_profile *prof, int32_t *names, uint32_t adr,
+                            char *buf, size_t len)
+  {
+    if(names[adr] >= 0)
+      {
+        snprintf(buf, len, "%s", prof->syms[names[adr]].name);
+      }
+    else
+      {
+        snprintf(buf, len, "sub_%04X", adr);
+      }
+  }
+
+int hc11_profile_callgrind(struct hc11_profile *prof, const char *fname)
+  {
+    struct profile_edge *edges;
+    int32_t *names;     //symbol of each function start, -1 for none
+    int32_t *fnstart;   //function each pc belongs to, -1 before the first
+    uint64_t clocks = 0;
+    uint32_t nedges = 0, e = 0, i;
+    int32_t fn, curfn = -2;
+    char name[PROFILE_NAME];
+    FILE *f;
+
+    f = fopen(fname, "w");
+    if(!f)
+      {
+        printf("profile: cannot write %s\n", fname);
+        return -1;
+      }
+    names   = malloc(0x10000 * sizeof(int32_t));
+    fnstart = malloc(0x10000 * sizeof(int32_t));
+    edges   = malloc(sizeof(prof->edges));
+    if(!names || !fnstart || !edges)
+      {
+        free(names);
+        free(fnstart);
+        free(edges);
+        fclose(f);
+        return -1;
+      }
+
+    //functions start at symbols and at every call target
+    for(i=0;i<0x10000;i++)
+      {
+        names[i]   = -1;
+        fnstart[i] = -1;
+        clocks    += prof->clocks[i];
+      }
+    for(i=0;i<prof->nsyms;i++)
+      {
+        names[prof->syms[i].adr] = i;
+        fnstart[prof->syms[i].adr] = prof->syms[i].adr;
+      }
+    for(i=0;i<PROFILE_EDGES;i++)
+      {
+        if(prof->edges[i].used)
+          {
+            edges[nedges++] = prof->edges[i];
+            fnstart[prof->edges[i].to] = prof->edges[i].to;
+          }
+      }
+    qsort(edges, nedges, sizeof(struct profile_edge), profile_edge_cmp);
+    for(i=1;i<0x10000;i++)
+      {
+        if(fnstart[i] < 0)
+          {
+            fnstart[i] = fnstart[i-1];
+          }
+      }
+
+    fprintf(f, "# callgrind format\n"
+               "version: 1\n"
+               "creator: sys11 simulator\n"
+               "positions: instr\n"
+               "events: Clocks Instr\n"
+               "summary: %"PRIu64" %"PRIu64"\n\n", clocks, prof->instr);
+    for(i=0;i<0x10000;i++)
+      {
+        if(!prof->count[i] && (e >= nedges || edges[e].from != i))
+          {
+            continue;
+          }
+        fn = fnstart[i];
+        if(fn != curfn)
+          {
+            if(fn < 0)
+              {
+                snprintf(name, sizeof(name), "unknown");
+              }
+            else
+              {
+                profile_fn_name(prof, names, fn, name, sizeof(name));
+              }
+            fprintf(f, "\nfn=%s\n", name);
+            curfn = fn;
+          }
+        if(prof->count[i])
+          {
+            fprintf(f, "0x%04X %"PRIu64" %"PRIu64"\n", i, prof->clocks[i], prof->count[i]);
+          }
+        for(; e < nedges && edges[e].from == i; e++)
+          {
+            profile_fn_name(prof, names, edges[e].to, name, sizeof(name));
+            fprintf(f, "cfn=%s\n"
+                       "calls=%"PRIu64" 0x%04X\n"
+                       "0x%04X %"PRIu64" %"PRIu64"\n", name, edges[e].calls, edges[e].to,
+                       i, edges[e].clocks, edges[e].instr);
+          }
+      }
+    if(prof->lost)
+      {
+        printf("profile: %u returns not recorded, more than %d call edges\n", prof->lost, PROFILE_EDGES);
+      }
+
+    free(names);
+    free(fnstart);
+    free(edges);
+    fclose(f);
+    return 0;
+  }
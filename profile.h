@@ -0,0 +1,33 @@
+#ifndef __profile__h__
+#define __profile__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* Firmware profiler. Each instruction adds its clocks to the pc it started
+ * at, and every return popped from the shadow call stack adds the clocks
+ * and instructions spent since the call to its caller/callee edge. The
+ * result is written in callgrind format for KCachegrind, with functions
+ * named from an optional symbol file, or after the call targets seen. */
+
+#define PROFILE_EDGES 4096 //distinct call sites and targets
+#define PROFILE_NAME  48
+
+struct hc11_profile *hc11_profile_create(struct hc11_core *core);
+void hc11_profile_destroy(struct hc11_profile *prof);
+void hc11_profile_clear  (struct hc11_profile *prof);
+//collection on or off, the counts are kept
+void hc11_profile_attach (struct hc11_profile *prof, bool on);
+
+//"address name" or nm output lines, -1 if the file cannot be read
+int  hc11_profile_symbols (struct hc11_profile *prof, const char *fname);
+int  hc11_profile_callgrind(struct hc11_profile *prof, const char *fname);
+
+//called by the core
+void hc11_profile_step  (struct hc11_profile *prof, uint16_t pc, uint32_t clocks);
+void hc11_profile_call  (struct hc11_profile *prof, uint32_t depth);
+void hc11_profile_return(struct hc11_profile *prof, const struct hc11_call *call, uint32_t depth);
+
+#endif /* __profile__h__ */
@@ -6,18 +6,22 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/socket.h>
 #include <sys/types.h>
-#include <netinet/in.h>
+#include <sys/eventfd.h>
 #include <semaphore.h>
 #include <pthread.h>
-#include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <inttypes.h>
 
 #include "core.h"
 #include "log.h"
+#include "sci.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "scibackend.h"
 
 enum
   {
@@ -30,23 +34,253 @@ enum
     SCI_REG_FIRST = 0x2B
   };
 
+#define BAUD_SCP_SHIFT 4
+#define BAUD_SCP_MASK  0x30
+#define BAUD_SCR_MASK  0x07
+
+#define SCCR1_M    0x10
+
+#define SCCR2_RE   0x04
+#define SCCR2_TE   0x08
+#define SCCR2_ILIE 0x10
+#define SCCR2_RIE  0x20
+#define SCCR2_TCIE 0x40
+#define SCCR2_TIE  0x80
+
+#define SCSR_OR   0x08
+#define SCSR_IDLE 0x10
 #define SCSR_RDRF 0x20
 #define SCSR_TC   0x40
 #define SCSR_TDRE 0x80
 
+#define SCI_FIFO_SIZE 4096 //host side buffering, must be a power of two
+
+#define SCI_TURBO_IDLE_POLL 64 //clocks between host fifo checks in turbo mode
+
+struct sci_fifo
+  {
+    uint8_t  buf[SCI_FIFO_SIZE];
+    uint32_t head; //next write
+    uint32_t tail; //next read
+  };
+
 struct hc11_sci
   {
+    struct hc11_core *core;
     uint8_t regs[REGCNT];
-    int port;
-    int sock;
-    int client;
+    uint8_t rdr;      //receive data register, read through SCDR
+    uint8_t tdr;      //transmit data register, written through SCDR
+    uint8_t tsr;      //transmit shift register
+    bool    txbusy;   //tsr holds a char being shifted out
+    bool    turbo;    //ignore baud rate: chars take one clock, no overrun
+    int     txevent;
+    int     rxevent;
+    pthread_mutex_t lock; //protects the fifos, shared with the host thread
+    struct sci_fifo rxfifo;
+    struct sci_fifo txfifo;
+    struct sci_backend be;
+    int wakefd; //eventfd to wake the host thread
     pthread_t thread;
     sem_t startstop;
     bool running;
     bool connected;
-    uint8_t txbuf;
   };
 
+static uint32_t sci_fifo_count(struct sci_fifo *fifo)
+  {
+    return fifo->head - fifo->tail;
+  }
+
+static bool sci_fifo_put(struct sci_fifo *fifo, uint8_t val)
+  {
+    if(fifo->head - fifo->tail == SCI_FIFO_SIZE)
+      {
+        return false;
+      }
+    fifo->buf[fifo->head & (SCI_FIFO_SIZE-1)] = val;
+    fifo->head += 1;
+    return true;
+  }
+
+static bool sci_fifo_get(struct sci_fifo *fifo, uint8_t *val)
+  {
+    if(fifo->head == fifo->tail)
+      {
+        return false;
+      }
+    *val = fifo->buf[fifo->tail & (SCI_FIFO_SIZE-1)];
+    fifo->tail += 1;
+    return true;
+  }
+
+//copy up to len queued bytes without removing them
+static uint32_t sci_fifo_peek(struct sci_fifo *fifo, uint8_t *buf, uint32_t len)
+  {
+    uint32_t i;
+    for(i=0;i<len && fifo->tail + i != fifo->head;i++)
+      {
+        buf[i] = fifo->buf[(fifo->tail + i) & (SCI_FIFO_SIZE-1)];
+      }
+    return i;
+  }
+
+static void sci_wake(struct hc11_sci *sci)
+  {
+    uint64_t one = 1;
+    if(write(sci->wakefd, &one, sizeof(one)) != sizeof(one))
+      {
+        log_msg(sci->core, SYS_SCI, 0, "hc11_sci: warning: cannot wake host thread\n");
+      }
+  }
+
+//number of E clocks needed to shift a complete frame, derived from BAUD
+//baud rate = E / (16 * prescaler * 2^SCR)
+static uint64_t sci_frame_clocks(struct hc11_sci *sci)
+  {
+    static const uint8_t prescalers[4] = {1, 3, 4, 13};
+    uint64_t bit;
+    uint8_t  baud = sci->regs[OFF_BAUD];
+
+    if(sci->turbo)
+      {
+        return 1;
+      }
+
+    bit = 16 * prescalers[(baud & BAUD_SCP_MASK) >> BAUD_SCP_SHIFT];
+    bit <<= baud & BAUD_SCR_MASK;
+    //start bit, 8 or 9 data bits, stop bit
+    return bit * ((sci->regs[OFF_SCCR1] & SCCR1_M) ? 11 : 10);
+  }
+
+//drive the SCI interrupt request line from current flags and enables
+static void sci_update_irq(struct hc11_sci *sci)
+  {
+    uint8_t scsr  = sci->regs[OFF_SCSR];
+    uint8_t sccr2 = sci->regs[OFF_SCCR2];
+    bool level;
+
+    level = ((scsr & SCSR_TDRE) && (sccr2 & SCCR2_TIE )) ||
+            ((scsr & SCSR_TC  ) && (sccr2 & SCCR2_TCIE)) ||
+            ((scsr & (SCSR_RDRF | SCSR_OR)) && (sccr2 & SCCR2_RIE)) ||
+            ((scsr & SCSR_IDLE) && (sccr2 & SCCR2_ILIE));
+    hc11_core_irq(sci->core, VECTOR_SCI, level);
+  }
+
+//move the transmit data register to the shifter if possible
+static void sci_tx_start(struct hc11_sci *sci)
+  {
+    if(sci->txbusy || (sci->regs[OFF_SCSR] & SCSR_TDRE) || !(sci->regs[OFF_SCCR2] & SCCR2_TE))
+      {
+        return;
+      }
+    sci->tsr    = sci->tdr;
+    sci->txbusy = true;
+    sci->regs[OFF_SCSR] |= SCSR_TDRE;
+    hc11_core_event_schedule(sci->core, sci->txevent, sci_frame_clocks(sci));
+  }
+
+//transmit shifter has sent the last stop bit
+static void sci_tx_done(void *ctx)
+  {
+    struct hc11_sci *sci = ctx;
+    bool wake;
+
+    pthread_mutex_lock(&sci->lock);
+    if(sci_fifo_count(&sci->txfifo) == SCI_FIFO_SIZE && sci->connected &&
+       !sci->be.lossy && !sci->core->journal)
+      {
+        //a reader is attached but slower than the firmware: hold the char in
+        //the shifter like a flow controlled line. With a journal the timing
+        //must not depend on the host, the char is dropped instead.
+        pthread_mutex_unlock(&sci->lock);
+        hc11_core_event_schedule(sci->core, sci->txevent, sci_frame_clocks(sci));
+        return;
+      }
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: transmit %02X\n", sci->tsr);
+    wake = sci_fifo_count(&sci->txfifo) == 0;
+    if(!sci_fifo_put(&sci->txfifo, sci->tsr))
+      {
+        log_msg(sci->core, SYS_SCI, 0, "hc11_sci: warning: host tx fifo full, lost byte %02X\n", sci->tsr);
+      }
+    pthread_mutex_unlock(&sci->lock);
+    if(wake)
+      {
+        sci_wake(sci);
+      }
+    sci->txbusy = false;
+    sci_tx_start(sci);
+    if(!sci->txbusy)
+      {
+        sci->regs[OFF_SCSR] |= SCSR_TC;
+      }
+    sci_update_irq(sci);
+  }
+
+//a complete frame was received
+static void sci_rx_char(struct hc11_sci *sci, uint8_t val)
+  {
+    if(sci->regs[OFF_SCSR] & SCSR_RDRF)
+      {
+        log_msg(sci->core, SYS_SCI, 0, "sci: warning: RX register already full, lost byte %02X\n", (int)val);
+        sci->regs[OFF_SCSR] |= SCSR_OR;
+      }
+    else
+      {
+        log_msg(sci->core, SYS_SCI, 0, "sci: received a char %02X\n", (int)val);
+        sci->rdr = val;
+        sci->regs[OFF_SCSR] |= SCSR_RDRF;
+      }
+    sci_update_irq(sci);
+  }
+
+//replay sink for recorded received chars
+static void sci_rx_replay(void *ctx, uint16_t arg, uint16_t val)
+  {
+    sci_rx_char(ctx, val);
+  }
+
+//receiver has sampled a complete frame time, take the next host byte
+static void sci_rx_poll(void *ctx)
+  {
+    struct hc11_sci *sci = ctx;
+    uint8_t val;
+    bool got;
+    bool wake;
+
+    if(!(sci->regs[OFF_SCCR2] & SCCR2_RE))
+      {
+        return; //rescheduled when RE is set
+      }
+    if(hc11_journal_replaying(sci->core))
+      {
+        return; //received chars come from the journal
+      }
+    if(sci->turbo && (sci->regs[OFF_SCSR] & SCSR_RDRF))
+      {
+        return; //rescheduled when SCDR is read
+      }
+    pthread_mutex_lock(&sci->lock);
+    wake = sci_fifo_count(&sci->rxfifo) == SCI_FIFO_SIZE;
+    got = sci_fifo_get(&sci->rxfifo, &val);
+    pthread_mutex_unlock(&sci->lock);
+    if(wake)
+      {
+        sci_wake(sci); //host thread stopped reading when the fifo was full
+      }
+    if(got)
+      {
+        hc11_journal_input(sci->core, JRN_SCI_RX, 0, val);
+        sci_rx_char(sci, val);
+      }
+    if(sci->turbo && !got)
+      {
+        //nothing from the host: do not poll the fifo on every clock
+        hc11_core_event_schedule(sci->core, sci->rxevent, SCI_TURBO_IDLE_POLL);
+        return;
+      }
+    hc11_core_event_schedule(sci->core, sci->rxevent, sci_frame_clocks(sci));
+  }
+
 static uint8_t sci_read(void *ctx, uint16_t off)
   {
     struct hc11_sci *sci = ctx;
@@ -55,13 +289,20 @@ static uint8_t sci_read(void *ctx, uint16_t off)
     ret = sci->regs[off];
     switch(off)
       {
-      case OFF_BAUD:  log_msg(SYS_SCI, 0, "SCI read BAUD -> %02X\n" , ret);  break;
-      case OFF_SCCR1: log_msg(SYS_SCI, 0, "SCI read SCCR1 -> %02X\n", ret); break;
-      case OFF_SCCR2: log_msg(SYS_SCI, 0, "SCI read SCCR2 -> %02X\n", ret); break;
-      case OFF_SCSR:  log_msg(SYS_SCI, 0, "SCI read SCSR -> %02X\n" , ret);  break;
+      case OFF_BAUD:  log_msg(sci->core, SYS_SCI, 0, "SCI read BAUD -> %02X\n" , ret);  break;
+      case OFF_SCCR1: log_msg(sci->core, SYS_SCI, 0, "SCI read SCCR1 -> %02X\n", ret); break;
+      case OFF_SCCR2: log_msg(sci->core, SYS_SCI, 0, "SCI read SCCR2 -> %02X\n", ret); break;
+      case OFF_SCSR:  log_msg(sci->core, SYS_SCI, 0, "SCI read SCSR -> %02X\n" , ret);  break;
       case OFF_SCDR:
-        sci->regs[OFF_SCSR] &= ~SCSR_RDRF;
-        log_msg(SYS_SCI, 0, "SCI read SCDR -> %02X\n", ret);
+        ret = sci->rdr;
+        sci->regs[OFF_SCSR] &= ~(SCSR_RDRF | SCSR_OR);
+        sci_update_irq(sci);
+        if(sci->turbo && (sci->regs[OFF_SCCR2] & SCCR2_RE))
+          {
+            //next byte is available right away
+            hc11_core_event_schedule(sci->core, sci->rxevent, 1);
+          }
+        log_msg(sci->core, SYS_SCI, 0, "SCI read SCDR -> %02X\n", ret);
         break;
       }
     return ret;
@@ -70,137 +311,273 @@ static uint8_t sci_read(void *ctx, uint16_t off)
 static void sci_write(void *ctx, uint16_t off, uint8_t val)
   {
     struct hc11_sci *sci = ctx;
+    uint8_t prev;
     off -= SCI_REG_FIRST;
-    sci->regs[off] = val;
     switch(off)
       {
-      case OFF_BAUD:  log_msg(SYS_SCI, 0, "SCI write BAUD <- %02X\n" , val); break;
-      case OFF_SCCR1: log_msg(SYS_SCI, 0, "SCI write SCCR1 <- %02X\n", val); break;
-      case OFF_SCCR2: log_msg(SYS_SCI, 0, "SCI write SCCR2 <- %02X\n", val); break;
-      case OFF_SCSR:  log_msg(SYS_SCI, 0, "SCI write SCSR <- %02X\n" , val); break;
+      case OFF_BAUD:
+        sci->regs[off] = val;
+        log_msg(sci->core, SYS_SCI, 0, "SCI write BAUD <- %02X (%"PRIu64" clocks/char)\n", val, sci_frame_clocks(sci));
+        break;
+      case OFF_SCCR1:
+        sci->regs[off] = val;
+        log_msg(sci->core, SYS_SCI, 0, "SCI write SCCR1 <- %02X\n", val);
+        break;
+      case OFF_SCCR2:
+        prev = sci->regs[off];
+        sci->regs[off] = val;
+        log_msg(sci->core, SYS_SCI, 0, "SCI write SCCR2 <- %02X\n", val);
+        if((val & SCCR2_RE) && !(prev & SCCR2_RE))
+          {
+            hc11_core_event_schedule(sci->core, sci->rxevent, sci_frame_clocks(sci));
+          }
+        sci_tx_start(sci);
+        sci_update_irq(sci);
+        break;
+      case OFF_SCSR:
+        //status register is read only
+        log_msg(sci->core, SYS_SCI, 0, "SCI write SCSR <- %02X (ignored)\n" , val);
+        break;
       case OFF_SCDR:
+        sci->tdr = val;
         sci->regs[OFF_SCSR] &= ~SCSR_TC;
         sci->regs[OFF_SCSR] &= ~SCSR_TDRE;
-        log_msg(SYS_SCI, 0, "SCI write SCDR <- %02X\n", val);
+        log_msg(sci->core, SYS_SCI, 0, "SCI write SCDR <- %02X\n", val);
+        sci_tx_start(sci);
+        sci_update_irq(sci);
         break;
       }
   }
 
-static void sci_thread_sig(int num, siginfo_t *info, void *v)
+//debugger view: SCDR shows the receive data without acknowledging it
+static uint8_t sci_debug_read(void *ctx, uint16_t off)
   {
-    struct hc11_sci *sci = info->si_value.sival_ptr;
-    log_msg(SYS_SCI, 0, "hc11_sci: thread signal caught\n");
-    sci->connected = false;
-    sci->running   = false;
+    struct hc11_sci *sci = ctx;
+    off -= SCI_REG_FIRST;
+    if(off == OFF_SCDR)
+      {
+        return sci->rdr;
+      }
+    return sci->regs[off];
+  }
+
+//debugger writes set the status flags and the receive data directly, the
+//control registers take a normal write
+static void sci_debug_write(void *ctx, uint16_t off, uint8_t val)
+  {
+    struct hc11_sci *sci = ctx;
+    switch(off - SCI_REG_FIRST)
+      {
+      case OFF_SCSR:
+        sci->regs[OFF_SCSR] = val;
+        sci_update_irq(sci);
+        break;
+      case OFF_SCDR:
+        sci->rdr = val;
+        break;
+      default:
+        sci_write(ctx, off, val);
+        break;
+      }
+  }
+
+//send the transmit fifo to the host. What the backend does not take stays
+//in the fifo, true if some is left and the thread must wait for POLLOUT.
+//Chars queued during the write did not wake us, they count as left too.
+static bool sci_host_tx(struct hc11_sci *sci)
+  {
+    uint8_t buf[SCI_FIFO_SIZE];
+    uint32_t len;
+    ssize_t ret;
+    bool left;
+
+    pthread_mutex_lock(&sci->lock);
+    len = sci_fifo_peek(&sci->txfifo, buf, SCI_FIFO_SIZE);
+    pthread_mutex_unlock(&sci->lock);
+    if(len == 0)
+      {
+        return false;
+      }
+    ret = (sci->be.txfd < 0) ? len : write(sci->be.txfd, buf, len); //no output: discard
+    if(ret < 0 && (errno == EAGAIN || errno == EINTR))
+      {
+        ret = 0;
+      }
+    else if(ret < 0)
+      {
+        log_msg(sci->core, SYS_SCI, 0, "hc11_sci: warning: transmit failed, %u bytes lost\n", len);
+        ret = len;
+      }
+    pthread_mutex_lock(&sci->lock);
+    sci->txfifo.tail += ret;
+    left = sci_fifo_count(&sci->txfifo) > 0;
+    pthread_mutex_unlock(&sci->lock);
+    return left;
   }
 
+//host side: only moves bytes between the backend and the fifos, all register
+//changes happen in simulated time from the core thread.
 static void* sci_thread(void *param)
   {
     struct hc11_sci *sci = param;
-    struct sockaddr_in client;
-    struct sigaction sa_thread;
-    int ret;
-    char buf;
-
-    memset(&sa_thread, 0, sizeof(struct sigaction));
-    sa_thread.sa_sigaction = sci_thread_sig;
-    sa_thread.sa_flags     = SA_SIGINFO;
-    //sigaction(SIGUSR1, &sa_thread, NULL);
+    struct sci_backend *be = &sci->be;
+    struct pollfd pfd[3];
+    uint8_t buf[SCI_FIFO_SIZE];
+    uint64_t wake;
+    uint32_t room;
+    ssize_t ret;
+    bool txpending;
+    int rxfd;
+    int i;
 
     sci->running = true;
     sci->connected = false;
-    log_msg(SYS_SCI, 0, "hc11_sci: listen thread start (port %u)\n", sci->port);
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: host thread start (%s)\n", be->ops->name);
     sem_post(&sci->startstop);
 
     while(sci->running)
       {
-        int clientsize = sizeof(client);
-        int flags;
-        sci->client = accept(sci->sock, (struct sockaddr*)&client, &clientsize);
-        if(sci->client < 0)
+        if(be->ops->accept(be, sci->wakefd) < 0)
           {
-            //perror("sci_accept()");
+            //output while nobody is connected also wakes us, keep waiting
+            //unless the wake came from hc11_sci_close
+            if(read(sci->wakefd, &wake, sizeof(wake)) == sizeof(wake) && sci->running)
+              {
+                continue;
+              }
             break;
           }
-        log_msg(SYS_SCI, 0, "hc11_sci: client connected\n");
-        flags = fcntl(sci->client, F_GETFL, 0);
-        if(flags == -1)
-          {
-           perror("fcntl GETFL");
-          }
-        flags |= O_NONBLOCK;
-        ret = fcntl(sci->client, F_SETFL, flags);
-        if(ret != 0)
-          {
-            perror("fcntl SETFL");
-          }
-        dprintf(sci->client, "SCI monitor\r\n");
+        log_msg(sci->core, SYS_SCI, 0, "hc11_sci: client connected\n");
         sci->connected = true;
-        while(sci->connected)
+        rxfd = be->rxfd;
+        while(sci->connected && sci->running)
           {
-            if(!(sci->regs[OFF_SCSR] & SCSR_TDRE))
+            txpending = sci_host_tx(sci);
+
+            pthread_mutex_lock(&sci->lock);
+            room = SCI_FIFO_SIZE - sci_fifo_count(&sci->rxfifo);
+            pthread_mutex_unlock(&sci->lock);
+
+            pfd[0].fd      = (room > 0) ? rxfd : -1; //stop reading when full
+            pfd[0].events  = POLLIN;
+            pfd[0].revents = 0;
+            pfd[1].fd      = sci->wakefd;
+            pfd[1].events  = POLLIN;
+            pfd[2].fd      = txpending ? be->txfd : -1;
+            pfd[2].events  = POLLOUT;
+            ret = poll(pfd, 3, -1);
+            if(ret < 0)
               {
-                buf = sci->regs[OFF_SCDR];
-                log_msg(SYS_SCI, 0, "hc11_sci: transmit %02X\n", (int)(buf&0xFF));
-                ret = send(sci->client, &buf, 1, 0);
-                sci->regs[OFF_SCSR] |= SCSR_TC;
-                sci->regs[OFF_SCSR] |= SCSR_TDRE;
-                if(ret != 1)
+                if(errno != EINTR)
                   {
-                    log_msg(SYS_SCI, 0, "hc11_sci: warning: transmit failed\n");
+                    sci->connected = false;
                   }
+                continue;
               }
-
-            ret = recv(sci->client, &buf, 1, 0);
-            if(ret == 0)
+            if(pfd[1].revents & POLLIN)
               {
-//                if(errno != EAGAIN)
-//                  {
-                    log_msg(SYS_SCI, 0, "zero ret\n");
-                    sci->connected = false;
-//                  }
-                usleep(10000);
+                if(read(sci->wakefd, &wake, sizeof(wake)) < 0)
+                  {
+                    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: wake read failed\n");
+                  }
               }
-            else if(ret < 0)
+            if(!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
               {
-                if(errno != EAGAIN)
+                continue;
+              }
+            ret = read(rxfd, buf, room);
+            if(ret < 0 && (errno == EAGAIN || errno == EINTR))
+              {
+                continue;
+              }
+            if(ret <= 0)
+              {
+                log_msg(sci->core, SYS_SCI, 0, "hc11_sci: end of input (%d)\n", (int)ret);
+                if(be->reconnect)
                   {
-                    log_msg(SYS_SCI, 0, "neg ret\n");
                     sci->connected = false;
                   }
-                usleep(10000);
-              }
-            else if(ret == 1)
-              {
-                if(!(sci->regs[OFF_SCSR] & SCSR_RDRF))
+                else
                   {
-                    log_msg(SYS_SCI, 0, "sci: received a char %02X\n", (int)(buf&0xFF));
-                    sci->regs[OFF_SCDR] = buf;
-                    sci->regs[OFF_SCSR] |= SCSR_RDRF;
+                    rxfd = -1; //keep sending output
                   }
-               else
-                 {
-                   log_msg(SYS_SCI, 0, "sci: warning: RX register already full, lost byte %02X\n", (int)(buf&0xFF));
-                 }
+                continue;
               }
+            pthread_mutex_lock(&sci->lock);
+            for(i=0;i<ret;i++)
+              {
+                sci_fifo_put(&sci->rxfifo, buf[i]);
+              }
+            pthread_mutex_unlock(&sci->lock);
           }
+        sci_host_tx(sci); //last chars before hangup or termination
         sci->connected = false;
-        log_msg(SYS_SCI, 0, "hc11_sci: connection closed\n");
-        close(sci->client);
+        log_msg(sci->core, SYS_SCI, 0, "hc11_sci: connection closed\n");
+        if(!be->reconnect)
+          {
+            break;
+          }
+        be->ops->hangup(be);
       }
 
-    log_msg(SYS_SCI, 0, "hc11_sci: listen thread done\n");
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: host thread done\n");
     return NULL;
   }
 
-struct hc11_sci* hc11_sci_init(struct hc11_core *core)
+static void sci_set_turbo(struct hc11_sci *sci, bool turbo)
+  {
+    sci->turbo = turbo;
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: %s timing\n", turbo ? "turbo" : "accurate");
+    //reschedule pending chars with the new timing
+    if(sci->txbusy)
+      {
+        hc11_core_event_schedule(sci->core, sci->txevent, sci_frame_clocks(sci));
+      }
+    if(sci->regs[OFF_SCCR2] & SCCR2_RE)
+      {
+        hc11_core_event_schedule(sci->core, sci->rxevent, sci_frame_clocks(sci));
+      }
+  }
+
+static void sci_mode_replay(void *ctx, uint16_t arg, uint16_t val)
+  {
+    sci_set_turbo(ctx, val);
+  }
+
+//simulated side only, host fifos and connection are not part of the machine
+static void sci_save(void *ctx, struct hc11_snapbuf *buf)
+  {
+    struct hc11_sci *sci = ctx;
+    snap_put(buf, sci->regs, REGCNT);
+    snap_put8(buf, sci->rdr);
+    snap_put8(buf, sci->tdr);
+    snap_put8(buf, sci->tsr);
+    snap_put8(buf, sci->txbusy);
+    snap_put8(buf, sci->turbo);
+    snap_put_event(buf, sci->core, sci->txevent);
+    snap_put_event(buf, sci->core, sci->rxevent);
+  }
+
+static int sci_load(void *ctx, struct hc11_snapbuf *buf)
+  {
+    struct hc11_sci *sci = ctx;
+    snap_get(buf, sci->regs, REGCNT);
+    sci->rdr    = snap_get8(buf);
+    sci->tdr    = snap_get8(buf);
+    sci->tsr    = snap_get8(buf);
+    sci->txbusy = snap_get8(buf);
+    sci->turbo  = snap_get8(buf);
+    snap_get_event(buf, sci->core, sci->txevent);
+    snap_get_event(buf, sci->core, sci->rxevent);
+    sci_update_irq(sci);
+    return 0;
+  }
+
+struct hc11_sci* hc11_sci_init(struct hc11_core *core, const char *backend)
   {
     struct hc11_sci *sci;
-    struct sockaddr_in server;
-    int ret;
-    int yes = 1;
 
-    log_msg(SYS_SCI, 0, "hc11_sci: starting\n");
+    log_msg(core, SYS_SCI, 0, "hc11_sci: starting\n");
 
     sci = malloc(sizeof(struct hc11_sci));
     if(!sci)
@@ -208,72 +585,123 @@ struct hc11_sci* hc11_sci_init(struct hc11_core *core)
         return NULL;
       }
 
-    memset(sci->regs, 0, 5);
-    sci->regs[OFF_SCSR] = SCSR_TDRE; //transmit buf is initially empty
-    hc11_core_iocallback(core, SCI_REG_FIRST, 5, sci, sci_read, sci_write);
+    memset(sci->regs, 0, REGCNT);
+    sci->regs[OFF_SCSR] = SCSR_TDRE | SCSR_TC; //transmitter is initially idle
+    sci->core   = core;
+    sci->rdr    = 0;
+    sci->tdr    = 0;
+    sci->txbusy = false;
+    sci->turbo  = false;
+    sci->rxfifo.head = sci->rxfifo.tail = 0;
+    sci->txfifo.head = sci->txfifo.tail = 0;
+    pthread_mutex_init(&sci->lock, NULL);
+    sci->txevent = hc11_core_event_register(core, sci, sci_tx_done);
+    sci->rxevent = hc11_core_event_register(core, sci, sci_rx_poll);
+    hc11_core_iocallback(core, SCI_REG_FIRST, REGCNT, sci, sci_read, sci_write);
+    hc11_core_iodebug   (core, SCI_REG_FIRST, REGCNT, sci_debug_read, sci_debug_write);
+    hc11_snapshot_register(core, "sci", sci, sci_save, sci_load);
+    if(core->journal)
+      {
+        hc11_journal_sink(core->journal, JRN_SCI_RX  , sci, sci_rx_replay);
+        hc11_journal_sink(core->journal, JRN_SCI_MODE, sci, sci_mode_replay);
+      }
 
     sem_init(&sci->startstop, 0, 0);
-    sci->port = 3334;
 
-    // create tcp socket to allow gdb incoming connection
-    sci->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if(sci->sock < 0)
+    sci->wakefd = eventfd(0, EFD_NONBLOCK);
+    if(sci->wakefd < 0)
       {
-        perror("socket");
+        perror("eventfd");
         goto release;
       }
 
-    ret = setsockopt(sci->sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
-    if(ret < 0)
+    if(sci_backend_open(&sci->be, core, backend) < 0)
       {
-        perror("setsockopt SO_REUSEADDR");
         goto close;
       }
 
+    pthread_create(&sci->thread, NULL, sci_thread, sci);
+    sem_wait(&sci->startstop);
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: started\n");
+    return sci;
 
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = htonl(INADDR_ANY);
-    server.sin_port = ntohs(sci->port);
-    ret = bind(sci->sock, (struct sockaddr*)&server, sizeof(server));
-    if(ret < 0)
+close:
+    close(sci->wakefd);
+release:
+    free(sci);
+    return NULL;
+  }
+
+//switch between baud-accurate and turbo timing, can be done at any time
+void hc11_sci_set_turbo(struct hc11_sci *sci, bool turbo)
+  {
+    if(sci->turbo == turbo)
       {
-        perror("bind()");
-        goto close;
+        return;
       }
+    hc11_journal_debug(sci->core, JRN_SCI_MODE, 0, turbo);
+    sci_set_turbo(sci, turbo);
+  }
 
-    ret = listen(sci->sock, 0);
-    if(ret < 0)
+bool hc11_sci_get_turbo(struct hc11_sci *sci)
+  {
+    return sci->turbo;
+  }
+
+//queue bytes as if they came from the host, returns the number accepted
+int hc11_sci_inject(struct hc11_sci *sci, const uint8_t *buf, uint32_t len)
+  {
+    uint32_t i;
+
+    pthread_mutex_lock(&sci->lock);
+    for(i=0;i<len;i++)
       {
-        perror("listen()");
-        goto close;
+        if(!sci_fifo_put(&sci->rxfifo, buf[i]))
+          {
+            break;
+          }
       }
+    pthread_mutex_unlock(&sci->lock);
+    return i;
+  }
 
-    pthread_create(&sci->thread, NULL, sci_thread, sci);
-    sem_wait(&sci->startstop);
-    log_msg(SYS_SCI, 0, "hc11_sci: started\n");
-    return sci;
+//all host input received and read by the firmware
+bool hc11_sci_rx_idle(struct hc11_sci *sci)
+  {
+    bool idle;
 
-release:
-    free(sci);
-close:
-    close(sci->sock);
-    return NULL;
+    pthread_mutex_lock(&sci->lock);
+    idle = sci_fifo_count(&sci->rxfifo) == 0;
+    pthread_mutex_unlock(&sci->lock);
+    return idle && !(sci->regs[OFF_SCSR] & SCSR_RDRF);
+  }
+
+//drop host input the core has not received yet
+void hc11_sci_flush(struct hc11_sci *sci)
+  {
+    bool wake;
+
+    pthread_mutex_lock(&sci->lock);
+    wake = sci_fifo_count(&sci->rxfifo) == SCI_FIFO_SIZE;
+    sci->rxfifo.tail = sci->rxfifo.head;
+    pthread_mutex_unlock(&sci->lock);
+    if(wake)
+      {
+        sci_wake(sci); //host thread stopped reading when the fifo was full
+      }
   }
 
 int hc11_sci_close(struct hc11_sci *sci)
   {
     void *ret;
-    sigval_t val;
-
-    log_msg(SYS_SCI, 0, "hc11_sci: terminating...\n");
-    close(sci->client);
-    close(sci->sock);
 
-    val.sival_ptr = sci;
-    pthread_sigqueue(sci->thread, SIGINT, val);
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: terminating...\n");
+    sci->running = false;
+    sci_wake(sci);
     pthread_join(sci->thread, &ret);
-    log_msg(SYS_SCI, 0, "hc11_sci: thread terminated\n");
+    sci_backend_close(&sci->be);
+    close(sci->wakefd);
+    log_msg(sci->core, SYS_SCI, 0, "hc11_sci: thread terminated\n");
     free(sci);
     return 0;
   }
-
@@ -1,9 +1,20 @@
 #ifndef __sci__h__
 #define __sci__h__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 struct hc11_sci;
 
-struct hc11_sci* hc11_sci_init(struct hc11_core *core);
-void hc11_sci_close(struct hc11_sci *sci);
+struct hc11_sci* hc11_sci_init(struct hc11_core *core, const char *backend);
+int  hc11_sci_close(struct hc11_sci *sci);
+
+void hc11_sci_set_turbo(struct hc11_sci *sci, bool turbo);
+bool hc11_sci_get_turbo(struct hc11_sci *sci);
+
+//host input injected from the simulator process, next to the backend's
+int  hc11_sci_inject(struct hc11_sci *sci, const uint8_t *buf, uint32_t len);
+void hc11_sci_flush (struct hc11_sci *sci);
+bool hc11_sci_rx_idle(struct hc11_sci *sci);
 
 #endif /* __sci__h__ */
@@ -0,0 +1,392 @@
+/* host side endpoints for the simulated SCI */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+
+#include "scibackend.h"
+#include "core.h"
+#include "log.h"
+
+//wait until the listening socket has a pending connection.
+//returns -1 if the wake descriptor was signaled first.
+static int sci_backend_waitlisten(struct sci_backend *be, int wakefd)
+  {
+    struct pollfd pfd[2];
+    int ret;
+
+    pfd[0].fd     = be->lfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd     = wakefd;
+    pfd[1].events = POLLIN;
+    do
+      {
+        ret = poll(pfd, 2, -1);
+      }
+    while(ret < 0 && errno == EINTR);
+    if(ret < 0 || (pfd[1].revents & POLLIN) || !(pfd[0].revents & POLLIN))
+      {
+        return -1;
+      }
+    return 0;
+  }
+
+static int sci_backend_listen(struct sci_backend *be, struct sockaddr *server,
+                              socklen_t len)
+  {
+    int ret;
+
+    ret = bind(be->lfd, server, len);
+    if(ret < 0)
+      {
+        perror("bind()");
+        return -1;
+      }
+
+    ret = listen(be->lfd, 0);
+    if(ret < 0)
+      {
+        perror("listen()");
+        return -1;
+      }
+    return 0;
+  }
+
+//=============================================================================
+//tcp:port - listen on all interfaces, one client at a time
+static int tcp_open(struct sci_backend *be, const char *arg)
+  {
+    struct sockaddr_in server;
+    int ret;
+    int yes = 1;
+    int port = 3334;
+
+    if(arg && *arg)
+      {
+        port = atoi(arg);
+      }
+
+    be->lfd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(be->lfd < 0)
+      {
+        perror("socket");
+        return -1;
+      }
+
+    ret = setsockopt(be->lfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    if(ret < 0)
+      {
+        perror("setsockopt SO_REUSEADDR");
+        return -1;
+      }
+
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_ANY);
+    server.sin_port = ntohs(port);
+    if(sci_backend_listen(be, (struct sockaddr*)&server, sizeof(server)) < 0)
+      {
+        return -1;
+      }
+    be->reconnect = true;
+    log_msg(be->core, SYS_SCI, 0, "hc11_sci: tcp port %d\n", port);
+    return 0;
+  }
+
+static int sock_accept(struct sci_backend *be, int wakefd)
+  {
+    int client;
+
+    if(sci_backend_waitlisten(be, wakefd) < 0)
+      {
+        return -1;
+      }
+    client = accept(be->lfd, NULL, NULL);
+    if(client < 0)
+      {
+        return -1;
+      }
+    //output waits for POLLOUT, a stalled peer must not block the thread
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) | O_NONBLOCK);
+    be->rxfd = client;
+    be->txfd = client;
+    return 0;
+  }
+
+static int tcp_accept(struct sci_backend *be, int wakefd)
+  {
+    if(sock_accept(be, wakefd) < 0)
+      {
+        return -1;
+      }
+    dprintf(be->txfd, "SCI monitor\r\n");
+    return 0;
+  }
+
+static void sock_hangup(struct sci_backend *be)
+  {
+    close(be->rxfd);
+    be->rxfd = -1;
+    be->txfd = -1;
+  }
+
+static void sock_close(struct sci_backend *be)
+  {
+    if(be->rxfd >= 0)
+      {
+        sock_hangup(be);
+      }
+    if(be->lfd >= 0)
+      {
+        close(be->lfd);
+        be->lfd = -1;
+      }
+  }
+
+//=============================================================================
+//unix:path - listen on a unix domain socket
+static int unix_open(struct sci_backend *be, const char *arg)
+  {
+    struct sockaddr_un server;
+
+    if(!arg || !*arg || strlen(arg) >= sizeof(server.sun_path))
+      {
+        fprintf(stderr, "sci: unix backend needs a socket path\n");
+        return -1;
+      }
+
+    be->lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(be->lfd < 0)
+      {
+        perror("socket");
+        return -1;
+      }
+
+    memset(&server, 0, sizeof(server));
+    server.sun_family = AF_UNIX;
+    strcpy(server.sun_path, arg);
+    strcpy(be->path, arg);
+    unlink(arg); //stale socket from a previous run
+    if(sci_backend_listen(be, (struct sockaddr*)&server, sizeof(server)) < 0)
+      {
+        return -1;
+      }
+    be->reconnect = true;
+    log_msg(be->core, SYS_SCI, 0, "hc11_sci: unix socket %s\n", arg);
+    return 0;
+  }
+
+static void unix_close(struct sci_backend *be)
+  {
+    sock_close(be);
+    unlink(be->path);
+  }
+
+//=============================================================================
+//pty - create a pseudo terminal, the slave stays open so the master never
+//reports a hangup when terminal programs come and go.
+static int pty_open(struct sci_backend *be, const char *arg)
+  {
+    struct termios tio;
+    int master, slave;
+
+    if(openpty(&master, &slave, be->path, NULL, NULL) < 0)
+      {
+        perror("openpty");
+        return -1;
+      }
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    //nobody may be reading the terminal: never block on output
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL, 0) | O_NONBLOCK);
+    be->rxfd   = master;
+    be->txfd   = master;
+    be->keepfd = slave;
+    be->lossy  = true;
+    printf("hc11_sci: pty is %s\n", be->path);
+    return 0;
+  }
+
+static void pty_close(struct sci_backend *be)
+  {
+    close(be->rxfd);
+    close(be->keepfd);
+    be->rxfd   = -1;
+    be->txfd   = -1;
+    be->keepfd = -1;
+  }
+
+//=============================================================================
+//stdio - use the process standard input and output
+static int stdio_open(struct sci_backend *be, const char *arg)
+  {
+    struct termios tio;
+
+    be->rxfd = STDIN_FILENO;
+    be->txfd = STDOUT_FILENO;
+    if(isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &be->saved) == 0)
+      {
+        tio = be->saved;
+        cfmakeraw(&tio);
+        tio.c_oflag |= OPOST | ONLCR; //keep the rest of the output readable
+        tio.c_lflag |= ISIG;          //ctrl-c still stops the simulator
+        tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+        be->rawtty = true;
+      }
+    return 0;
+  }
+
+static void stdio_close(struct sci_backend *be)
+  {
+    if(be->rawtty)
+      {
+        tcsetattr(STDIN_FILENO, TCSANOW, &be->saved);
+        be->rawtty = false;
+      }
+  }
+
+//=============================================================================
+//file:in,out - scripted input and captured output, either can be omitted
+static int file_open(struct sci_backend *be, const char *arg)
+  {
+    char in[256];
+    const char *out;
+    size_t len;
+
+    out = arg ? strchr(arg, ',') : NULL;
+    len = out ? (size_t)(out - arg) : (arg ? strlen(arg) : 0);
+    if(len >= sizeof(in))
+      {
+        fprintf(stderr, "sci: input file name too long\n");
+        return -1;
+      }
+    memcpy(in, arg, len);
+    in[len] = 0;
+
+    if(len)
+      {
+        be->rxfd = open(in, O_RDONLY);
+        if(be->rxfd < 0)
+          {
+            perror(in);
+            return -1;
+          }
+      }
+    if(out && out[1])
+      {
+        be->txfd = open(out+1, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(be->txfd < 0)
+          {
+            perror(out+1);
+            return -1;
+          }
+      }
+    be->lossy = (be->txfd < 0); //output not wanted
+    return 0;
+  }
+
+static void file_close(struct sci_backend *be)
+  {
+    if(be->rxfd >= 0) close(be->rxfd);
+    if(be->txfd >= 0) close(be->txfd);
+    be->rxfd = -1;
+    be->txfd = -1;
+  }
+
+//=============================================================================
+//backends that are ready as soon as they are open
+static int nop_accept(struct sci_backend *be, int wakefd)
+  {
+    return 0;
+  }
+
+static void nop_hangup(struct sci_backend *be)
+  {
+  }
+
+static const struct sci_backend_ops backends[] =
+  {
+    {"tcp"  , tcp_open  , tcp_accept , sock_hangup, sock_close },
+    {"unix" , unix_open , sock_accept, sock_hangup, unix_close },
+    {"pty"  , pty_open  , nop_accept , nop_hangup , pty_close  },
+    {"stdio", stdio_open, nop_accept , nop_hangup , stdio_close},
+    {"file" , file_open , nop_accept , nop_hangup , file_close },
+  };
+
+//spec is name[:arg], see sci_backend_help
+int sci_backend_open(struct sci_backend *be, struct hc11_core *core, const char *spec)
+  {
+    const char *arg;
+    size_t len;
+    int i;
+
+    if(!spec)
+      {
+        spec = SCI_BACKEND_DEFAULT;
+      }
+    arg = strchr(spec, ':');
+    len = arg ? (size_t)(arg - spec) : strlen(spec);
+    if(arg)
+      {
+        arg++;
+      }
+
+    be->core      = core;
+    be->lfd       = -1;
+    be->rxfd      = -1;
+    be->txfd      = -1;
+    be->keepfd    = -1;
+    be->reconnect = false;
+    be->lossy     = false;
+    be->rawtty    = false;
+    be->path[0]   = 0;
+
+    for(i=0;i<sizeof(backends)/sizeof(backends[0]);i++)
+      {
+        if(strlen(backends[i].name) == len && !strncmp(backends[i].name, spec, len))
+          {
+            be->ops = &backends[i];
+            if(be->ops->open(be, arg) < 0)
+              {
+                be->ops->close(be);
+                return -1;
+              }
+            return 0;
+          }
+      }
+    fprintf(stderr, "sci: unknown backend: %s\n", spec);
+    return -1;
+  }
+
+void sci_backend_close(struct sci_backend *be)
+  {
+    be->ops->close(be);
+  }
+
+void sci_backend_help(void)
+  {
+    printf("  SCI backends:\n"
+           "    tcp[:port]      listen on a TCP port (default %s)\n"
+           "    unix:path       listen on a unix domain socket\n"
+           "    pty             create a pseudo terminal, its name is printed\n"
+           "    stdio           use standard input and output\n"
+           "    file:[in],[out] read input from a file, write output to a file\n",
+           SCI_BACKEND_DEFAULT);
+  }
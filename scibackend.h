@@ -0,0 +1,44 @@
+#ifndef __scibackend__h__
+#define __scibackend__h__
+
+#include <stdbool.h>
+#include <termios.h>
+
+#define SCI_BACKEND_DEFAULT "tcp:3334"
+
+struct sci_backend;
+struct hc11_core;
+
+struct sci_backend_ops
+  {
+    const char *name;
+    int  (*open  )(struct sci_backend *be, const char *arg); //setup, -1 on error
+    int  (*accept)(struct sci_backend *be, int wakefd);      //wait for a peer, -1 to stop
+    void (*hangup)(struct sci_backend *be);                  //peer is gone
+    void (*close )(struct sci_backend *be);
+  };
+
+/* Host side of the SCI. Once a peer is accepted, bytes are read from rxfd and
+ * written to txfd (which may be the same descriptor). rxfd is -1 when there
+ * is no more input. */
+struct sci_backend
+  {
+    const struct sci_backend_ops *ops;
+    struct hc11_core *core; //for log messages
+    int  lfd;       //listening socket, or -1
+    int  rxfd;
+    int  txfd;
+    int  keepfd;    //kept open for the backend lifetime (pty slave), or -1
+    bool reconnect; //on end of input, hang up and accept a new peer
+    bool lossy;     //nobody may be reading, output is dropped when it backs up
+    bool rawtty;    //saved terminal settings must be restored
+    struct termios saved;
+    char path[108]; //unix socket path, pty name
+  };
+
+int  sci_backend_open (struct sci_backend *be, struct hc11_core *core,
+                       const char *spec);
+void sci_backend_close(struct sci_backend *be);
+void sci_backend_help (void);
+
+#endif /* __scibackend__h__ */
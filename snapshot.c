@@ -0,0 +1,919 @@
+/* machine state snapshots */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "core.h"
+#include "snapshot.h"
+#include "log.h"
+#include "history.h"
+
+/* File format: 8 bytes magic, one version byte, then sections:
+ *   char[8] name, zero padded
+ *   uint32  payload length
+ *   payload
+ * All values are little endian. Sections with an unknown name are skipped.
+ *   core : registers and execution state
+ *   iram : 256 bytes of internal RAM
+ *   mem  : uint16 start, uint16 len, contents of a RAM mapping
+ *   other: registered peripherals, see hc11_snapshot_register
+ */
+static const char snapshot_magic[8] = "HC11SNP";
+
+/* Checkpoint chain: 8 bytes magic, one version byte, then frames:
+ *   uint8   SNAPCHAIN_KEY or SNAPCHAIN_DELTA
+ *   uint32  length of the rest of the frame
+ *   uint64  clock count
+ *   sections as in a snapshot. Delta frames replace the mem sections by pages
+ *   sections: uint16 start, uint16 len of the mapping, then runs of
+ *   uint16 offset, uint16 count, data for the pages written since the
+ *   previous frame.
+ */
+static const char snapchain_magic[8] = "HC11CKP";
+
+static int snapchain_load(struct hc11_core *core, struct hc11_snapbuf *buf,
+                          int index);
+
+void snap_init(struct hc11_snapbuf *buf)
+  {
+    buf->data = NULL;
+    buf->len  = 0;
+    buf->size = 0;
+    buf->pos  = 0;
+    buf->err  = false;
+  }
+
+void snap_free(struct hc11_snapbuf *buf)
+  {
+    free(buf->data);
+    snap_init(buf);
+  }
+
+void snap_put(struct hc11_snapbuf *buf, const void *src, size_t len)
+  {
+    uint8_t *data;
+    size_t size;
+
+    if(buf->len + len > buf->size)
+      {
+        size = buf->size ? buf->size : 4096;
+        while(size < buf->len + len)
+          {
+            size <<= 1;
+          }
+        data = realloc(buf->data, size);
+        if(!data)
+          {
+            buf->err = true;
+            return;
+          }
+        buf->data = data;
+        buf->size = size;
+      }
+    memcpy(buf->data + buf->len, src, len);
+    buf->len += len;
+  }
+
+void snap_put8(struct hc11_snapbuf *buf, uint8_t val)
+  {
+    snap_put(buf, &val, 1);
+  }
+
+void snap_put16(struct hc11_snapbuf *buf, uint16_t val)
+  {
+    snap_put8(buf, val     );
+    snap_put8(buf, val >> 8);
+  }
+
+void snap_put32(struct hc11_snapbuf *buf, uint32_t val)
+  {
+    snap_put16(buf, val      );
+    snap_put16(buf, val >> 16);
+  }
+
+void snap_put64(struct hc11_snapbuf *buf, uint64_t val)
+  {
+    snap_put32(buf, val      );
+    snap_put32(buf, val >> 32);
+  }
+
+void snap_get(struct hc11_snapbuf *buf, void *dst, size_t len)
+  {
+    if(buf->err || buf->pos + len > buf->len)
+      {
+        buf->err = true;
+        memset(dst, 0, len);
+        return;
+      }
+    memcpy(dst, buf->data + buf->pos, len);
+    buf->pos += len;
+  }
+
+uint8_t snap_get8(struct hc11_snapbuf *buf)
+  {
+    uint8_t val;
+    snap_get(buf, &val, 1);
+    return val;
+  }
+
+uint16_t snap_get16(struct hc11_snapbuf *buf)
+  {
+    uint16_t val = snap_get8(buf);
+    return val | ((uint16_t)snap_get8(buf) << 8);
+  }
+
+uint32_t snap_get32(struct hc11_snapbuf *buf)
+  {
+    uint32_t val = snap_get16(buf);
+    return val | ((uint32_t)snap_get16(buf) << 16);
+  }
+
+uint64_t snap_get64(struct hc11_snapbuf *buf)
+  {
+    uint64_t val = snap_get32(buf);
+    return val | ((uint64_t)snap_get32(buf) << 32);
+  }
+
+void snap_put_event(struct hc11_snapbuf *buf, struct hc11_core *core, int id)
+  {
+    snap_put64(buf, hc11_core_event_delay(core, id));
+  }
+
+void snap_get_event(struct hc11_snapbuf *buf, struct hc11_core *core, int id)
+  {
+    uint64_t delay = snap_get64(buf);
+    if(delay == HC11_EVENT_NONE)
+      {
+        hc11_core_event_cancel(core, id);
+      }
+    else
+      {
+        hc11_core_event_schedule(core, id, delay);
+      }
+  }
+
+int hc11_snapshot_register(struct hc11_core *core, const char *name, void *ctx,
+                           snapsave_f save, snapload_f load)
+  {
+    int i;
+    for(i=0;i<HC11_STATE_NUM;i++)
+      {
+        if(core->states[i].save == NULL)
+          {
+            strncpy(core->states[i].name, name, sizeof(core->states[i].name));
+            core->states[i].ctx  = ctx;
+            core->states[i].save = save;
+            core->states[i].load = load;
+            return 0;
+          }
+      }
+    log_msg(core, SYS_CORE, CORE_ERROR, "ERROR - no free snapshot slot\n");
+    return -1;
+  }
+
+//=============================================================================
+//sections
+
+static size_t snapshot_section(struct hc11_snapbuf *buf, const char *name)
+  {
+    char tag[8];
+    size_t pos;
+
+    memset(tag, 0, sizeof(tag));
+    strncpy(tag, name, sizeof(tag));
+    snap_put(buf, tag, sizeof(tag));
+    pos = buf->len;
+    snap_put32(buf, 0); //patched by snapshot_section_end
+    return pos;
+  }
+
+static void snapshot_section_end(struct hc11_snapbuf *buf, size_t pos)
+  {
+    uint32_t len = buf->len - pos - 4;
+    if(!buf->err)
+      {
+        buf->data[pos  ] = len;
+        buf->data[pos+1] = len >> 8;
+        buf->data[pos+2] = len >> 16;
+        buf->data[pos+3] = len >> 24;
+      }
+  }
+
+static void snapshot_save_core(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    snap_put16(buf, core->regs.pc);
+    snap_put16(buf, core->regs.sp);
+    snap_put16(buf, core->regs.d );
+    snap_put16(buf, core->regs.x );
+    snap_put16(buf, core->regs.y );
+    snap_put8 (buf, core->regs.ccr);
+    snap_put64(buf, core->clocks);
+    snap_put16(buf, core->rambase);
+    snap_put16(buf, core->iobase);
+    snap_put16(buf, core->state);
+    snap_put16(buf, core->busadr);
+    snap_put16(buf, core->busdat);
+    snap_put8 (buf, core->prefix);
+    snap_put8 (buf, core->opcode);
+    snap_put8 (buf, core->addmode);
+    snap_put16(buf, core->operand);
+    snap_put8 (buf, core->op2);
+    snap_put8 (buf, core->op3);
+    snap_put8 (buf, core->pulsel);
+    snap_put8 (buf, core->stackcnt);
+    snap_put16(buf, core->irqvec);
+    snap_put16(buf, core->pc_opcode);
+    snap_put32(buf, core->irq_pending);
+  }
+
+static int snapshot_load_core(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    uint64_t clocks;
+
+    core->regs.pc  = snap_get16(buf);
+    core->regs.sp  = snap_get16(buf);
+    core->regs.d   = snap_get16(buf);
+    core->regs.x   = snap_get16(buf);
+    core->regs.y   = snap_get16(buf);
+    core->regs.ccr = snap_get8 (buf);
+    clocks         = snap_get64(buf);
+    core->rambase  = snap_get16(buf);
+    core->iobase   = snap_get16(buf);
+    core->state    = snap_get16(buf);
+    core->busadr   = snap_get16(buf);
+    core->busdat   = snap_get16(buf);
+    core->prefix   = snap_get8 (buf);
+    core->opcode   = snap_get8 (buf);
+    core->addmode  = snap_get8 (buf);
+    core->operand  = snap_get16(buf);
+    core->op2      = snap_get8 (buf);
+    core->op3      = snap_get8 (buf);
+    core->pulsel   = snap_get8 (buf);
+    core->stackcnt = snap_get8 (buf);
+    core->irqvec   = snap_get16(buf);
+    core->pc_opcode   = snap_get16(buf);
+    core->irq_pending = snap_get32(buf);
+
+    //events not restored by their owner keep the same distance to the clock
+    hc11_core_set_clocks(core, clocks);
+    core->ncalls = 0; //not saved, rebuilt by the next calls and returns
+    if(core->history)
+      {
+        hc11_history_clear(core->history);
+      }
+    return buf->err ? -1 : 0;
+  }
+
+static int snapshot_load_mem(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    struct hc11_mapping *cur;
+    uint16_t start = snap_get16(buf);
+    uint16_t len   = snap_get16(buf);
+
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(cur->start == start && cur->len == len && cur->mem && cur->wrf)
+          {
+            snap_get(buf, cur->mem, len);
+            hc11_core_mem_touch(core, start, len);
+            return buf->err ? -1 : 0;
+          }
+      }
+    printf("snapshot: no %u bytes RAM mapping at %04X\n", len, start);
+    return -1;
+  }
+
+//runs of pages of a mapping written since the given memory epoch
+static void snapshot_save_pages(struct hc11_core *core, struct hc11_snapbuf *buf,
+                                struct hc11_mapping *map, uint32_t since)
+  {
+    uint32_t end = (uint32_t)map->start + map->len;
+    uint32_t adr, next, run;
+
+    snap_put16(buf, map->start);
+    snap_put16(buf, map->len);
+    adr = map->start;
+    while(adr < end)
+      {
+        next = ((adr >> HC11_PAGE_SHIFT) + 1) << HC11_PAGE_SHIFT;
+        if(!hc11_core_page_dirty(core, adr >> HC11_PAGE_SHIFT, since))
+          {
+            adr = next;
+            continue;
+          }
+        //extend the run over the following dirty pages
+        run = adr;
+        while(next < end && hc11_core_page_dirty(core, next >> HC11_PAGE_SHIFT, since))
+          {
+            next += HC11_PAGE_SIZE;
+          }
+        if(next > end)
+          {
+            next = end;
+          }
+        snap_put16(buf, run - map->start);
+        snap_put16(buf, next - run);
+        snap_put(buf, map->mem + (run - map->start), next - run);
+        adr = next;
+      }
+  }
+
+static int snapshot_load_pages(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    struct hc11_mapping *cur;
+    uint16_t start = snap_get16(buf);
+    uint16_t len   = snap_get16(buf);
+    uint16_t off, count;
+
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(cur->start == start && cur->len == len && cur->mem && cur->wrf)
+          {
+            break;
+          }
+      }
+    if(!cur)
+      {
+        printf("snapshot: no %u bytes RAM mapping at %04X\n", len, start);
+        return -1;
+      }
+    while(!buf->err && buf->pos < buf->len)
+      {
+        off   = snap_get16(buf);
+        count = snap_get16(buf);
+        if((uint32_t)off + count > len)
+          {
+            return -1;
+          }
+        snap_get(buf, cur->mem + off, count);
+        hc11_core_mem_touch(core, start + off, count);
+      }
+    return buf->err ? -1 : 0;
+  }
+
+//which memory is saved with the machine state
+enum
+  {
+    SNAP_MEM_ALL,   //complete RAM mappings
+    SNAP_MEM_DIRTY, //pages written since a memory checkpoint
+    SNAP_MEM_NONE,
+  };
+
+static void snapshot_save_body(struct hc11_core *core, struct hc11_snapbuf *buf,
+                               int mem, uint32_t since)
+  {
+    struct hc11_mapping *cur;
+    size_t sec;
+    int i;
+
+    sec = snapshot_section(buf, "core");
+    snapshot_save_core(core, buf);
+    snapshot_section_end(buf, sec);
+
+    sec = snapshot_section(buf, "iram");
+    snap_put(buf, core->iram, sizeof(core->iram));
+    snapshot_section_end(buf, sec);
+
+    //register page as the debugger sees it, for inspection only: the
+    //peripherals restore their own state from their sections
+    sec = snapshot_section(buf, "io");
+    snap_put16(buf, core->iobase);
+    for(i=0;i<64;i++)
+      {
+        snap_put8(buf, hc11_core_debug_readb(core, core->iobase + i));
+      }
+    snapshot_section_end(buf, sec);
+
+    //only writable memory, rom comes from the command line
+    for(cur = core->maps; cur != NULL && mem != SNAP_MEM_NONE; cur = cur->next)
+      {
+        if(cur->mem && cur->wrf)
+          {
+            sec = snapshot_section(buf, (mem == SNAP_MEM_DIRTY) ? "pages" : "mem");
+            if(mem == SNAP_MEM_DIRTY)
+              {
+                snapshot_save_pages(core, buf, cur, since);
+              }
+            else
+              {
+                snap_put16(buf, cur->start);
+                snap_put16(buf, cur->len);
+                snap_put(buf, cur->mem, cur->len);
+              }
+            snapshot_section_end(buf, sec);
+          }
+      }
+
+    for(i=0;i<HC11_STATE_NUM;i++)
+      {
+        if(core->states[i].save)
+          {
+            sec = snapshot_section(buf, core->states[i].name);
+            core->states[i].save(core->states[i].ctx, buf);
+            snapshot_section_end(buf, sec);
+          }
+      }
+  }
+
+static int snapshot_load_body(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    struct hc11_snapbuf sec;
+    char name[9];
+    uint32_t len;
+    int ret;
+    int i;
+
+    while(buf->pos < buf->len)
+      {
+        snap_get(buf, name, 8);
+        name[8] = 0;
+        len = snap_get32(buf);
+        if(buf->err || buf->pos + len > buf->len)
+          {
+            printf("snapshot: truncated\n");
+            return -1;
+          }
+        //section contents are read through their own cursor
+        snap_init(&sec);
+        sec.data = buf->data + buf->pos;
+        sec.len  = len;
+        buf->pos += len;
+
+        if(!strcmp(name, "core"))
+          {
+            ret = snapshot_load_core(core, &sec);
+          }
+        else if(!strcmp(name, "iram"))
+          {
+            snap_get(&sec, core->iram, sizeof(core->iram));
+            ret = sec.err ? -1 : 0;
+          }
+        else if(!strcmp(name, "io"))
+          {
+            ret = 0;
+          }
+        else if(!strcmp(name, "mem"))
+          {
+            ret = snapshot_load_mem(core, &sec);
+          }
+        else if(!strcmp(name, "pages"))
+          {
+            ret = snapshot_load_pages(core, &sec);
+          }
+        else
+          {
+            ret = 0;
+            for(i=0;i<HC11_STATE_NUM;i++)
+              {
+                if(core->states[i].load && !strncmp(core->states[i].name, name, 8))
+                  {
+                    ret = core->states[i].load(core->states[i].ctx, &sec);
+                    if(sec.err)
+                      {
+                        ret = -1;
+                      }
+                    break;
+                  }
+              }
+            if(i == HC11_STATE_NUM)
+              {
+                printf("snapshot: skipping unknown section %s\n", name);
+              }
+          }
+        if(ret < 0)
+          {
+            printf("snapshot: bad %s section\n", name);
+            return -1;
+          }
+      }
+    return 0;
+  }
+
+int hc11_snapshot_save(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    snap_put(buf, snapshot_magic, sizeof(snapshot_magic));
+    snap_put8(buf, SNAPSHOT_VERSION);
+    snapshot_save_body(core, buf, SNAP_MEM_ALL, 0);
+    return buf->err ? -1 : 0;
+  }
+
+int hc11_snapshot_load(struct hc11_core *core, struct hc11_snapbuf *buf)
+  {
+    char magic[sizeof(snapshot_magic)];
+
+    snap_get(buf, magic, sizeof(magic));
+    if(buf->err || memcmp(magic, snapshot_magic, sizeof(magic)))
+      {
+        printf("snapshot: bad magic\n");
+        return -1;
+      }
+    if(snap_get8(buf) != SNAPSHOT_VERSION)
+      {
+        printf("snapshot: unsupported version\n");
+        return -1;
+      }
+    return snapshot_load_body(core, buf);
+  }
+
+int hc11_snapshot_write(struct hc11_core *core, const char *fname)
+  {
+    struct hc11_snapbuf buf;
+    FILE *f;
+    int ret = -1;
+
+    snap_init(&buf);
+    if(hc11_snapshot_save(core, &buf) < 0)
+      {
+        printf("snapshot: out of memory\n");
+        goto done;
+      }
+    f = fopen(fname, "wb");
+    if(!f)
+      {
+        printf("snapshot: cannot create %s\n", fname);
+        goto done;
+      }
+    if(fwrite(buf.data, 1, buf.len, f) == buf.len)
+      {
+        ret = 0;
+      }
+    if(fclose(f) != 0)
+      {
+        ret = -1;
+      }
+    if(ret < 0)
+      {
+        printf("snapshot: cannot write %s\n", fname);
+      }
+done:
+    snap_free(&buf);
+    return ret;
+  }
+
+//whole file in a buffer
+static int snapshot_readfile(const char *fname, struct hc11_snapbuf *buf)
+  {
+    FILE *f;
+    long size;
+    int ret = -1;
+
+    snap_init(buf);
+    f = fopen(fname, "rb");
+    if(!f)
+      {
+        printf("snapshot: cannot open %s\n", fname);
+        return -1;
+      }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    buf->data = malloc(size > 0 ? size : 1);
+    if(buf->data && fread(buf->data, 1, size, f) == (size_t)size)
+      {
+        buf->len  = size;
+        buf->size = size;
+        ret = 0;
+      }
+    else
+      {
+        printf("snapshot: cannot read %s\n", fname);
+        snap_free(buf);
+      }
+    fclose(f);
+    return ret;
+  }
+
+//a snapshot file or the last frame of a checkpoint chain
+int hc11_snapshot_read(struct hc11_core *core, const char *fname)
+  {
+    struct hc11_snapbuf buf;
+    int ret;
+
+    if(snapshot_readfile(fname, &buf) < 0)
+      {
+        return -1;
+      }
+    if(buf.len >= sizeof(snapchain_magic) &&
+       !memcmp(buf.data, snapchain_magic, sizeof(snapchain_magic)))
+      {
+        ret = snapchain_load(core, &buf, -1);
+      }
+    else
+      {
+        ret = hc11_snapshot_load(core, &buf);
+      }
+    snap_free(&buf);
+    return ret;
+  }
+
+//=============================================================================
+//checkpoint chains
+
+struct hc11_snapchain
+  {
+    struct hc11_core *core;
+    FILE     *f;
+    unsigned keyint; //frames between two keyframes
+    unsigned count;  //frames written
+    uint32_t epoch;  //memory checkpoint of the previous frame
+  };
+
+struct hc11_snapchain *hc11_snapchain_create(struct hc11_core *core,
+                                             const char *fname, unsigned keyint)
+  {
+    struct hc11_snapchain *chain;
+
+    chain = malloc(sizeof(struct hc11_snapchain));
+    if(!chain)
+      {
+        return NULL;
+      }
+    chain->f = fopen(fname, "wb");
+    if(!chain->f)
+      {
+        printf("snapshot: cannot create %s\n", fname);
+        free(chain);
+        return NULL;
+      }
+    chain->core   = core;
+    chain->keyint = keyint ? keyint : 1;
+    chain->count  = 0;
+    chain->epoch  = 0;
+    fwrite(snapchain_magic, 1, sizeof(snapchain_magic), chain->f);
+    fputc(SNAPSHOT_VERSION, chain->f);
+    return chain;
+  }
+
+//append a frame: a keyframe every keyint frames, else the pages written since
+//the previous frame
+int hc11_snapchain_append(struct hc11_snapchain *chain)
+  {
+    struct hc11_snapbuf buf;
+    bool key = (chain->count % chain->keyint) == 0;
+    int ret = 0;
+
+    snap_init(&buf);
+    snap_put8 (&buf, key ? SNAPCHAIN_KEY : SNAPCHAIN_DELTA);
+    snap_put32(&buf, 0); //body length, patched below
+    snap_put64(&buf, chain->core->clocks);
+    snapshot_save_body(chain->core, &buf, key ? SNAP_MEM_ALL : SNAP_MEM_DIRTY, chain->epoch);
+    chain->epoch = hc11_core_mem_checkpoint(chain->core);
+    if(buf.err)
+      {
+        snap_free(&buf);
+        return -1;
+      }
+    snapshot_section_end(&buf, 1);
+    if(fwrite(buf.data, 1, buf.len, chain->f) != buf.len || fflush(chain->f) != 0)
+      {
+        printf("snapshot: cannot write checkpoint\n");
+        ret = -1;
+      }
+    chain->count += 1;
+    snap_free(&buf);
+    return ret;
+  }
+
+void hc11_snapchain_close(struct hc11_snapchain *chain)
+  {
+    fclose(chain->f);
+    free(chain);
+  }
+
+//restore frame index (last one if -1): from the closest keyframe before it,
+//apply each following delta
+static int snapchain_load(struct hc11_core *core, struct hc11_snapbuf *buf,
+                          int index)
+  {
+    struct hc11_snapbuf frame;
+    size_t keypos = 0;
+    int keyidx = -1;
+    int count;
+    uint32_t len;
+    uint8_t kind;
+
+    //first pass: find the keyframe
+    buf->pos = sizeof(snapchain_magic);
+    if(snap_get8(buf) != SNAPSHOT_VERSION)
+      {
+        printf("snapshot: unsupported version\n");
+        return -1;
+      }
+    for(count = 0; buf->pos < buf->len && (index < 0 || count <= index); count++)
+      {
+        kind = snap_get8(buf);
+        len  = snap_get32(buf);
+        if(buf->err || buf->pos + len > buf->len)
+          {
+            break; //incomplete last frame of an interrupted run
+          }
+        if(len < 8)
+          {
+            printf("snapshot: corrupt frame %d in chain\n", count);
+            return -1; //no room for the clock count
+          }
+        if(kind == SNAPCHAIN_KEY)
+          {
+            keypos = buf->pos - 5;
+            keyidx = count;
+          }
+        buf->pos += len;
+      }
+    if(keyidx < 0 || (index >= 0 && count <= index))
+      {
+        printf("snapshot: no frame %d in chain\n", index);
+        return -1;
+      }
+
+    //second pass: load the keyframe and the deltas up to the frame
+    buf->err = false;
+    buf->pos = keypos;
+    for(count -= keyidx; count > 0; count--)
+      {
+        kind = snap_get8 (buf);
+        len  = snap_get32(buf);
+        snap_get64(buf); //clocks, also in the core section
+        snap_init(&frame);
+        frame.data = buf->data + buf->pos;
+        frame.len  = len - 8;
+        buf->pos  += len - 8;
+        if(snapshot_load_body(core, &frame) < 0)
+          {
+            return -1;
+          }
+      }
+    return 0;
+  }
+
+int hc11_snapchain_read(struct hc11_core *core, const char *fname, int index)
+  {
+    struct hc11_snapbuf buf;
+    int ret = -1;
+
+    if(snapshot_readfile(fname, &buf) < 0)
+      {
+        return -1;
+      }
+    if(buf.len >= sizeof(snapchain_magic) &&
+       !memcmp(buf.data, snapchain_magic, sizeof(snapchain_magic)))
+      {
+        ret = snapchain_load(core, &buf, index);
+      }
+    else
+      {
+        printf("snapshot: %s is not a checkpoint chain\n", fname);
+      }
+    snap_free(&buf);
+    return ret;
+  }
+
+//=============================================================================
+//baselines: fast return to a captured state
+
+struct baseline_mem
+  {
+    struct hc11_mapping *map;
+    uint8_t             *copy;
+  };
+
+struct hc11_baseline
+  {
+    struct hc11_core    *core;
+    struct hc11_snapbuf  state; //everything but the RAM mappings
+    struct baseline_mem *mem;
+    int                  nmem;
+    uint32_t             epoch; //pages written since differ from the copies
+  };
+
+//Pages still zero are left out of the copy, which then takes no memory for
+//them. Many instances mostly differ in the few pages their firmware uses.
+static uint8_t *baseline_copy(struct hc11_mapping *map)
+  {
+    static const uint8_t zero[HC11_PAGE_SIZE];
+    uint8_t *copy;
+    uint32_t off;
+    uint32_t len;
+
+    copy = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(copy == MAP_FAILED)
+      {
+        return NULL;
+      }
+    for(off = 0; off < map->len; off += len)
+      {
+        len = (map->len - off < HC11_PAGE_SIZE) ? map->len - off : HC11_PAGE_SIZE;
+        if(memcmp(map->mem + off, zero, len))
+          {
+            memcpy(copy + off, map->mem + off, len);
+          }
+      }
+    return copy;
+  }
+
+struct hc11_baseline *hc11_baseline_capture(struct hc11_core *core)
+  {
+    struct hc11_baseline *b;
+    struct hc11_mapping *cur;
+    int n = 0;
+
+    b = malloc(sizeof(struct hc11_baseline));
+    if(!b)
+      {
+        return NULL;
+      }
+    b->core = core;
+    b->nmem = 0;
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(cur->mem && cur->wrf)
+          {
+            n++;
+          }
+      }
+    b->mem = calloc(n ? n : 1, sizeof(struct baseline_mem));
+    snap_init(&b->state);
+    if(!b->mem)
+      {
+        goto fail;
+      }
+    for(cur = core->maps; cur != NULL; cur = cur->next)
+      {
+        if(cur->mem && cur->wrf)
+          {
+            b->mem[b->nmem].map  = cur;
+            b->mem[b->nmem].copy = baseline_copy(cur);
+            if(!b->mem[b->nmem].copy)
+              {
+                goto fail;
+              }
+            b->nmem++;
+          }
+      }
+    snapshot_save_body(core, &b->state, SNAP_MEM_NONE, 0);
+    if(b->state.err)
+      {
+        goto fail;
+      }
+    b->epoch = hc11_core_mem_checkpoint(core);
+    return b;
+
+fail:
+    printf("baseline: out of memory\n");
+    hc11_baseline_free(b);
+    return NULL;
+  }
+
+//copy back the pages written since the capture (or the previous restore),
+//then reload the cpu and peripheral state
+int hc11_baseline_restore(struct hc11_baseline *b)
+  {
+    struct hc11_core *core = b->core;
+    struct hc11_mapping *map;
+    uint32_t adr, end, next;
+    int i;
+
+    for(i=0;i<b->nmem;i++)
+      {
+        map = b->mem[i].map;
+        end = (uint32_t)map->start + map->len;
+        for(adr = map->start; adr < end; adr = next)
+          {
+            next = ((adr >> HC11_PAGE_SHIFT) + 1) << HC11_PAGE_SHIFT;
+            if(next > end)
+              {
+                next = end;
+              }
+            if(hc11_core_page_dirty(core, adr >> HC11_PAGE_SHIFT, b->epoch))
+              {
+                memcpy(map->mem + (adr - map->start),
+                       b->mem[i].copy + (adr - map->start), next - adr);
+                hc11_core_mem_touch(core, adr, next - adr); //changed for others
+              }
+          }
+      }
+    b->state.pos = 0;
+    if(snapshot_load_body(core, &b->state) < 0)
+      {
+        return -1;
+      }
+    b->epoch = hc11_core_mem_checkpoint(core);
+    return 0;
+  }
+
+void hc11_baseline_free(struct hc11_baseline *b)
+  {
+    int i;
+    for(i=0;b->mem && i<b->nmem;i++)
+      {
+        munmap(b->mem[i].copy, b->mem[i].map->len);
+      }
+    free(b->mem);
+    snap_free(&b->state);
+    free(b);
+  }
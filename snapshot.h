@@ -0,0 +1,79 @@
+#ifndef __snapshot__h__
+#define __snapshot__h__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "core.h"
+
+/* Machine snapshots: cpu registers and execution state, internal RAM, the
+ * contents of RAM mappings and the state of registered peripherals.
+ * ROM contents and host side state (connections, fifos) are not saved, a
+ * snapshot must be loaded in a simulator started with the same options. */
+
+#define SNAPSHOT_VERSION 1
+
+#define SNAPCHAIN_KEY   'K'
+#define SNAPCHAIN_DELTA 'D'
+#define SNAPCHAIN_KEYINT 16 //default frames between two keyframes
+
+//growable byte buffer, also used as a read cursor when loading
+struct hc11_snapbuf
+  {
+    uint8_t *data;
+    size_t  len;  //bytes written
+    size_t  size; //bytes allocated
+    size_t  pos;  //read position
+    bool    err;  //overflow on read or allocation failure
+  };
+
+void snap_init(struct hc11_snapbuf *buf);
+void snap_free(struct hc11_snapbuf *buf);
+
+void snap_put  (struct hc11_snapbuf *buf, const void *src, size_t len);
+void snap_put8 (struct hc11_snapbuf *buf, uint8_t  val);
+void snap_put16(struct hc11_snapbuf *buf, uint16_t val);
+void snap_put32(struct hc11_snapbuf *buf, uint32_t val);
+void snap_put64(struct hc11_snapbuf *buf, uint64_t val);
+
+void     snap_get  (struct hc11_snapbuf *buf, void *dst, size_t len);
+uint8_t  snap_get8 (struct hc11_snapbuf *buf);
+uint16_t snap_get16(struct hc11_snapbuf *buf);
+uint32_t snap_get32(struct hc11_snapbuf *buf);
+uint64_t snap_get64(struct hc11_snapbuf *buf);
+
+//core events, saved as a delay from the current clock
+void snap_put_event(struct hc11_snapbuf *buf, struct hc11_core *core, int id);
+void snap_get_event(struct hc11_snapbuf *buf, struct hc11_core *core, int id);
+
+//register a peripheral, name identifies its section in the snapshot
+int hc11_snapshot_register(struct hc11_core *core, const char *name, void *ctx,
+                           snapsave_f save, snapload_f load);
+
+int hc11_snapshot_save (struct hc11_core *core, struct hc11_snapbuf *buf);
+int hc11_snapshot_load (struct hc11_core *core, struct hc11_snapbuf *buf);
+int hc11_snapshot_write(struct hc11_core *core, const char *fname);
+int hc11_snapshot_read (struct hc11_core *core, const char *fname);
+
+/* Checkpoint chains: frequent snapshots appended to one file, only the RAM
+ * pages written since the previous frame are stored, with a complete
+ * keyframe every keyint frames. */
+struct hc11_snapchain;
+
+struct hc11_snapchain *hc11_snapchain_create(struct hc11_core *core,
+                                             const char *fname, unsigned keyint);
+int  hc11_snapchain_append(struct hc11_snapchain *chain);
+void hc11_snapchain_close (struct hc11_snapchain *chain);
+int  hc11_snapchain_read  (struct hc11_core *core, const char *fname, int index);
+
+/* Baselines: an in-memory copy of the machine to come back to quickly, for
+ * batch and fuzz loops. Restoring copies back only the RAM pages written
+ * since the capture or the previous restore. */
+struct hc11_baseline;
+
+struct hc11_baseline *hc11_baseline_capture(struct hc11_core *core);
+int  hc11_baseline_restore(struct hc11_baseline *b);
+void hc11_baseline_free   (struct hc11_baseline *b);
+
+#endif /* __snapshot__h__ */
@@ -7,31 +7,47 @@
 # N = 0x08
 SIM="./sim -g -w --run"
 
-#test rotations in A and B
-echo ROLA
-#ROLA,C=0, each bit. Carry set is MSB of reg is rolled left, Neg set if 0x40 rolls to 0x80, Cy set of 0x80 rolls to 0.
-#V set if N!=C
-${SIM} -pa=0x00,c=0,p=0xE000 -m0xE000,49 -ea=0x00,c=0x04 #Z=0x04
-${SIM} -pa=0x01,c=0,p=0xE000 -m0xE000,49 -ea=0x02,c=0x00
-${SIM} -pa=0x02,c=0,p=0xE000 -m0xE000,49 -ea=0x04,c=0x00
-${SIM} -pa=0x04,c=0,p=0xE000 -m0xE000,49 -ea=0x08,c=0x00
-${SIM} -pa=0x08,c=0,p=0xE000 -m0xE000,49 -ea=0x10,c=0x00
-${SIM} -pa=0x10,c=0,p=0xE000 -m0xE000,49 -ea=0x20,c=0x00
-${SIM} -pa=0x20,c=0,p=0xE000 -m0xE000,49 -ea=0x40,c=0x00
-${SIM} -pa=0x40,c=0,p=0xE000 -m0xE000,49 -ea=0x80,c=0x0A #N
-${SIM} -pa=0x80,c=0,p=0xE000 -m0xE000,49 -ea=0x00,c=0x07 #C,Z
+#instruction vectors run in-process, see isa.vec
+echo ISA
+./vecrun -q isa.vec
 
-echo ROLB
-#ROLA,C=0, each bit. Carry set is MSB of reg is rolled left, Neg set if 0x40 rolls to 0x80, Cy set of 0x80 rolls to 0.
-#V set if N!=C
-${SIM} -pb=0x00,c=0,p=0xE000 -m0xE000,59 -eb=0x00,c=0x04 #Z=0x04
-${SIM} -pb=0x01,c=0,p=0xE000 -m0xE000,59 -eb=0x02,c=0x00
-${SIM} -pb=0x02,c=0,p=0xE000 -m0xE000,59 -eb=0x04,c=0x00
-${SIM} -pb=0x04,c=0,p=0xE000 -m0xE000,59 -eb=0x08,c=0x00
-${SIM} -pb=0x08,c=0,p=0xE000 -m0xE000,59 -eb=0x10,c=0x00
-${SIM} -pb=0x10,c=0,p=0xE000 -m0xE000,59 -eb=0x20,c=0x00
-${SIM} -pb=0x20,c=0,p=0xE000 -m0xE000,59 -eb=0x40,c=0x00
-${SIM} -pb=0x40,c=0,p=0xE000 -m0xE000,59 -eb=0x80,c=0x0A #N
-${SIM} -pb=0x80,c=0,p=0xE000 -m0xE000,59 -eb=0x00,c=0x07 #C,Z
+#flag results of ALU instructions over all operands, against reference kernels
+echo ALU
+./alucheck -q ADDA ADCA CMPA ABA NEGA NEGB MUL IDIV FDIV
 
+echo SCI
+#TIE|TE with TDRE set: interrupt taken after CLI, 9 bytes stacked, I set in ISR (TEST at E100 stops)
+${SIM} -pp=0xE000 -m0xE000,8E00FF8688B7102D0E20FE -m0xE100,00 -m0xFFD6,E100 -es=0x00F6,p=0xE101,c=0x18
+#ISR disables TIE and returns with RTI: registers restored from stack
+${SIM} -pp=0xE000 -m0xE000,8E00FF8688B7102D0E0100 -m0xE100,B6102E8600B7102D3B -m0xFFD6,E100 -es=0x00FF,a=0x88
 
+echo JOURNAL
+#record the echo of scripted SCI input, then replay it without any input
+JRN=${TMPDIR:-/tmp}/hc11_test_jrn
+printf 'hi q' > ${JRN}.in
+${SIM} -pp=0xE000 -m0xE000,860CB7102DB6102E842027F9F6102FB6102E2AFBF7102FC17126EAB6102E844027F900 --sci file:${JRN}.in, --record ${JRN} -eb=0x71,p=0xE023
+${SIM} -pp=0xE000 -m0xE000,860CB7102DB6102E842027F9F6102FB6102E2AFBF7102FC17126EAB6102E844027F900 --sci file:, --replay ${JRN} -eb=0x71,p=0xE023
+rm -f ${JRN} ${JRN}.in
+
+echo LOCKSTEP
+#SCI echo checked instruction by instruction against the bare state machine
+printf 'hi q' > ${JRN}.in
+${SIM} -pp=0xE000 -m0xE000,860CB7102DB6102E842027F9F6102FB6102E2AFBF7102FC17126EAB6102E844027F900 --sci file:${JRN}.in, --lockstep step,clock -eb=0x71,p=0xE023
+rm -f ${JRN}.in
+#three ROMs given in non address order, the shadow core must see the same contents
+head -c 16384 /dev/zero | tr '\000' '\021' > ${JRN}.rom1
+head -c 8192 /dev/zero | tr '\000' '\042' > ${JRN}.rom2
+${SIM} -b 0x8000,${JRN}.rom1 -b 0xC000,${JRN}.rom2 -pp=0x0100 -m0x0100,B68000F6C00000 --lockstep step,clock -ea=0x11,b=0x22,p=0x0107 > /dev/null || echo "WARNING lockstep: three ROM layout"
+rm -f ${JRN}.rom1 ${JRN}.rom2
+
+echo FUZZ
+#stand-in command parser: X runs an illegal opcode, R writes to ROM, S returns from the top level
+FW=8E01FF860CB7102DB6102E842027F9F6102FC158260141C1522603F7E000C15326013920E3
+FUZZ="./hc11fuzz -q -m E000,${FW} -p E000 -B 2000"
+printf 'a' > ${JRN}.in
+${FUZZ} ${JRN}.in || echo "WARNING fuzz: crash on harmless input"
+for c in X R S; do
+  printf "$c" > ${JRN}.in
+  ${FUZZ} ${JRN}.in > /dev/null && echo "WARNING fuzz: crash on $c not detected"
+done
+rm -f ${JRN}.in
@@ -0,0 +1,442 @@
+/* batch runner for instruction test vectors, see help() for the file format */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "core.h"
+#include "hc11sim.h"
+#include "snapshot.h"
+
+#define VEC_REGS    16
+#define VEC_BUDGET  1000000 //default clocks before a vector is declared hung
+
+struct vec_reg
+  {
+    int      reg;
+    uint16_t val;
+  };
+
+struct vec_mem
+  {
+    struct vec_mem *next;
+    uint16_t adr;
+    uint16_t len;
+    uint8_t  data[];
+  };
+
+struct vector
+  {
+    char            name[32];
+    const char     *file;
+    int             line;
+    struct vec_reg  preset[VEC_REGS];
+    int             npreset;
+    struct vec_reg  expect[VEC_REGS];
+    int             nexpect;
+    struct vec_mem *mem;    //preset memory and code
+    struct vec_mem *expmem; //expected memory
+    bool            checkclocks;
+    uint64_t        clocks;
+    uint64_t        budget;
+    //result
+    bool            pass;
+    uint64_t        took;
+    char            msg[128];
+  };
+
+struct batch
+  {
+    struct vector   *vecs;
+    int              count;
+    int              next; //next vector to run, taken atomically
+  };
+
+void help(void)
+  {
+    printf("vecrun [-j threads] [-q] <file>...\n"
+           "\n"
+           "  -j <n>  Number of worker threads, default one per cpu\n"
+           "  -q      Only report failures\n"
+           "\n"
+           "Runs each vector on a fresh machine (RAM at 0000-7FFF and E000-FFFF) and\n"
+           "prints a TAP report. The exit code is 1 if any vector failed.\n"
+           "One vector per line, blank lines and lines starting with # are ignored:\n"
+           "  name [-p<regs>] [-m<adr>,<hex>]... [-e<regs>] [-E<adr>,<hex>]... [-c<clocks>] [-b<budget>]\n"
+           "  -p  preset registers, reg=val comma-separated, reg in d,a,b,x,y,p,s,c\n"
+           "  -m  preset memory (code, data, vectors)\n"
+           "  -e  expected registers\n"
+           "  -E  expected memory\n"
+           "  -c  expected clock count, from the first fetch to the final TEST opcode\n"
+           "  -b  clocks before the vector is declared hung, default %d\n"
+           "Execution starts at the preset PC and must end with a TEST (00) opcode.\n",
+           VEC_BUDGET);
+  }
+
+static int vec_regnum(char name)
+  {
+    switch(name)
+      {
+        case 'd': return HC11_REG_D;
+        case 'a': return HC11_REG_A;
+        case 'b': return HC11_REG_B;
+        case 'x': return HC11_REG_X;
+        case 'y': return HC11_REG_Y;
+        case 'p': return HC11_REG_PC;
+        case 's': return HC11_REG_SP;
+        case 'c': return HC11_REG_CCR;
+      }
+    return -1;
+  }
+
+static const char *vec_regname(int reg)
+  {
+    static const char *names[HC11_REG_COUNT] = {"x", "d", "y", "s", "p", "a", "b", "c"};
+    return names[reg];
+  }
+
+static int vec_parse_regs(char *arg, struct vec_reg *regs, int *count)
+  {
+    char *tok;
+    char *end;
+
+    for(tok = strtok_r(arg, ",", &end); tok; tok = strtok_r(NULL, ",", &end))
+      {
+        if(*count == VEC_REGS || tok[1] != '=' || vec_regnum(tok[0]) < 0)
+          {
+            return -1;
+          }
+        regs[*count].reg = vec_regnum(tok[0]);
+        regs[*count].val = strtoul(tok + 2, NULL, 0);
+        *count += 1;
+      }
+    return 0;
+  }
+
+static int vec_parse_mem(char *arg, struct vec_mem **list)
+  {
+    struct vec_mem *m;
+    char *hex = strchr(arg, ',');
+    size_t len;
+    size_t i;
+    unsigned val;
+
+    if(!hex)
+      {
+        return -1;
+      }
+    *hex++ = 0;
+    len = strlen(hex);
+    if(len == 0 || (len & 1))
+      {
+        return -1;
+      }
+    len /= 2;
+    m = malloc(sizeof(struct vec_mem) + len);
+    if(!m)
+      {
+        return -1;
+      }
+    m->adr = strtoul(arg, NULL, 0);
+    m->len = len;
+    for(i=0;i<len;i++)
+      {
+        if(!isxdigit(hex[2*i]) || !isxdigit(hex[2*i+1]) ||
+           sscanf(hex + 2*i, "%2x", &val) != 1)
+          {
+            free(m);
+            return -1;
+          }
+        m->data[i] = val;
+      }
+    //keep file order, later presets overwrite earlier ones
+    while(*list)
+      {
+        list = &(*list)->next;
+      }
+    m->next = NULL;
+    *list = m;
+    return 0;
+  }
+
+static int vec_parse(struct vector *v, char *line)
+  {
+    char *tok;
+    char *end;
+    int ret = 0;
+
+    tok = strtok_r(line, " \t\r\n", &end);
+    strncpy(v->name, tok, sizeof(v->name) - 1);
+    v->name[sizeof(v->name) - 1] = 0;
+    v->budget = VEC_BUDGET;
+
+    while(ret == 0 && (tok = strtok_r(NULL, " \t\r\n", &end)) != NULL)
+      {
+        if(tok[0] == '#')
+          {
+            break;
+          }
+        if(tok[0] != '-' || !tok[1] || !tok[2])
+          {
+            return -1;
+          }
+        switch(tok[1])
+          {
+            case 'p': ret = vec_parse_regs(tok + 2, v->preset, &v->npreset); break;
+            case 'e': ret = vec_parse_regs(tok + 2, v->expect, &v->nexpect); break;
+            case 'm': ret = vec_parse_mem (tok + 2, &v->mem);    break;
+            case 'E': ret = vec_parse_mem (tok + 2, &v->expmem); break;
+            case 'c':
+              v->checkclocks = true;
+              v->clocks = strtoull(tok + 2, NULL, 0);
+              break;
+            case 'b': v->budget = strtoull(tok + 2, NULL, 0); break;
+            default : ret = -1;
+          }
+      }
+    return ret;
+  }
+
+static int vec_load(struct batch *b, const char *fname)
+  {
+    FILE *f;
+    char line[4096];
+    char *ptr;
+    int lineno = 0;
+    struct vector *vecs;
+    struct vector *v;
+
+    f = fopen(fname, "r");
+    if(!f)
+      {
+        printf("Unable to open: %s\n", fname);
+        return -1;
+      }
+    while(fgets(line, sizeof(line), f))
+      {
+        lineno++;
+        for(ptr = line; isspace(*ptr); ptr++);
+        if(!*ptr || *ptr == '#')
+          {
+            continue;
+          }
+        vecs = realloc(b->vecs, (b->count + 1) * sizeof(struct vector));
+        if(!vecs)
+          {
+            printf("cannot alloc vectors\n");
+            fclose(f);
+            return -1;
+          }
+        b->vecs = vecs;
+        v = &b->vecs[b->count];
+        memset(v, 0, sizeof(struct vector));
+        v->file = fname;
+        v->line = lineno;
+        if(vec_parse(v, ptr) < 0)
+          {
+            printf("%s:%d: bad vector\n", fname, lineno);
+            fclose(f);
+            return -1;
+          }
+        b->count++;
+      }
+    fclose(f);
+    return 0;
+  }
+
+static void vec_run(struct hc11_sim *sim, struct hc11_baseline *base, struct vector *v)
+  {
+    struct vec_mem *m;
+    uint8_t buf[256];
+    uint16_t pc = 0;
+    uint16_t val;
+    uint64_t start;
+    int ret;
+    int i;
+    int j;
+
+    hc11_baseline_restore(base);
+    for(m = v->mem; m; m = m->next)
+      {
+        hc11_sim_write(sim, m->adr, m->data, m->len);
+      }
+    for(i=0;i<v->npreset;i++)
+      {
+        hc11_sim_set_reg(sim, v->preset[i].reg, v->preset[i].val);
+      }
+    hc11_sim_get_reg(sim, HC11_REG_PC, &pc);
+    hc11_sim_start(sim, pc);
+    start = hc11_sim_clocks(sim);
+    ret = hc11_sim_run(sim, v->budget);
+    v->took = hc11_sim_clocks(sim) - start;
+    v->pass = false;
+
+    if(ret != HC11_SIM_STOP)
+      {
+        hc11_sim_get_reg(sim, HC11_REG_PC, &pc);
+        snprintf(v->msg, sizeof(v->msg), "%s at pc=0x%04X",
+                 (ret == HC11_SIM_BUDGET)  ? "timeout" :
+                 (ret == HC11_SIM_ILLEGAL) ? "illegal opcode" : "stopped", pc);
+        return;
+      }
+    for(i=0;i<v->nexpect;i++)
+      {
+        hc11_sim_get_reg(sim, v->expect[i].reg, &val);
+        if(val != v->expect[i].val)
+          {
+            snprintf(v->msg, sizeof(v->msg), "reg %s=0x%04X expected 0x%04X",
+                     vec_regname(v->expect[i].reg), val, v->expect[i].val);
+            return;
+          }
+      }
+    for(m = v->expmem; m; m = m->next)
+      {
+        for(i=0;i<m->len;i+=sizeof(buf))
+          {
+            int len = (m->len - i < sizeof(buf)) ? m->len - i : sizeof(buf);
+            hc11_sim_read(sim, m->adr + i, buf, len);
+            for(j=0;j<len;j++)
+              {
+                if(buf[j] != m->data[i + j])
+                  {
+                    snprintf(v->msg, sizeof(v->msg), "mem 0x%04X=0x%02X expected 0x%02X",
+                             (uint16_t)(m->adr + i + j), buf[j], m->data[i + j]);
+                    return;
+                  }
+              }
+          }
+      }
+    if(v->checkclocks && v->took != v->clocks)
+      {
+        snprintf(v->msg, sizeof(v->msg), "clocks=%"PRIu64" expected %"PRIu64,
+                 v->took, v->clocks);
+        return;
+      }
+    v->pass = true;
+  }
+
+static void *vec_worker(void *arg)
+  {
+    struct batch *b = arg;
+    struct hc11_sim *sim;
+    struct hc11_baseline *base;
+    int i;
+
+    sim = hc11_sim_create();
+    if(!sim)
+      {
+        return NULL;
+      }
+    //same memory map as sim -w
+    if(hc11_sim_map_ram(sim, 0x0000, 0x8000) < 0 ||
+       hc11_sim_map_ram(sim, 0xE000, 0x2000) < 0)
+      {
+        hc11_sim_destroy(sim);
+        return NULL;
+      }
+    base = hc11_baseline_capture(hc11_sim_core(sim));
+    if(base)
+      {
+        while((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->count)
+          {
+            vec_run(sim, base, &b->vecs[i]);
+          }
+        hc11_baseline_free(base);
+      }
+    hc11_sim_destroy(sim);
+    return NULL;
+  }
+
+int main(int argc, char **argv)
+  {
+    struct batch b;
+    pthread_t *threads;
+    struct vector *v;
+    int nthreads = 0;
+    bool quiet = false;
+    int failed = 0;
+    int c;
+    int i;
+
+    while((c = getopt(argc, argv, "j:qh")) != -1)
+      {
+        switch(c)
+          {
+            case 'j': nthreads = atoi(optarg); break;
+            case 'q': quiet = true; break;
+            default : help(); return 2;
+          }
+      }
+    if(optind == argc)
+      {
+        help();
+        return 2;
+      }
+
+    b.vecs  = NULL;
+    b.count = 0;
+    b.next  = 0;
+    for(i=optind;i<argc;i++)
+      {
+        if(vec_load(&b, argv[i]) < 0)
+          {
+            return 2;
+          }
+      }
+    //vectors not run because a worker could not start are reported as failed
+    for(i=0;i<b.count;i++)
+      {
+        strcpy(b.vecs[i].msg, "not run");
+      }
+
+    if(nthreads <= 0)
+      {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+      }
+    if(nthreads > b.count)
+      {
+        nthreads = b.count ? b.count : 1;
+      }
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if(!threads)
+      {
+        return 2;
+      }
+    for(i=0;i<nthreads;i++)
+      {
+        pthread_create(&threads[i], NULL, vec_worker, &b);
+      }
+    for(i=0;i<nthreads;i++)
+      {
+        pthread_join(threads[i], NULL);
+      }
+
+    if(!quiet)
+      {
+        printf("1..%d\n", b.count);
+      }
+    for(i=0;i<b.count;i++)
+      {
+        v = &b.vecs[i];
+        if(!v->pass)
+          {
+            failed++;
+            printf("not ok %d - %s # %s:%d: %s\n", i + 1, v->name, v->file, v->line, v->msg);
+          }
+        else if(!quiet)
+          {
+            printf("ok %d - %s # clocks=%"PRIu64"\n", i + 1, v->name, v->took);
+          }
+      }
+    if(!quiet || failed)
+      {
+        printf("# %d vectors, %d failed\n", b.count, failed);
+      }
+    return failed ? 1 : 0;
+  }